@@ -0,0 +1,1565 @@
+#include "analysis/comptime_eval.h"
+#include "platform/os.h"
+#include "zprep.h"
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Statements and loop iterations run before a block is handed to the C
+// compiler instead; a compiled loop is faster than this walker.
+#define CT_STEP_LIMIT 10000000L
+#define CT_ARRAY_MAX (1 << 20)
+
+// Sizes of the buffers behind f-strings (see create_fstring_block()).
+#define CT_FSTRING_MAX 4096
+#define CT_FSTRING_PART_MAX 128
+
+typedef enum
+{
+    CT_NONE,
+    CT_BOOL,
+    CT_CHAR,
+    CT_I8,
+    CT_U8,
+    CT_I16,
+    CT_U16,
+    CT_I32,
+    CT_I64,
+    CT_STR
+} CtType;
+
+typedef struct
+{
+    CtType type;
+    long long i;
+    const char *s;
+} CtValue;
+
+typedef struct
+{
+    const char *name;
+    CtValue val;
+    long long *elems; // Fixed-size arrays; val.type is the element type.
+    int count;
+} CtVar;
+
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t cap;
+} CtBuf;
+
+// What the walker keeps per node: decoded string literals, the static
+// buffer of each f-string, decoded println statements.
+typedef struct
+{
+    ASTNode *node;
+    void *data;
+} CtSlot;
+
+typedef enum
+{
+    CT_FLOW_NEXT,
+    CT_FLOW_BREAK,
+    CT_FLOW_CONTINUE,
+    CT_FLOW_RETURN
+} CtFlow;
+
+typedef struct
+{
+    CtVar *vars;
+    int var_count;
+    int var_cap;
+    CtSlot *slots;
+    int slot_count;
+    int slot_cap;
+    CtBuf out;
+    CtBuf err;
+    CtBuf fstring; // Scratch space for f-strings.
+    CtBuf part;
+    long steps;
+    ComptimeEvalResult why;
+    jmp_buf bail;
+} CtState;
+
+static void ct_bail(CtState *st, ComptimeEvalResult why)
+{
+    st->why = why;
+    longjmp(st->bail, 1);
+}
+
+static void ct_step(CtState *st)
+{
+    if (++st->steps > CT_STEP_LIMIT)
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+}
+
+static void ct_buf_append(CtBuf *b, const char *s, size_t n)
+{
+    if (b->len + n + 1 > b->cap)
+    {
+        b->cap = (b->len + n + 1) * 2;
+        b->data = xrealloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = 0;
+}
+
+static void ct_buf_printf(CtBuf *b, const char *spec, ...)
+{
+    va_list ap;
+    va_start(ap, spec);
+    va_list ap2;
+    va_copy(ap2, ap);
+    char small[256];
+    int n = vsnprintf(small, sizeof(small), spec, ap);
+    va_end(ap);
+    if (n > 0 && n < (int)sizeof(small))
+    {
+        ct_buf_append(b, small, n);
+    }
+    else if (n > 0)
+    {
+        char *tmp = xmalloc(n + 1);
+        vsnprintf(tmp, n + 1, spec, ap2);
+        ct_buf_append(b, tmp, n);
+        free(tmp);
+    }
+    va_end(ap2);
+}
+
+// Types
+
+static CtType ct_type_of(Type *t)
+{
+    if (!t)
+    {
+        return CT_NONE;
+    }
+    switch (t->kind)
+    {
+    case TYPE_BOOL:
+        return CT_BOOL;
+    case TYPE_CHAR:
+    case TYPE_C_CHAR:
+        return CT_CHAR;
+    case TYPE_I8:
+        return CT_I8;
+    case TYPE_U8:
+    case TYPE_BYTE:
+    case TYPE_C_UCHAR:
+        return CT_U8;
+    case TYPE_I16:
+    case TYPE_C_SHORT:
+        return CT_I16;
+    case TYPE_U16:
+    case TYPE_C_USHORT:
+        return CT_U16;
+    case TYPE_I32:
+    case TYPE_INT:
+    case TYPE_C_INT:
+    case TYPE_RUNE:
+        return CT_I32;
+    case TYPE_I64:
+    case TYPE_C_LONG_LONG:
+        return CT_I64;
+    case TYPE_C_LONG:
+        return sizeof(long) == 8 ? CT_I64 : CT_I32;
+    case TYPE_STRING:
+        return CT_STR;
+    case TYPE_POINTER:
+        return (t->inner && t->inner->kind == TYPE_CHAR) ? CT_STR : CT_NONE;
+    default:
+        return CT_NONE;
+    }
+}
+
+static CtType ct_type_named(const char *name)
+{
+    static const struct
+    {
+        const char *name;
+        CtType type;
+    } names[] = {
+        {"int", CT_I32},       {"i32", CT_I32},          {"int32_t", CT_I32},
+        {"c_int", CT_I32},     {"long", CT_I64},         {"i64", CT_I64},
+        {"int64_t", CT_I64},   {"long long", CT_I64},    {"short", CT_I16},
+        {"i16", CT_I16},       {"int16_t", CT_I16},      {"i8", CT_I8},
+        {"int8_t", CT_I8},     {"u8", CT_U8},            {"uint8_t", CT_U8},
+        {"byte", CT_U8},       {"unsigned char", CT_U8}, {"u16", CT_U16},
+        {"uint16_t", CT_U16},  {"char", CT_CHAR},        {"bool", CT_BOOL},
+        {"string", CT_STR},    {"char*", CT_STR},        {"const char*", CT_STR},
+    };
+    for (size_t i = 0; name && i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (strcmp(name, names[i].name) == 0)
+        {
+            return names[i].type;
+        }
+    }
+    return CT_NONE;
+}
+
+static int ct_is_int(CtType t)
+{
+    return t != CT_NONE && t != CT_STR;
+}
+
+// Converts a value to a C integer type, as an assignment or cast would.
+static long long ct_wrap(CtType t, long long v)
+{
+    switch (t)
+    {
+    case CT_BOOL:
+        return v != 0;
+    case CT_CHAR:
+        return (char)v;
+    case CT_I8:
+        return (signed char)v;
+    case CT_U8:
+        return (unsigned char)v;
+    case CT_I16:
+        return (short)v;
+    case CT_U16:
+        return (unsigned short)v;
+    case CT_I32:
+        return (int)v;
+    default:
+        return v;
+    }
+}
+
+static CtValue ct_int(CtType t, long long v)
+{
+    CtValue r = {t, ct_wrap(t, v), NULL};
+    return r;
+}
+
+// Variables
+
+static CtVar *ct_lookup(CtState *st, const char *name)
+{
+    for (int i = st->var_count - 1; i >= 0; i--)
+    {
+        if (strcmp(st->vars[i].name, name) == 0)
+        {
+            return &st->vars[i];
+        }
+    }
+    return NULL;
+}
+
+static CtVar *ct_declare(CtState *st, const char *name)
+{
+    if (st->var_count == st->var_cap)
+    {
+        st->var_cap = st->var_cap ? st->var_cap * 2 : 32;
+        st->vars = xrealloc(st->vars, sizeof(CtVar) * st->var_cap);
+    }
+    CtVar *v = &st->vars[st->var_count++];
+    memset(v, 0, sizeof(*v));
+    v->name = name;
+    return v;
+}
+
+static void ct_pop_scope(CtState *st, int mark)
+{
+    for (int i = mark; i < st->var_count; i++)
+    {
+        free(st->vars[i].elems);
+    }
+    st->var_count = mark;
+}
+
+// Strings
+
+static void **ct_slot(CtState *st, ASTNode *node)
+{
+    for (int i = 0; i < st->slot_count; i++)
+    {
+        if (st->slots[i].node == node)
+        {
+            return &st->slots[i].data;
+        }
+    }
+    if (st->slot_count == st->slot_cap)
+    {
+        st->slot_cap = st->slot_cap ? st->slot_cap * 2 : 16;
+        st->slots = xrealloc(st->slots, sizeof(CtSlot) * st->slot_cap);
+    }
+    st->slots[st->slot_count].node = node;
+    st->slots[st->slot_count].data = NULL;
+    return &st->slots[st->slot_count++].data;
+}
+
+// Decodes the body of a C string or char literal. Returns the number of
+// bytes written to out (which needs room for len + 1), or -1 on an escape
+// we do not know.
+static int ct_unescape(const char *s, size_t len, char *out)
+{
+    int n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] != '\\')
+        {
+            out[n++] = s[i];
+            continue;
+        }
+        if (++i >= len)
+        {
+            return -1;
+        }
+        char c = s[i];
+        switch (c)
+        {
+        case 'n':
+            out[n++] = '\n';
+            break;
+        case 't':
+            out[n++] = '\t';
+            break;
+        case 'r':
+            out[n++] = '\r';
+            break;
+        case 'a':
+            out[n++] = '\a';
+            break;
+        case 'b':
+            out[n++] = '\b';
+            break;
+        case 'f':
+            out[n++] = '\f';
+            break;
+        case 'v':
+            out[n++] = '\v';
+            break;
+        case 'e':
+            out[n++] = 27;
+            break;
+        case '\\':
+        case '\'':
+        case '"':
+        case '?':
+            out[n++] = c;
+            break;
+        case 'x':
+        {
+            int v = 0, digits = 0;
+            while (i + 1 < len && strchr("0123456789abcdefABCDEF", s[i + 1]) && s[i + 1])
+            {
+                char h = s[++i];
+                v = v * 16 + (h <= '9' ? h - '0' : (h | 32) - 'a' + 10);
+                digits++;
+            }
+            if (digits == 0 || digits > 2)
+            {
+                return -1;
+            }
+            out[n++] = (char)v;
+            break;
+        }
+        default:
+            if (c >= '0' && c <= '7')
+            {
+                int v = c - '0';
+                for (int k = 0; k < 2 && i + 1 < len && s[i + 1] >= '0' && s[i + 1] <= '7'; k++)
+                {
+                    v = v * 8 + (s[++i] - '0');
+                }
+                out[n++] = (char)v;
+                break;
+            }
+            return -1;
+        }
+    }
+    out[n] = 0;
+    return n;
+}
+
+// Decodes the C literal text `s` once per node.
+static const char *ct_decoded(CtState *st, ASTNode *node, const char *s, size_t len)
+{
+    void **slot = ct_slot(st, node);
+    if (!*slot)
+    {
+        char *str = xmalloc(len + 1);
+        if (ct_unescape(s, len, str) < 0)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        *slot = str;
+    }
+    return *slot;
+}
+
+static const char *ct_string_literal(CtState *st, ASTNode *node)
+{
+    const char *s = node->literal.string_val;
+    return ct_decoded(st, node, s, strlen(s));
+}
+
+// Formatting
+
+// Appends `fmt` formatted like printf() would with `args`, as long as every
+// conversion is one whose output we can reproduce exactly.
+static void ct_format(CtState *st, CtBuf *dst, const char *fmt, CtValue *args, int argc)
+{
+    int next = 0;
+    for (const char *p = fmt; *p; p++)
+    {
+        const char *pct = strchr(p, '%');
+        if (!pct)
+        {
+            ct_buf_append(dst, p, strlen(p));
+            break;
+        }
+        ct_buf_append(dst, p, pct - p);
+        p = pct + 1;
+        if (*p == '%')
+        {
+            ct_buf_append(dst, "%", 1);
+            continue;
+        }
+
+        char spec[64];
+        int n = 0;
+        spec[n++] = '%';
+        while (*p && strchr("-+ #0", *p) && n < 40)
+        {
+            spec[n++] = *p++;
+        }
+        while (*p >= '0' && *p <= '9' && n < 40)
+        {
+            spec[n++] = *p++;
+        }
+        if (*p == '.')
+        {
+            spec[n++] = *p++;
+            while (*p >= '0' && *p <= '9' && n < 40)
+            {
+                spec[n++] = *p++;
+            }
+        }
+        if (n >= 40)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+
+        int longs = 0, shorts = 0;
+        while (*p == 'l' || *p == 'h')
+        {
+            if (*p == 'l')
+            {
+                longs++;
+            }
+            else
+            {
+                shorts++;
+            }
+            p++;
+        }
+        char conv = *p;
+        if ((longs && shorts) || longs > 2 || shorts > 2 || !conv || next >= argc)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        CtValue v = args[next++];
+
+        if (conv == 's')
+        {
+            if (v.type != CT_STR || longs || shorts)
+            {
+                ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+            }
+            spec[n++] = 's';
+            spec[n] = 0;
+            ct_buf_printf(dst, spec, v.s);
+            continue;
+        }
+        if (!strchr("diuxXoc", conv) || !ct_is_int(v.type) || (longs > 0) != (v.type == CT_I64))
+        {
+            // Mismatched widths read bits we cannot see; leave them to C.
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        if (conv == 'c')
+        {
+            if (longs || shorts)
+            {
+                ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+            }
+            spec[n++] = 'c';
+            spec[n] = 0;
+            // A NUL is written out like any other byte.
+            char one[64];
+            int w = snprintf(one, sizeof(one), spec, (int)(unsigned char)v.i);
+            if (w < 0 || w >= (int)sizeof(one))
+            {
+                ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+            }
+            ct_buf_append(dst, one, w);
+            continue;
+        }
+
+        spec[n++] = 'l';
+        spec[n++] = 'l';
+        spec[n++] = conv;
+        spec[n] = 0;
+        if (conv == 'd' || conv == 'i')
+        {
+            long long x = longs        ? v.i
+                          : shorts == 2 ? (signed char)v.i
+                          : shorts      ? (short)v.i
+                                        : (int)v.i;
+            ct_buf_printf(dst, spec, x);
+        }
+        else
+        {
+            unsigned long long x = longs       ? (unsigned long long)v.i
+                                   : shorts == 2 ? (unsigned char)v.i
+                                   : shorts    ? (unsigned short)v.i
+                                               : (unsigned int)v.i;
+            ct_buf_printf(dst, spec, x);
+        }
+    }
+}
+
+// The conversion `_z_str(x)` picks for a value.
+static const char *ct_generic_spec(CtState *st, CtValue v)
+{
+    switch (v.type)
+    {
+    case CT_CHAR:
+    case CT_I8:
+        return "%c";
+    case CT_U8:
+    case CT_U16:
+        return "%u";
+    case CT_I16:
+    case CT_I32:
+        return "%d";
+    case CT_I64:
+        return "%ld";
+    case CT_STR:
+        return "%s";
+    default:
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        return NULL;
+    }
+}
+
+// Expressions
+
+static CtValue ct_eval(CtState *st, ASTNode *node);
+static CtFlow ct_exec_list(CtState *st, ASTNode *stmts);
+
+static CtValue ct_eval_int(CtState *st, ASTNode *node)
+{
+    CtValue v = ct_eval(st, node);
+    if (!ct_is_int(v.type))
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+    return v;
+}
+
+static int ct_truthy(CtState *st, ASTNode *node)
+{
+    return ct_eval_int(st, node).i != 0;
+}
+
+// Applies a binary arithmetic operator with C's promotions: everything
+// narrower than int computes as int, and int64 wins over int.
+static CtValue ct_arith(CtState *st, const char *op, CtValue a, CtValue b)
+{
+    if (!ct_is_int(a.type) || !ct_is_int(b.type))
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+    CtType t = (a.type == CT_I64 || b.type == CT_I64) ? CT_I64 : CT_I32;
+    unsigned long long x = (unsigned long long)a.i;
+    unsigned long long y = (unsigned long long)b.i;
+    long long min = t == CT_I64 ? LLONG_MIN : INT_MIN;
+    int bits = t == CT_I64 ? 64 : 32;
+
+    if (strcmp(op, "+") == 0)
+    {
+        return ct_int(t, (long long)(x + y));
+    }
+    if (strcmp(op, "-") == 0)
+    {
+        return ct_int(t, (long long)(x - y));
+    }
+    if (strcmp(op, "*") == 0)
+    {
+        return ct_int(t, (long long)(x * y));
+    }
+    if (strcmp(op, "/") == 0 || strcmp(op, "%") == 0)
+    {
+        if (b.i == 0 || (a.i == min && b.i == -1))
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        return ct_int(t, op[0] == '/' ? a.i / b.i : a.i % b.i);
+    }
+    if (strcmp(op, "<<") == 0 || strcmp(op, ">>") == 0)
+    {
+        t = a.type == CT_I64 ? CT_I64 : CT_I32;
+        bits = t == CT_I64 ? 64 : 32;
+        if (b.i < 0 || b.i >= bits)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        return ct_int(t, op[0] == '<' ? (long long)(x << b.i) : a.i >> b.i);
+    }
+    if (strcmp(op, "&") == 0)
+    {
+        return ct_int(t, (long long)(x & y));
+    }
+    if (strcmp(op, "|") == 0)
+    {
+        return ct_int(t, (long long)(x | y));
+    }
+    if (strcmp(op, "^") == 0)
+    {
+        return ct_int(t, (long long)(x ^ y));
+    }
+    if (strcmp(op, "==") == 0)
+    {
+        return ct_int(CT_I32, a.i == b.i);
+    }
+    if (strcmp(op, "!=") == 0)
+    {
+        return ct_int(CT_I32, a.i != b.i);
+    }
+    if (strcmp(op, "<") == 0)
+    {
+        return ct_int(CT_I32, a.i < b.i);
+    }
+    if (strcmp(op, ">") == 0)
+    {
+        return ct_int(CT_I32, a.i > b.i);
+    }
+    if (strcmp(op, "<=") == 0)
+    {
+        return ct_int(CT_I32, a.i <= b.i);
+    }
+    if (strcmp(op, ">=") == 0)
+    {
+        return ct_int(CT_I32, a.i >= b.i);
+    }
+    ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    return a;
+}
+
+// Resolves an assignable expression: a scalar variable or an array element.
+static long long *ct_lvalue(CtState *st, ASTNode *node, CtVar **var_out, CtType *type_out)
+{
+    if (node->type == NODE_EXPR_VAR)
+    {
+        CtVar *v = ct_lookup(st, node->var_ref.name);
+        if (!v || v->elems)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        *var_out = v;
+        *type_out = v->val.type;
+        return &v->val.i;
+    }
+    if (node->type == NODE_EXPR_INDEX && node->index.array->type == NODE_EXPR_VAR)
+    {
+        CtVar *v = ct_lookup(st, node->index.array->var_ref.name);
+        if (!v || !v->elems)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        long long i = ct_eval_int(st, node->index.index).i;
+        if (i < 0 || i >= v->count)
+        {
+            // Out of bounds: the compiled block reports it.
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        *var_out = NULL;
+        *type_out = v->val.type;
+        return &v->elems[i];
+    }
+    ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    return NULL;
+}
+
+static CtValue ct_assign(CtState *st, ASTNode *node)
+{
+    const char *op = node->binary.op;
+    CtVar *var = NULL;
+    CtType type = CT_NONE;
+    long long *slot = ct_lvalue(st, node->binary.left, &var, &type);
+
+    if (type == CT_STR)
+    {
+        CtValue v = ct_eval(st, node->binary.right);
+        if (strcmp(op, "=") != 0 || v.type != CT_STR)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        var->val.s = v.s;
+        return v;
+    }
+
+    CtValue rhs = ct_eval_int(st, node->binary.right);
+    if (strcmp(op, "=") != 0)
+    {
+        char bop[4];
+        size_t n = strlen(op) - 1;
+        if (n == 0 || n >= sizeof(bop))
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        memcpy(bop, op, n);
+        bop[n] = 0;
+        CtValue cur = {type, *slot, NULL};
+        rhs = ct_arith(st, bop, cur, rhs);
+    }
+    *slot = ct_wrap(type, rhs.i);
+    return ct_int(type, *slot);
+}
+
+static int ct_is_assign_op(const char *op)
+{
+    static const char *ops[] = {"=",  "+=", "-=", "*=",  "/=",  "%=",
+                                "&=", "|=", "^=", "<<=", ">>=", NULL};
+    for (int i = 0; ops[i]; i++)
+    {
+        if (strcmp(op, ops[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static CtValue ct_unary(CtState *st, ASTNode *node)
+{
+    const char *op = node->unary.op;
+    if (strcmp(op, "++") == 0 || strcmp(op, "--") == 0 || strcmp(op, "_post++") == 0 ||
+        strcmp(op, "_post--") == 0)
+    {
+        CtVar *var = NULL;
+        CtType type = CT_NONE;
+        long long *slot = ct_lvalue(st, node->unary.operand, &var, &type);
+        if (!ct_is_int(type) || type == CT_BOOL)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        long long old = *slot;
+        int up = strchr(op, '+') != NULL;
+        *slot = ct_wrap(type, (long long)((unsigned long long)old + (up ? 1ULL : -1ULL)));
+        return ct_int(type, op[0] == '_' ? old : *slot);
+    }
+
+    CtValue v = ct_eval_int(st, node->unary.operand);
+    CtType t = v.type == CT_I64 ? CT_I64 : CT_I32;
+    if (strcmp(op, "-") == 0)
+    {
+        return ct_int(t, (long long)(0ULL - (unsigned long long)v.i));
+    }
+    if (strcmp(op, "+") == 0)
+    {
+        return ct_int(t, v.i);
+    }
+    if (strcmp(op, "~") == 0)
+    {
+        return ct_int(t, ~v.i);
+    }
+    if (strcmp(op, "!") == 0)
+    {
+        return ct_int(CT_I32, !v.i);
+    }
+    ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    return v;
+}
+
+// Builds an f-string into the static buffer its block declares, so values
+// taken from the same f-string alias each other as they do in C.
+static CtValue ct_fstring(CtState *st, ASTNode *block)
+{
+    CtBuf *b = &st->fstring;
+    CtBuf *part = &st->part;
+    b->len = 0;
+    part->len = 0;
+
+    for (ASTNode *s = block->block.statements; s; s = s->next)
+    {
+        if (s->type == NODE_RAW_STMT)
+        {
+            const char *c = s->raw_stmt.content;
+            size_t len = strlen(c);
+            if (strcmp(c, "static char _b[4096]; _b[0]=0;") == 0 ||
+                strcmp(c, "char _t[128];") == 0 || strcmp(c, "_b;") == 0)
+            {
+                continue;
+            }
+            if (strcmp(c, "strcat(_b, _t);") == 0)
+            {
+                ct_buf_append(b, part->data ? part->data : "", part->len);
+                continue;
+            }
+            if (len > 15 && strncmp(c, "strcat(_b, \"", 12) == 0 &&
+                strcmp(c + len - 3, "\");") == 0)
+            {
+                const char *lit = ct_decoded(st, s, c + 12, len - 15);
+                ct_buf_append(b, lit, strlen(lit));
+                continue;
+            }
+        }
+        else if (s->type == NODE_EXPR_CALL && s->call.callee->type == NODE_EXPR_VAR &&
+                 strcmp(s->call.callee->var_ref.name, "sprintf") == 0 && s->call.args &&
+                 s->call.args->next && s->call.args->next->next)
+        {
+            ASTNode *fmt = s->call.args->next;
+            CtValue v = ct_eval(st, fmt->next);
+            const char *spec = NULL;
+            if (fmt->type == NODE_EXPR_LITERAL && fmt->literal.type_kind == LITERAL_STRING)
+            {
+                spec = ct_string_literal(st, fmt);
+            }
+            else if (fmt->type == NODE_EXPR_CALL && fmt->call.callee->type == NODE_EXPR_VAR &&
+                     strcmp(fmt->call.callee->var_ref.name, "_z_str") == 0)
+            {
+                spec = ct_generic_spec(st, v);
+            }
+            if (spec)
+            {
+                part->len = 0;
+                ct_format(st, part, spec, &v, 1);
+                if (part->len < CT_FSTRING_PART_MAX)
+                {
+                    continue;
+                }
+            }
+        }
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+
+    if (b->len >= CT_FSTRING_MAX)
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+    void **slot = ct_slot(st, block);
+    if (!*slot)
+    {
+        *slot = xmalloc(CT_FSTRING_MAX);
+    }
+    memcpy(*slot, b->data ? b->data : "", b->len + 1);
+    CtValue r = {CT_STR, 0, *slot};
+    return r;
+}
+
+static CtValue ct_call(CtState *st, ASTNode *node)
+{
+    if (node->call.callee->type != NODE_EXPR_VAR)
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+    const char *name = node->call.callee->var_ref.name;
+
+    CtValue args[16];
+    int argc = 0;
+    for (ASTNode *a = node->call.args; a; a = a->next)
+    {
+        if (argc == 16)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        args[argc++] = ct_eval(st, a);
+    }
+
+    if (strcmp(name, "printf") == 0 && argc >= 1 && args[0].type == CT_STR)
+    {
+        size_t before = st->out.len;
+        ct_format(st, &st->out, args[0].s, args + 1, argc - 1);
+        return ct_int(CT_I32, (long long)(st->out.len - before));
+    }
+    if (argc != 1 || args[0].type != CT_STR)
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+    if (strcmp(name, "yield") == 0 || strcmp(name, "code") == 0)
+    {
+        ct_buf_append(&st->out, args[0].s, strlen(args[0].s));
+    }
+    else if (strcmp(name, "compile_warn") == 0)
+    {
+        ct_buf_printf(&st->err, "Compile-time warning: %s\n", args[0].s);
+    }
+    else if (strcmp(name, "compile_error") == 0)
+    {
+        ct_buf_printf(&st->err, "Compile-time error: %s\n", args[0].s);
+        ct_bail(st, COMPTIME_EVAL_FAILED);
+    }
+    else
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+    return ct_int(CT_I32, 0);
+}
+
+static CtValue ct_eval(CtState *st, ASTNode *node)
+{
+    if (!node)
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+
+    switch (node->type)
+    {
+    case NODE_EXPR_LITERAL:
+        if (node->literal.type_kind == LITERAL_INT)
+        {
+            if (node->literal.int_val > (unsigned long long)LLONG_MAX)
+            {
+                break;
+            }
+            long long v = (long long)node->literal.int_val;
+            return ct_int(v > INT_MAX ? CT_I64 : CT_I32, v);
+        }
+        if (node->literal.type_kind == LITERAL_STRING)
+        {
+            CtValue r = {CT_STR, 0, ct_string_literal(st, node)};
+            return r;
+        }
+        if (node->literal.type_kind == LITERAL_CHAR)
+        {
+            const char *s = node->literal.string_val;
+            size_t len = s ? strlen(s) : 0;
+            char buf[8];
+            if (len >= 3 && len < sizeof(buf) && s[0] == '\'' && s[len - 1] == '\'' &&
+                ct_unescape(s + 1, len - 2, buf) == 1)
+            {
+                return ct_int(CT_I32, (char)buf[0]);
+            }
+        }
+        break;
+
+    case NODE_EXPR_VAR:
+    {
+        CtVar *v = ct_lookup(st, node->var_ref.name);
+        if (v && !v->elems)
+        {
+            return v->val;
+        }
+        if (!v && strcmp(node->var_ref.name, "true") == 0)
+        {
+            return ct_int(CT_I32, 1);
+        }
+        if (!v && strcmp(node->var_ref.name, "false") == 0)
+        {
+            return ct_int(CT_I32, 0);
+        }
+        break;
+    }
+
+    case NODE_EXPR_INDEX:
+    {
+        CtVar *var = NULL;
+        CtType type = CT_NONE;
+        long long *slot = ct_lvalue(st, node, &var, &type);
+        return ct_int(type, *slot);
+    }
+
+    case NODE_EXPR_BINARY:
+    {
+        const char *op = node->binary.op;
+        if (ct_is_assign_op(op))
+        {
+            return ct_assign(st, node);
+        }
+        if (strcmp(op, "&&") == 0)
+        {
+            return ct_int(CT_I32, ct_truthy(st, node->binary.left) &&
+                                      ct_truthy(st, node->binary.right));
+        }
+        if (strcmp(op, "||") == 0)
+        {
+            return ct_int(CT_I32, ct_truthy(st, node->binary.left) ||
+                                      ct_truthy(st, node->binary.right));
+        }
+        CtValue a = ct_eval(st, node->binary.left);
+        CtValue b = ct_eval(st, node->binary.right);
+        return ct_arith(st, op, a, b);
+    }
+
+    case NODE_EXPR_UNARY:
+        return ct_unary(st, node);
+
+    case NODE_EXPR_CAST:
+    {
+        CtType t = ct_type_named(node->cast.target_type);
+        CtValue v = ct_eval(st, node->cast.expr);
+        if (t == CT_STR && v.type == CT_STR)
+        {
+            return v;
+        }
+        if (t != CT_STR && ct_is_int(t) && ct_is_int(v.type))
+        {
+            return ct_int(t, v.i);
+        }
+        break;
+    }
+
+    case NODE_TERNARY:
+        return ct_truthy(st, node->ternary.cond) ? ct_eval(st, node->ternary.true_expr)
+                                                 : ct_eval(st, node->ternary.false_expr);
+
+    case NODE_EXPR_CALL:
+        return ct_call(st, node);
+
+    case NODE_BLOCK:
+        if (node->type_info && node->type_info->kind == TYPE_STRING)
+        {
+            return ct_fstring(st, node);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    CtValue none = {CT_NONE, 0, NULL};
+    return none;
+}
+
+// println / print
+
+typedef enum
+{
+    CT_ARG_NONE,    // fprintf(out, "text")
+    CT_ARG_TEXT,    // fprintf(out, "%s", "text")
+    CT_ARG_VAR,     // fprintf(out, "%d", x)
+    CT_ARG_BOOL,    // fprintf(out, "%s", _z_bool_str(x))
+    CT_ARG_GENERIC, // fprintf(out, _z_str(x), _z_arg(x))
+} CtArgKind;
+
+typedef struct CtPrint
+{
+    int to_stderr;
+    char *fmt;
+    CtArgKind kind;
+    char *text;
+    char var[128];
+    struct CtPrint *next;
+} CtPrint;
+
+static const char *ct_skip_ws(const char *p)
+{
+    while (*p == ' ')
+    {
+        p++;
+    }
+    return p;
+}
+
+static int ct_match(const char **p, const char *lit)
+{
+    const char *q = ct_skip_ws(*p);
+    size_t n = strlen(lit);
+    if (strncmp(q, lit, n) != 0)
+    {
+        return 0;
+    }
+    *p = q + n;
+    return 1;
+}
+
+// Reads a C string literal; returns its decoded text, or NULL.
+static char *ct_read_c_string(const char **p)
+{
+    const char *q = ct_skip_ws(*p);
+    if (*q != '"')
+    {
+        return NULL;
+    }
+    const char *end = q + 1;
+    while (*end && *end != '"')
+    {
+        end += (*end == '\\' && end[1]) ? 2 : 1;
+    }
+    if (*end != '"')
+    {
+        return NULL;
+    }
+    char *s = xmalloc(end - q);
+    if (ct_unescape(q + 1, end - q - 1, s) < 0)
+    {
+        free(s);
+        return NULL;
+    }
+    *p = end + 1;
+    return s;
+}
+
+static int ct_read_ident(const char **p, char *buf, size_t size)
+{
+    const char *q = ct_skip_ws(*p);
+    size_t n = 0;
+    while ((q[n] == '_' || (q[n] >= 'a' && q[n] <= 'z') || (q[n] >= 'A' && q[n] <= 'Z') ||
+            (n > 0 && q[n] >= '0' && q[n] <= '9')) &&
+           n + 1 < size)
+    {
+        buf[n] = q[n];
+        n++;
+    }
+    buf[n] = 0;
+    *p = q + n;
+    return n > 0;
+}
+
+// Decodes the C that process_printf_sugar() generates for println/print,
+// `({ fprintf(stdout, "%d", x); ... 0; })`, as long as every argument is a
+// literal or a plain variable. Returns 0 otherwise.
+static int ct_parse_print(const char *c, CtPrint **out)
+{
+    CtPrint *head = NULL;
+    CtPrint **tail = &head;
+    const char *p = c;
+    if (!ct_match(&p, "({"))
+    {
+        return 0;
+    }
+    while (!ct_match(&p, "0;"))
+    {
+        if (ct_match(&p, "fflush(stdout);") || ct_match(&p, "fflush(stderr);"))
+        {
+            continue;
+        }
+        CtPrint *op = xmalloc(sizeof(CtPrint));
+        memset(op, 0, sizeof(*op));
+        if (!ct_match(&p, "fprintf("))
+        {
+            return 0;
+        }
+        if (ct_match(&p, "stderr,"))
+        {
+            op->to_stderr = 1;
+        }
+        else if (!ct_match(&p, "stdout,"))
+        {
+            return 0;
+        }
+
+        op->fmt = ct_read_c_string(&p);
+        if (!op->fmt)
+        {
+            char again[128];
+            op->kind = CT_ARG_GENERIC;
+            if (!ct_match(&p, "_z_str(") || !ct_read_ident(&p, op->var, sizeof(op->var)) ||
+                !ct_match(&p, "),") || !ct_match(&p, "_z_arg(") ||
+                !ct_read_ident(&p, again, sizeof(again)) || strcmp(again, op->var) != 0 ||
+                !ct_match(&p, ")"))
+            {
+                return 0;
+            }
+        }
+        else if (ct_match(&p, ","))
+        {
+            if ((op->text = ct_read_c_string(&p)) != NULL)
+            {
+                op->kind = CT_ARG_TEXT;
+            }
+            else if (ct_match(&p, "_z_bool_str("))
+            {
+                op->kind = CT_ARG_BOOL;
+                if (!ct_read_ident(&p, op->var, sizeof(op->var)) || !ct_match(&p, ")"))
+                {
+                    return 0;
+                }
+            }
+            else
+            {
+                op->kind = CT_ARG_VAR;
+                if (!ct_read_ident(&p, op->var, sizeof(op->var)))
+                {
+                    return 0;
+                }
+            }
+        }
+        if (!ct_match(&p, ");"))
+        {
+            return 0;
+        }
+        *tail = op;
+        tail = &op->next;
+    }
+    if (!ct_match(&p, "})"))
+    {
+        return 0;
+    }
+    ct_match(&p, ";");
+    if (*ct_skip_ws(p) != 0)
+    {
+        return 0;
+    }
+    *out = head;
+    return 1;
+}
+
+static void ct_exec_print(CtState *st, ASTNode *node)
+{
+    void **slot = ct_slot(st, node);
+    if (!*slot)
+    {
+        CtPrint *ops = NULL;
+        if (!ct_parse_print(node->raw_stmt.content, &ops))
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        // An empty list still needs a non-NULL slot.
+        *slot = ops ? (void *)ops : (void *)node;
+    }
+    if (*slot == (void *)node)
+    {
+        return;
+    }
+
+    for (CtPrint *op = *slot; op; op = op->next)
+    {
+        CtValue arg = {CT_NONE, 0, NULL};
+        if (op->kind == CT_ARG_TEXT)
+        {
+            arg.type = CT_STR;
+            arg.s = op->text;
+        }
+        else if (op->kind != CT_ARG_NONE)
+        {
+            CtVar *v = ct_lookup(st, op->var);
+            if (!v || v->elems)
+            {
+                ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+            }
+            arg = v->val;
+            if (op->kind == CT_ARG_BOOL || (op->kind == CT_ARG_GENERIC && arg.type == CT_BOOL))
+            {
+                if (!ct_is_int(arg.type))
+                {
+                    ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+                }
+                arg.type = CT_STR;
+                arg.s = arg.i ? "true" : "false";
+            }
+        }
+        const char *spec = op->kind == CT_ARG_GENERIC ? ct_generic_spec(st, arg) : op->fmt;
+        ct_format(st, op->to_stderr ? &st->err : &st->out, spec, &arg,
+                  arg.type == CT_NONE ? 0 : 1);
+    }
+}
+
+// Statements
+
+static void ct_exec_decl(CtState *st, ASTNode *node)
+{
+    Type *t = node->type_info;
+    if (!t || node->var_decl.is_static || node->var_decl.is_autofree ||
+        strcmp(node->var_decl.name, "_") == 0)
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+
+    if (t->kind == TYPE_ARRAY)
+    {
+        CtType elem = ct_type_of(t->inner);
+        if (!ct_is_int(elem) || t->array_size <= 0 || t->array_size > CT_ARRAY_MAX ||
+            node->var_decl.init_expr)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        long long *elems = xmalloc(sizeof(long long) * t->array_size);
+        memset(elems, 0, sizeof(long long) * t->array_size);
+        CtVar *v = ct_declare(st, node->var_decl.name);
+        v->val.type = elem;
+        v->elems = elems;
+        v->count = t->array_size;
+        return;
+    }
+
+    CtType type = ct_type_of(t);
+    if (type == CT_NONE || (type == CT_STR && !node->var_decl.init_expr))
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+    CtValue init = {type, 0, NULL};
+    if (node->var_decl.init_expr)
+    {
+        init = ct_eval(st, node->var_decl.init_expr);
+        if ((type == CT_STR) != (init.type == CT_STR))
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        if (type != CT_STR)
+        {
+            init = ct_int(type, init.i);
+        }
+    }
+    // Declared after the initializer runs, as C scopes it.
+    CtVar *v = ct_declare(st, node->var_decl.name);
+    v->val = init;
+}
+
+static CtFlow ct_exec(CtState *st, ASTNode *node);
+
+// Runs a loop body; returns 1 if the loop should stop.
+static int ct_loop_body(CtState *st, ASTNode *body, CtFlow *flow)
+{
+    ct_step(st);
+    CtFlow f = ct_exec(st, body);
+    if (f == CT_FLOW_BREAK)
+    {
+        *flow = CT_FLOW_NEXT;
+        return 1;
+    }
+    if (f == CT_FLOW_RETURN)
+    {
+        *flow = f;
+        return 1;
+    }
+    return 0;
+}
+
+static long long ct_parse_count(CtState *st, const char *s)
+{
+    char *end = NULL;
+    long long v = s ? strtoll(s, &end, 10) : 0;
+    if (!s || end == s || *end)
+    {
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+    return v;
+}
+
+static CtFlow ct_exec(CtState *st, ASTNode *node)
+{
+    if (!node)
+    {
+        return CT_FLOW_NEXT;
+    }
+    ct_step(st);
+
+    CtFlow flow = CT_FLOW_NEXT;
+    int mark = st->var_count;
+
+    switch (node->type)
+    {
+    case NODE_BLOCK:
+        flow = ct_exec_list(st, node->block.statements);
+        break;
+
+    case NODE_VAR_DECL:
+        ct_exec_decl(st, node);
+        return CT_FLOW_NEXT;
+
+    case NODE_RAW_STMT:
+        ct_exec_print(st, node);
+        break;
+
+    case NODE_IF:
+        if (ct_truthy(st, node->if_stmt.condition))
+        {
+            flow = ct_exec(st, node->if_stmt.then_body);
+        }
+        else
+        {
+            flow = ct_exec(st, node->if_stmt.else_body);
+        }
+        break;
+
+    case NODE_UNLESS:
+        if (!ct_truthy(st, node->unless_stmt.condition))
+        {
+            flow = ct_exec(st, node->unless_stmt.body);
+        }
+        break;
+
+    case NODE_WHILE:
+        while (ct_truthy(st, node->while_stmt.condition))
+        {
+            if (ct_loop_body(st, node->while_stmt.body, &flow))
+            {
+                break;
+            }
+        }
+        break;
+
+    case NODE_DO_WHILE:
+        do
+        {
+            if (ct_loop_body(st, node->do_while_stmt.body, &flow))
+            {
+                break;
+            }
+        } while (ct_truthy(st, node->do_while_stmt.condition));
+        break;
+
+    case NODE_LOOP:
+        while (!ct_loop_body(st, node->loop_stmt.body, &flow))
+        {
+        }
+        break;
+
+    case NODE_REPEAT:
+    {
+        long long n = ct_parse_count(st, node->repeat_stmt.count);
+        for (long long i = 0; i < n; i++)
+        {
+            if (ct_loop_body(st, node->repeat_stmt.body, &flow))
+            {
+                break;
+            }
+        }
+        break;
+    }
+
+    case NODE_FOR:
+        if (ct_exec(st, node->for_stmt.init) != CT_FLOW_NEXT)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        while (!node->for_stmt.condition || ct_truthy(st, node->for_stmt.condition))
+        {
+            if (ct_loop_body(st, node->for_stmt.body, &flow))
+            {
+                break;
+            }
+            if (node->for_stmt.step)
+            {
+                ct_eval(st, node->for_stmt.step);
+            }
+        }
+        break;
+
+    case NODE_FOR_RANGE:
+    {
+        long long step = node->for_range.step ? ct_parse_count(st, node->for_range.step) : 1;
+        CtValue start = ct_eval_int(st, node->for_range.start);
+        CtVar *v = ct_declare(st, node->for_range.var_name);
+        int idx = st->var_count - 1;
+        v->val = start;
+        for (;;)
+        {
+            long long cur = st->vars[idx].val.i;
+            long long end = ct_eval_int(st, node->for_range.end).i;
+            int more = step < 0 ? (node->for_range.is_inclusive ? cur >= end : cur > end)
+                                : (node->for_range.is_inclusive ? cur <= end : cur < end);
+            if (!more || ct_loop_body(st, node->for_range.body, &flow))
+            {
+                break;
+            }
+            CtVar *iv = &st->vars[idx];
+            unsigned long long next = (unsigned long long)iv->val.i + (unsigned long long)step;
+            iv->val.i = ct_wrap(iv->val.type, (long long)next);
+        }
+        break;
+    }
+
+    case NODE_BREAK:
+        if (node->break_stmt.target_label)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        return CT_FLOW_BREAK;
+
+    case NODE_CONTINUE:
+        if (node->continue_stmt.target_label)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        return CT_FLOW_CONTINUE;
+
+    case NODE_RETURN:
+        // A non-zero status fails the block; let the compiled run report it.
+        if (node->ret.value && ct_eval_int(st, node->ret.value).i != 0)
+        {
+            ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+        }
+        return CT_FLOW_RETURN;
+
+    case NODE_AST_COMMENT:
+        break;
+
+    default:
+        if (node->type >= NODE_EXPR_BINARY && node->type <= NODE_EXPR_SLICE)
+        {
+            ct_eval(st, node);
+            break;
+        }
+        ct_bail(st, COMPTIME_EVAL_UNSUPPORTED);
+    }
+
+    ct_pop_scope(st, mark);
+    return flow;
+}
+
+static CtFlow ct_exec_list(CtState *st, ASTNode *stmts)
+{
+    for (ASTNode *s = stmts; s; s = s->next)
+    {
+        CtFlow f = ct_exec(st, s);
+        if (f != CT_FLOW_NEXT)
+        {
+            return f;
+        }
+    }
+    return CT_FLOW_NEXT;
+}
+
+ComptimeEvalResult comptime_eval(ASTNode *stmts, char **out, char **err)
+{
+    CtState *st = xmalloc(sizeof(CtState));
+    memset(st, 0, sizeof(*st));
+    *out = NULL;
+    *err = NULL;
+
+    ComptimeEvalResult result = COMPTIME_EVAL_OK;
+    if (setjmp(st->bail) == 0)
+    {
+        CtVar *target = ct_declare(st, "__COMPTIME_TARGET__");
+        target->val.type = CT_STR;
+        target->val.s = z_get_system_name();
+        CtVar *file = ct_declare(st, "__COMPTIME_FILE__");
+        file->val.type = CT_STR;
+        file->val.s = g_current_filename ? g_current_filename : "";
+
+        CtFlow flow = ct_exec_list(st, stmts);
+        if (flow == CT_FLOW_BREAK || flow == CT_FLOW_CONTINUE)
+        {
+            result = COMPTIME_EVAL_UNSUPPORTED;
+        }
+    }
+    else
+    {
+        result = st->why;
+    }
+
+    if (result != COMPTIME_EVAL_UNSUPPORTED)
+    {
+        *err = st->err.data ? st->err.data : xstrdup("");
+        st->err.data = NULL;
+    }
+    if (result == COMPTIME_EVAL_OK)
+    {
+        *out = st->out.data ? st->out.data : xstrdup("");
+        st->out.data = NULL;
+    }
+
+    ct_pop_scope(st, 0);
+    free(st->slots);
+    free(st->vars);
+    free(st->out.data);
+    free(st->err.data);
+    free(st);
+    return result;
+}
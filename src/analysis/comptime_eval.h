@@ -0,0 +1,35 @@
+#ifndef COMPTIME_EVAL_H
+#define COMPTIME_EVAL_H
+
+#include "ast/ast.h"
+
+// Direct evaluation of `comptime` blocks.
+//
+// Most comptime blocks are a few loops over integers that print code with
+// printf(), yield() or println. Compiling each one to a C program and
+// running it costs a C compiler invocation per block, so blocks that stay
+// inside that subset are walked here instead, with the same C semantics
+// (integer widths, printf conversions, f-string buffers). Anything outside
+// it - calls to other functions, floats, pointers, declarations, runtime
+// errors, very long runs - reports COMPTIME_EVAL_UNSUPPORTED and the block
+// is compiled as before.
+
+typedef enum
+{
+    COMPTIME_EVAL_OK,          ///< Block ran; output is complete.
+    COMPTIME_EVAL_UNSUPPORTED, ///< Block must be compiled instead.
+    COMPTIME_EVAL_FAILED       ///< Block called compile_error().
+} ComptimeEvalResult;
+
+/**
+ * @brief Runs the statements of a comptime block.
+ *
+ * @param stmts The block's top-level nodes, as parsed for compilation.
+ * @param out   Set to what the block wrote to stdout (OK only).
+ * @param err   Set to what it wrote to stderr (OK and FAILED), e.g. the
+ *              messages of compile_warn() and compile_error().
+ * @return Whether the block ran, failed, or has to be compiled.
+ */
+ComptimeEvalResult comptime_eval(ASTNode *stmts, char **out, char **err);
+
+#endif
@@ -1,7 +1,159 @@
 #include "analysis/const_fold.h"
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
 #include <string.h>
 #include <stdio.h>
 
+// ** Type layout **
+
+// Structs are laid out under the two layouts zc targets use for 8-byte
+// fields: aligned to 8 (x86-64, AArch64) and aligned to 4 (i386). A size
+// is only known if the two agree, and only fixed-width fields take part;
+// pointers, `usize` and C's `long` vary with the target.
+typedef struct
+{
+    long long size[2];
+    long long align[2];
+} CfLayout;
+
+static int cf_type_layout(ParserContext *ctx, Type *t, CfLayout *out, int depth);
+
+static int cf_scalar_layout(long long size, CfLayout *out)
+{
+    out->size[0] = out->size[1] = size;
+    out->align[0] = size;
+    out->align[1] = size > 4 ? 4 : size;
+    return 1;
+}
+
+static int cf_struct_layout(ParserContext *ctx, const char *name, CfLayout *out, int depth)
+{
+    ASTNode *def = name ? find_struct_def(ctx, name) : NULL;
+    if (!def || def->type != NODE_STRUCT || def->strct.is_template ||
+        def->strct.is_incomplete || def->strct.is_opaque || !def->strct.fields || depth > 32)
+    {
+        return 0;
+    }
+
+    for (int m = 0; m < 2; m++)
+    {
+        long long size = 0;
+        long long align = 1;
+        for (ASTNode *f = def->strct.fields; f; f = f->next)
+        {
+            CfLayout fl;
+            if (f->type != NODE_FIELD || f->field.bit_width > 0 ||
+                !cf_type_layout(ctx, f->type_info, &fl, depth + 1))
+            {
+                return 0;
+            }
+            long long fa = def->strct.is_packed ? 1 : fl.align[m];
+            if (def->strct.is_union)
+            {
+                size = fl.size[m] > size ? fl.size[m] : size;
+            }
+            else
+            {
+                size = (size + fa - 1) / fa * fa + fl.size[m];
+            }
+            align = fa > align ? fa : align;
+        }
+        if (def->strct.align > align)
+        {
+            align = def->strct.align;
+        }
+        out->size[m] = (size + align - 1) / align * align;
+        out->align[m] = align;
+    }
+    return 1;
+}
+
+static int cf_type_layout(ParserContext *ctx, Type *t, CfLayout *out, int depth)
+{
+    if (!t)
+    {
+        return 0;
+    }
+    switch (t->kind)
+    {
+    case TYPE_BOOL:
+    case TYPE_CHAR:
+    case TYPE_I8:
+    case TYPE_U8:
+    case TYPE_BYTE:
+    case TYPE_C_CHAR:
+    case TYPE_C_UCHAR:
+        return cf_scalar_layout(1, out);
+    case TYPE_I16:
+    case TYPE_U16:
+    case TYPE_C_SHORT:
+    case TYPE_C_USHORT:
+        return cf_scalar_layout(2, out);
+    case TYPE_I32:
+    case TYPE_U32:
+    case TYPE_INT:
+    case TYPE_UINT:
+    case TYPE_RUNE:
+    case TYPE_C_INT:
+    case TYPE_C_UINT:
+    case TYPE_F32:
+    case TYPE_FLOAT:
+        return cf_scalar_layout(4, out);
+    case TYPE_I64:
+    case TYPE_U64:
+    case TYPE_F64:
+    case TYPE_C_LONG_LONG:
+    case TYPE_C_ULONG_LONG:
+        return cf_scalar_layout(8, out);
+    case TYPE_ARRAY:
+        if (t->array_size <= 0 || !cf_type_layout(ctx, t->inner, out, depth + 1))
+        {
+            return 0;
+        }
+        out->size[0] *= t->array_size;
+        out->size[1] *= t->array_size;
+        return 1;
+    case TYPE_STRUCT:
+        return t->arg_count == 0 && cf_struct_layout(ctx, t->name, out, depth);
+    default:
+        return 0;
+    }
+}
+
+// sizeof() of a type named by its Zen or C spelling.
+static int cf_sizeof_named(ParserContext *ctx, const char *name, long long *out)
+{
+    static const struct
+    {
+        const char *name;
+        int size;
+    } scalars[] = {
+        {"bool", 1},     {"char", 1},     {"i8", 1},       {"u8", 1},      {"byte", 1},
+        {"int8_t", 1},   {"uint8_t", 1},  {"i16", 2},      {"u16", 2},     {"int16_t", 2},
+        {"uint16_t", 2}, {"i32", 4},      {"u32", 4},      {"int", 4},     {"uint", 4},
+        {"rune", 4},     {"int32_t", 4},  {"uint32_t", 4}, {"f32", 4},     {"float", 4},
+        {"i64", 8},      {"u64", 8},      {"int64_t", 8},  {"uint64_t", 8}, {"f64", 8},
+        {"double", 8},
+    };
+    for (size_t i = 0; i < sizeof(scalars) / sizeof(scalars[0]); i++)
+    {
+        if (strcmp(name, scalars[i].name) == 0)
+        {
+            *out = scalars[i].size;
+            return 1;
+        }
+    }
+
+    CfLayout l;
+    if (!cf_struct_layout(ctx, name, &l, 0) || l.size[0] != l.size[1])
+    {
+        return 0;
+    }
+    *out = l.size[0];
+    return 1;
+}
+
 int eval_const_int_expr(ASTNode *node, ParserContext *ctx, long long *out_val)
 {
     if (!node)
@@ -133,8 +285,815 @@ int eval_const_int_expr(ASTNode *node, ParserContext *ctx, long long *out_val)
         return 1;
     }
 
+    case NODE_EXPR_SIZEOF:
+        return node->size_of.target_type &&
+               cf_sizeof_named(ctx, node->size_of.target_type, out_val);
+
     default:
         return 0;
     }
     return 0; // For warning.
 }
+
+// ** Folding pass **
+
+typedef enum
+{
+    CF_NONE,
+    CF_INT,
+    CF_FLOAT,
+    CF_STRING
+} CfKind;
+
+typedef struct
+{
+    CfKind kind;
+    long long i;   // CF_INT
+    int wide;      // CF_INT: 1 if the C type is 64 bits wide rather than int.
+    int is_bool;   // CF_INT: spelled `true` / `false`.
+    double f;      // CF_FLOAT
+    const char *s; // CF_STRING: contents, C-escaped.
+} CfValue;
+
+// The C type codegen gives an integer literal: int if it fits, else the
+// 64-bit type. -1 if it cannot be spelled (LLONG_MIN).
+static int cf_int_width(long long v)
+{
+    if (v == LLONG_MIN)
+    {
+        return -1;
+    }
+    return (v < 0 ? -v : v) > INT_MAX;
+}
+
+// Reads a node that is already in folded form: a literal, `-` applied to a
+// numeric literal (how negative numbers parse), or true/false.
+static int cf_leaf(ASTNode *n, CfValue *v)
+{
+    memset(v, 0, sizeof(*v));
+    if (!n)
+    {
+        return 0;
+    }
+
+    int negate = 0;
+    ASTNode *lit = n;
+    if (n->type == NODE_EXPR_UNARY && n->unary.op && strcmp(n->unary.op, "-") == 0 &&
+        n->unary.operand && n->unary.operand->type == NODE_EXPR_LITERAL &&
+        n->unary.operand->literal.type_kind != LITERAL_STRING &&
+        n->unary.operand->literal.type_kind != LITERAL_CHAR)
+    {
+        negate = 1;
+        lit = n->unary.operand;
+    }
+
+    if (lit->type == NODE_EXPR_LITERAL)
+    {
+        switch (lit->literal.type_kind)
+        {
+        case LITERAL_INT:
+            if (lit->literal.int_val > (unsigned long long)LLONG_MAX)
+            {
+                return 0;
+            }
+            v->kind = CF_INT;
+            v->i = negate ? -(long long)lit->literal.int_val : (long long)lit->literal.int_val;
+            v->wide = lit->literal.int_val > INT_MAX;
+            return 1;
+        case LITERAL_FLOAT:
+            if (!isfinite(lit->literal.float_val))
+            {
+                return 0;
+            }
+            v->kind = CF_FLOAT;
+            v->f = negate ? -lit->literal.float_val : lit->literal.float_val;
+            return 1;
+        case LITERAL_STRING:
+            v->kind = CF_STRING;
+            v->s = lit->literal.string_val;
+            return lit->literal.string_val != NULL;
+        default:
+            return 0;
+        }
+    }
+
+    if (n->type == NODE_EXPR_VAR && n->var_ref.name &&
+        (strcmp(n->var_ref.name, "true") == 0 || strcmp(n->var_ref.name, "false") == 0))
+    {
+        v->kind = CF_INT;
+        v->is_bool = 1;
+        v->i = n->var_ref.name[0] == 't';
+        return 1;
+    }
+    return 0;
+}
+
+// Overwrites `n` with `with`, keeping its place in the tree and its types.
+static void cf_replace(ASTNode *n, ASTNode *with)
+{
+    with->next = n->next;
+    with->line = n->line;
+    with->token = n->token;
+    with->definition_token = n->definition_token;
+    with->resolved_type = n->resolved_type;
+    with->cfg_condition = n->cfg_condition;
+    if (n->type_info)
+    {
+        with->type_info = n->type_info;
+    }
+    *n = *with;
+}
+
+static ASTNode *cf_literal(LiteralKind kind, TypeKind type)
+{
+    ASTNode *lit = ast_create(NODE_EXPR_LITERAL);
+    lit->literal.type_kind = kind;
+    lit->type_info = type_new(type);
+    return lit;
+}
+
+static void cf_store(ASTNode *n, const CfValue *v)
+{
+    ASTNode *with;
+    int negative = 0;
+    if (v->kind == CF_INT && v->is_bool)
+    {
+        with = ast_create(NODE_EXPR_VAR);
+        with->var_ref.name = xstrdup(v->i ? "true" : "false");
+        with->type_info = type_new(TYPE_BOOL);
+    }
+    else if (v->kind == CF_INT)
+    {
+        with = cf_literal(LITERAL_INT, TYPE_INT);
+        negative = v->i < 0;
+        with->literal.int_val = (unsigned long long)(negative ? -v->i : v->i);
+    }
+    else if (v->kind == CF_FLOAT)
+    {
+        with = cf_literal(LITERAL_FLOAT, TYPE_F64);
+        negative = signbit(v->f) != 0;
+        with->literal.float_val = negative ? -v->f : v->f;
+    }
+    else
+    {
+        with = cf_literal(LITERAL_STRING, TYPE_STRING);
+        with->literal.string_val = xstrdup(v->s);
+    }
+
+    if (negative)
+    {
+        ASTNode *neg = ast_create(NODE_EXPR_UNARY);
+        neg->unary.op = xstrdup("-");
+        neg->unary.operand = with;
+        neg->type_info = with->type_info;
+        with = neg;
+    }
+    cf_replace(n, with);
+}
+
+static int cf_bool(CfValue *r, int value)
+{
+    memset(r, 0, sizeof(*r));
+    r->kind = CF_INT;
+    r->is_bool = 1;
+    r->i = value != 0;
+    return 1;
+}
+
+// Gives `r` the value `value` in a C integer type `wide` bits wide, if a
+// literal of that value has the same type.
+static int cf_int_result(CfValue *r, long long value, int wide)
+{
+    if (!wide && (value < INT_MIN || value > INT_MAX))
+    {
+        return 0; // Overflows int: undefined, leave it to the C compiler.
+    }
+    if (cf_int_width(value) != wide)
+    {
+        return 0;
+    }
+    memset(r, 0, sizeof(*r));
+    r->kind = CF_INT;
+    r->i = value;
+    r->wide = wide;
+    return 1;
+}
+
+static int cf_int_binary(const char *op, const CfValue *a, const CfValue *b, CfValue *r)
+{
+    long long x = a->i;
+    long long y = b->i;
+    int wide = a->wide || b->wide;
+
+    if (strcmp(op, "==") == 0)
+    {
+        return cf_bool(r, x == y);
+    }
+    if (strcmp(op, "!=") == 0)
+    {
+        return cf_bool(r, x != y);
+    }
+    if (strcmp(op, "<") == 0)
+    {
+        return cf_bool(r, x < y);
+    }
+    if (strcmp(op, ">") == 0)
+    {
+        return cf_bool(r, x > y);
+    }
+    if (strcmp(op, "<=") == 0)
+    {
+        return cf_bool(r, x <= y);
+    }
+    if (strcmp(op, ">=") == 0)
+    {
+        return cf_bool(r, x >= y);
+    }
+    if (strcmp(op, "&&") == 0)
+    {
+        return cf_bool(r, x && y);
+    }
+    if (strcmp(op, "||") == 0)
+    {
+        return cf_bool(r, x || y);
+    }
+
+    if (strcmp(op, "+") == 0)
+    {
+        if ((y > 0 && x > LLONG_MAX - y) || (y < 0 && x < LLONG_MIN - y))
+        {
+            return 0;
+        }
+        return cf_int_result(r, x + y, wide);
+    }
+    if (strcmp(op, "-") == 0)
+    {
+        if ((y < 0 && x > LLONG_MAX + y) || (y > 0 && x < LLONG_MIN + y))
+        {
+            return 0;
+        }
+        return cf_int_result(r, x - y, wide);
+    }
+    if (strcmp(op, "*") == 0)
+    {
+        if (x != 0 && y != 0 &&
+            ((x == -1 && y == LLONG_MIN) || (y == -1 && x == LLONG_MIN) ||
+             (x != -1 && y != -1 && (x * y) / y != x)))
+        {
+            return 0;
+        }
+        return cf_int_result(r, x * y, wide);
+    }
+    if (strcmp(op, "/") == 0 || strcmp(op, "%") == 0)
+    {
+        if (y == 0 || (x == LLONG_MIN && y == -1))
+        {
+            return 0;
+        }
+        return cf_int_result(r, op[0] == '/' ? x / y : x % y, wide);
+    }
+    if (strcmp(op, "&") == 0)
+    {
+        return cf_int_result(r, x & y, wide);
+    }
+    if (strcmp(op, "|") == 0)
+    {
+        return cf_int_result(r, x | y, wide);
+    }
+    if (strcmp(op, "^") == 0)
+    {
+        return cf_int_result(r, x ^ y, wide);
+    }
+
+    // A shift has the type of its left operand. Negative or oversized
+    // operands are left alone.
+    int bits = a->wide ? 64 : 32;
+    if (strcmp(op, "<<") == 0)
+    {
+        if (x < 0 || y < 0 || y >= bits || x > (a->wide ? LLONG_MAX : INT_MAX) >> y)
+        {
+            return 0;
+        }
+        return cf_int_result(r, x << y, a->wide);
+    }
+    if (strcmp(op, ">>") == 0)
+    {
+        if (x < 0 || y < 0 || y >= bits)
+        {
+            return 0;
+        }
+        return cf_int_result(r, x >> y, a->wide);
+    }
+    return 0;
+}
+
+static int cf_float_binary(const char *op, const CfValue *a, const CfValue *b, CfValue *r)
+{
+    // Integers convert to double exactly up to 2^53.
+    const long long exact = 1LL << 53;
+    if ((a->kind == CF_INT && (a->i > exact || a->i < -exact)) ||
+        (b->kind == CF_INT && (b->i > exact || b->i < -exact)))
+    {
+        return 0;
+    }
+    double x = a->kind == CF_FLOAT ? a->f : (double)a->i;
+    double y = b->kind == CF_FLOAT ? b->f : (double)b->i;
+    double v;
+
+    if (strcmp(op, "==") == 0)
+    {
+        return cf_bool(r, x == y);
+    }
+    if (strcmp(op, "!=") == 0)
+    {
+        return cf_bool(r, x != y);
+    }
+    if (strcmp(op, "<") == 0)
+    {
+        return cf_bool(r, x < y);
+    }
+    if (strcmp(op, ">") == 0)
+    {
+        return cf_bool(r, x > y);
+    }
+    if (strcmp(op, "<=") == 0)
+    {
+        return cf_bool(r, x <= y);
+    }
+    if (strcmp(op, ">=") == 0)
+    {
+        return cf_bool(r, x >= y);
+    }
+
+    if (strcmp(op, "+") == 0)
+    {
+        v = x + y;
+    }
+    else if (strcmp(op, "-") == 0)
+    {
+        v = x - y;
+    }
+    else if (strcmp(op, "*") == 0)
+    {
+        v = x * y;
+    }
+    else if (strcmp(op, "/") == 0 && y != 0.0)
+    {
+        v = x / y;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (!isfinite(v))
+    {
+        return 0;
+    }
+    memset(r, 0, sizeof(*r));
+    r->kind = CF_FLOAT;
+    r->f = v;
+    return 1;
+}
+
+// Joining "\x4" and "1" would read as "\x41"; such pairs are left apart.
+static int cf_concat_safe(const char *left, const char *right)
+{
+    int open_hex = 0;
+    int open_octal = 0;
+    for (const char *p = left; *p;)
+    {
+        open_hex = open_octal = 0;
+        if (*p != '\\' || !p[1])
+        {
+            p++;
+            continue;
+        }
+        p++;
+        if (*p == 'x')
+        {
+            p++;
+            while (isxdigit((unsigned char)*p))
+            {
+                p++;
+            }
+            open_hex = *p == 0;
+        }
+        else if (*p >= '0' && *p <= '7')
+        {
+            int digits = 0;
+            while (digits < 3 && *p >= '0' && *p <= '7')
+            {
+                p++;
+                digits++;
+            }
+            open_octal = *p == 0 && digits < 3;
+        }
+        else
+        {
+            p++;
+        }
+    }
+    if (open_hex && isxdigit((unsigned char)right[0]))
+    {
+        return 0;
+    }
+    if (open_octal && right[0] >= '0' && right[0] <= '7')
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static void cf_fold_node(ASTNode *n)
+{
+    CfValue a, b, c, r;
+    if (cf_leaf(n, &a))
+    {
+        return;
+    }
+
+    switch (n->type)
+    {
+    case NODE_EXPR_BINARY:
+        if (!n->binary.op || !cf_leaf(n->binary.left, &a) || !cf_leaf(n->binary.right, &b))
+        {
+            return;
+        }
+        if (a.kind == CF_STRING || b.kind == CF_STRING)
+        {
+            if (a.kind != CF_STRING || b.kind != CF_STRING || strcmp(n->binary.op, "+") != 0 ||
+                !cf_concat_safe(a.s, b.s))
+            {
+                return;
+            }
+            size_t len = strlen(a.s);
+            char *joined = xmalloc(len + strlen(b.s) + 1);
+            strcpy(joined, a.s);
+            strcpy(joined + len, b.s);
+            memset(&r, 0, sizeof(r));
+            r.kind = CF_STRING;
+            r.s = joined;
+        }
+        else if (a.kind == CF_FLOAT || b.kind == CF_FLOAT)
+        {
+            if (!cf_float_binary(n->binary.op, &a, &b, &r))
+            {
+                return;
+            }
+        }
+        else if (!cf_int_binary(n->binary.op, &a, &b, &r))
+        {
+            return;
+        }
+        break;
+
+    case NODE_EXPR_UNARY:
+        if (!n->unary.op || !cf_leaf(n->unary.operand, &a) || a.kind == CF_STRING)
+        {
+            return;
+        }
+        if (strcmp(n->unary.op, "+") == 0)
+        {
+            r = a;
+        }
+        else if (strcmp(n->unary.op, "-") == 0 && a.kind == CF_FLOAT)
+        {
+            r = a;
+            r.f = -a.f;
+        }
+        else if (strcmp(n->unary.op, "-") == 0)
+        {
+            if (a.i == LLONG_MIN || !cf_int_result(&r, -a.i, a.wide))
+            {
+                return;
+            }
+        }
+        else if (strcmp(n->unary.op, "~") == 0 && a.kind == CF_INT)
+        {
+            if (!cf_int_result(&r, ~a.i, a.wide))
+            {
+                return;
+            }
+        }
+        else if (strcmp(n->unary.op, "!") == 0 && a.kind == CF_INT)
+        {
+            cf_bool(&r, !a.i);
+        }
+        else
+        {
+            return;
+        }
+        break;
+
+    case NODE_TERNARY:
+        // Both arms must have the same C type for the result to keep it.
+        if (!cf_leaf(n->ternary.cond, &c) || c.kind != CF_INT ||
+            !cf_leaf(n->ternary.true_expr, &a) || !cf_leaf(n->ternary.false_expr, &b) ||
+            a.kind != b.kind || a.wide != b.wide || a.is_bool != b.is_bool)
+        {
+            return;
+        }
+        r = c.i ? a : b;
+        break;
+
+    default:
+        return;
+    }
+
+    cf_store(n, &r);
+}
+
+// Decides a @cfg() condition as far as the -D flags allow: 1 or 0, or -1
+// if it depends on something only the C compiler knows.
+static int cf_cfg_or(const char **p);
+
+static int cf_cfg_unary(const char **p)
+{
+    while (**p == ' ')
+    {
+        (*p)++;
+    }
+    if (**p == '!')
+    {
+        (*p)++;
+        int v = cf_cfg_unary(p);
+        return v < 0 ? v : !v;
+    }
+    if (**p == '(')
+    {
+        (*p)++;
+        int v = cf_cfg_or(p);
+        if (**p != ')')
+        {
+            return -2;
+        }
+        (*p)++;
+        return v;
+    }
+    if (strncmp(*p, "defined(", 8) != 0)
+    {
+        return -2;
+    }
+    *p += 8;
+    const char *name = *p;
+    while (isalnum((unsigned char)**p) || **p == '_')
+    {
+        (*p)++;
+    }
+    size_t len = *p - name;
+    if (**p != ')' || len == 0)
+    {
+        return -2;
+    }
+    (*p)++;
+    for (int i = 0; i < g_config.cfg_define_count; i++)
+    {
+        const char *def = g_config.cfg_defines[i];
+        if (strlen(def) == len && strncmp(def, name, len) == 0)
+        {
+            return 1;
+        }
+    }
+    return -1;
+}
+
+static int cf_cfg_and(const char **p)
+{
+    int v = cf_cfg_unary(p);
+    while (v != -2)
+    {
+        while (**p == ' ')
+        {
+            (*p)++;
+        }
+        if (strncmp(*p, "&&", 2) != 0)
+        {
+            break;
+        }
+        *p += 2;
+        int w = cf_cfg_unary(p);
+        v = w == -2 ? -2 : (v == 0 || w == 0) ? 0 : (v == 1 && w == 1) ? 1 : -1;
+    }
+    return v;
+}
+
+static int cf_cfg_or(const char **p)
+{
+    int v = cf_cfg_and(p);
+    while (v != -2)
+    {
+        while (**p == ' ')
+        {
+            (*p)++;
+        }
+        if (strncmp(*p, "||", 2) != 0)
+        {
+            break;
+        }
+        *p += 2;
+        int w = cf_cfg_and(p);
+        v = w == -2 ? -2 : (v == 1 || w == 1) ? 1 : (v == 0 && w == 0) ? 0 : -1;
+    }
+    return v;
+}
+
+static void cf_fold_cfg(ASTNode *n)
+{
+    const char *p = n->cfg_condition;
+    int v = cf_cfg_or(&p);
+    if (*p != 0 || v < 0)
+    {
+        return;
+    }
+    n->cfg_condition = v ? NULL : xstrdup("0");
+}
+
+static int cf_walk(ParserContext *ctx, ASTNode *n, int is_stmt);
+
+static int cf_walk_list(ParserContext *ctx, ASTNode *n, int is_stmt)
+{
+    int has_label = 0;
+    for (; n; n = n->next)
+    {
+        has_label |= cf_walk(ctx, n, is_stmt);
+    }
+    return has_label;
+}
+
+// Folds everything under `n`, children first. Returns 1 if the subtree has a
+// label, which keeps an untaken branch alive for a goto from outside it.
+static int cf_walk(ParserContext *ctx, ASTNode *n, int is_stmt)
+{
+    if (!n)
+    {
+        return 0;
+    }
+    if (n->cfg_condition)
+    {
+        cf_fold_cfg(n);
+    }
+
+    switch (n->type)
+    {
+    case NODE_LABEL:
+        return 1;
+    case NODE_FUNCTION:
+        return cf_walk(ctx, n->func.body, 1);
+    case NODE_IMPL:
+        return cf_walk_list(ctx, n->impl.methods, 0);
+    case NODE_IMPL_TRAIT:
+        return cf_walk_list(ctx, n->impl_trait.methods, 0);
+    case NODE_TEST:
+        return cf_walk(ctx, n->test_stmt.body, 1);
+    case NODE_LAMBDA:
+        return cf_walk(ctx, n->lambda.body, !n->lambda.is_expression);
+    case NODE_BLOCK:
+        return cf_walk_list(ctx, n->block.statements, 1);
+    case NODE_RETURN:
+        return cf_walk(ctx, n->ret.value, 0);
+    case NODE_VAR_DECL:
+    case NODE_CONST:
+        return cf_walk(ctx, n->var_decl.init_expr, 0);
+    case NODE_DESTRUCT_VAR:
+        return cf_walk(ctx, n->destruct.init_expr, 0) | cf_walk(ctx, n->destruct.else_block, 1);
+
+    case NODE_IF:
+    {
+        int has_label = cf_walk(ctx, n->if_stmt.condition, 0);
+        int then_label = cf_walk(ctx, n->if_stmt.then_body, 1);
+        int else_label = cf_walk(ctx, n->if_stmt.else_body, 1);
+        CfValue c;
+        // As a statement, an `if` on a constant becomes the branch it takes.
+        if (is_stmt && cf_leaf(n->if_stmt.condition, &c) && c.kind == CF_INT &&
+            !(c.i ? else_label : then_label))
+        {
+            ASTNode *taken = c.i ? n->if_stmt.then_body : n->if_stmt.else_body;
+            ASTNode *with = ast_create(NODE_BLOCK);
+            if (taken && taken->type == NODE_BLOCK)
+            {
+                *with = *taken;
+            }
+            else
+            {
+                with->block.statements = taken;
+            }
+            ASTNode *next = n->next;
+            int line = n->line;
+            *n = *with;
+            n->next = next;
+            n->line = line;
+            return has_label | (c.i ? then_label : else_label);
+        }
+        return has_label | then_label | else_label;
+    }
+    case NODE_WHILE:
+        return cf_walk(ctx, n->while_stmt.condition, 0) | cf_walk(ctx, n->while_stmt.body, 1);
+    case NODE_DO_WHILE:
+        return cf_walk(ctx, n->do_while_stmt.condition, 0) | cf_walk(ctx, n->do_while_stmt.body, 1);
+    case NODE_FOR:
+        return cf_walk(ctx, n->for_stmt.init, 0) | cf_walk(ctx, n->for_stmt.condition, 0) |
+               cf_walk(ctx, n->for_stmt.step, 0) | cf_walk(ctx, n->for_stmt.body, 1);
+    case NODE_FOR_RANGE:
+        return cf_walk(ctx, n->for_range.start, 0) | cf_walk(ctx, n->for_range.end, 0) |
+               cf_walk(ctx, n->for_range.body, 1);
+    case NODE_LOOP:
+        return cf_walk(ctx, n->loop_stmt.body, 1);
+    case NODE_REPEAT:
+        return cf_walk(ctx, n->repeat_stmt.body, 1);
+    case NODE_UNLESS:
+        return cf_walk(ctx, n->unless_stmt.condition, 0) | cf_walk(ctx, n->unless_stmt.body, 1);
+    case NODE_GUARD:
+        return cf_walk(ctx, n->guard_stmt.condition, 0) | cf_walk(ctx, n->guard_stmt.body, 1);
+    case NODE_MATCH:
+        return cf_walk(ctx, n->match_stmt.expr, 0) | cf_walk_list(ctx, n->match_stmt.cases, 0);
+    case NODE_MATCH_CASE:
+        return cf_walk(ctx, n->match_case.guard, 0) | cf_walk(ctx, n->match_case.body, 0);
+    case NODE_DEFER:
+        return cf_walk(ctx, n->defer_stmt.stmt, 0);
+    case NODE_ASSERT:
+        return cf_walk(ctx, n->assert_stmt.condition, 0);
+    case NODE_GOTO:
+        return cf_walk(ctx, n->goto_stmt.goto_expr, 0);
+    case NODE_TRY:
+        return cf_walk(ctx, n->try_stmt.expr, 0);
+    case NODE_REPL_PRINT:
+        return cf_walk(ctx, n->repl_print.expr, 0);
+
+    case NODE_EXPR_BINARY:
+    case NODE_EXPR_UNARY:
+    case NODE_TERNARY:
+        fold_expr(ctx, n);
+        return 0;
+    case NODE_AWAIT:
+        return cf_walk(ctx, n->unary.operand, 0);
+    case NODE_EXPR_CALL:
+        return cf_walk(ctx, n->call.callee, 0) | cf_walk_list(ctx, n->call.args, 0);
+    case NODE_EXPR_MEMBER:
+        return cf_walk(ctx, n->member.target, 0);
+    case NODE_EXPR_INDEX:
+        return cf_walk(ctx, n->index.array, 0) | cf_walk(ctx, n->index.index, 0);
+    case NODE_EXPR_SLICE:
+        return cf_walk(ctx, n->slice.array, 0) | cf_walk(ctx, n->slice.start, 0) |
+               cf_walk(ctx, n->slice.end, 0);
+    case NODE_EXPR_CAST:
+        return cf_walk(ctx, n->cast.expr, 0);
+    case NODE_EXPR_ARRAY_LITERAL:
+        return cf_walk_list(ctx, n->array_literal.elements, 0);
+    case NODE_EXPR_STRUCT_INIT:
+        return cf_walk_list(ctx, n->struct_init.fields, 0);
+
+    default:
+        return 0;
+    }
+}
+
+void fold_expr(ParserContext *ctx, ASTNode *node)
+{
+    if (!node)
+    {
+        return;
+    }
+    switch (node->type)
+    {
+    case NODE_EXPR_BINARY:
+        fold_expr(ctx, node->binary.left);
+        fold_expr(ctx, node->binary.right);
+        break;
+    case NODE_EXPR_UNARY:
+        fold_expr(ctx, node->unary.operand);
+        break;
+    case NODE_TERNARY:
+        fold_expr(ctx, node->ternary.cond);
+        fold_expr(ctx, node->ternary.true_expr);
+        fold_expr(ctx, node->ternary.false_expr);
+        break;
+    default:
+        // Statements nested in expressions (lambdas, blocks) and the other
+        // expression kinds.
+        cf_walk(ctx, node, 0);
+        return;
+    }
+    cf_fold_node(node);
+}
+
+void fold_constants(ParserContext *ctx, ASTNode *root)
+{
+    if (root && root->type == NODE_ROOT)
+    {
+        cf_walk_list(ctx, root->root.children, 0);
+    }
+    cf_walk_list(ctx, ctx->instantiated_funcs, 0);
+    for (StructRef *r = ctx->parsed_funcs_list; r; r = r->next)
+    {
+        cf_walk(ctx, r->node, 0);
+    }
+    for (StructRef *r = ctx->parsed_impls_list; r; r = r->next)
+    {
+        cf_walk(ctx, r->node, 0);
+    }
+    for (StructRef *r = ctx->parsed_globals_list; r; r = r->next)
+    {
+        cf_walk(ctx, r->node, 0);
+    }
+}
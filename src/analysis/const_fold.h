@@ -9,4 +9,15 @@
 // Returns 0 if the expression is not a compile-time constant.
 int eval_const_int_expr(ASTNode *node, ParserContext *ctx, long long *out_val);
 
+// Folds the constant parts of an expression in place: int, float and bool
+// arithmetic on literals, and `+` of two string literals. A node is only
+// replaced when the literal that replaces it has the same C type, so the
+// generated code means exactly what it did before.
+void fold_expr(ParserContext *ctx, ASTNode *node);
+
+// Runs fold_expr() over every function, method, test and global before
+// codegen. It also drops the untaken side of an `if` whose condition folds
+// to a constant, and resolves @cfg() conditions that the -D flags decide.
+void fold_constants(ParserContext *ctx, ASTNode *root);
+
 #endif
@@ -0,0 +1,429 @@
+#include "analysis/escape.h"
+#include "zprep.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Per-parameter results. A positive state is the analysis depth of a
+// parameter that is still being looked at.
+#define ESC_UNKNOWN 0
+#define ESC_ESCAPES -1
+#define ESC_LOCAL -2
+
+typedef struct
+{
+    ASTNode *fn;
+    const char *impl_type; // Type whose impl block holds the method, or NULL
+    int *state;
+    int statics;           // Body declares static locals (-1 until walked)
+} EscFunc;
+
+static EscFunc *esc_funcs = NULL;
+static int esc_count = 0;
+static int esc_cap = 0;
+static int esc_depth = 0;
+// Shallowest depth whose result was assumed local while a recursive call
+// was being analysed; results that rest on it are not cached.
+static int esc_assumed = INT_MAX;
+// Set when the walk passes a static local.
+static int esc_saw_static = 0;
+
+static int esc_node(ASTNode *n, const char *name);
+
+static void esc_add(ASTNode *fn, const char *impl_type)
+{
+    if (!fn || fn->type != NODE_FUNCTION || !fn->func.name)
+    {
+        return;
+    }
+    if (esc_count == esc_cap)
+    {
+        esc_cap = esc_cap ? esc_cap * 2 : 64;
+        esc_funcs = xrealloc(esc_funcs, sizeof(EscFunc) * esc_cap);
+    }
+    esc_funcs[esc_count].fn = fn;
+    esc_funcs[esc_count].impl_type = impl_type;
+    esc_funcs[esc_count].statics = -1;
+    esc_funcs[esc_count].state = xcalloc(fn->func.arg_count > 0 ? fn->func.arg_count : 1,
+                                         sizeof(int));
+    esc_count++;
+}
+
+void escape_set_functions(ASTNode *funcs)
+{
+    for (int i = 0; i < esc_count; i++)
+    {
+        free(esc_funcs[i].state);
+    }
+    free(esc_funcs);
+    esc_funcs = NULL;
+    esc_count = 0;
+    esc_cap = 0;
+
+    for (ASTNode *n = funcs; n; n = n->next)
+    {
+        ASTNode *m = NULL;
+        const char *impl_type = NULL;
+        if (n->type == NODE_FUNCTION)
+        {
+            esc_add(n, NULL);
+        }
+        else if (n->type == NODE_IMPL)
+        {
+            m = n->impl.methods;
+            impl_type = n->impl.struct_name;
+        }
+        else if (n->type == NODE_IMPL_TRAIT)
+        {
+            m = n->impl_trait.methods;
+            impl_type = n->impl_trait.target_type;
+        }
+        for (; m; m = m->next)
+        {
+            esc_add(m, impl_type);
+        }
+    }
+}
+
+static EscFunc *esc_find(const char *c_name)
+{
+    // Static calls may still be spelled `Type::method`.
+    char buf[512];
+    const char *sep = strstr(c_name, "::");
+    if (sep)
+    {
+        snprintf(buf, sizeof(buf), "%.*s__%s", (int)(sep - c_name), c_name, sep + 2);
+        c_name = buf;
+    }
+    for (int i = 0; i < esc_count; i++)
+    {
+        if (strcmp(esc_funcs[i].fn->func.name, c_name) == 0)
+        {
+            return &esc_funcs[i];
+        }
+    }
+    return NULL;
+}
+
+static int is_ident_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Whether `name` appears as a whole identifier in raw text.
+static int esc_text(const char *text, const char *name)
+{
+    if (!text)
+    {
+        return 0;
+    }
+    size_t len = strlen(name);
+    for (const char *p = strstr(text, name); p; p = strstr(p + 1, name))
+    {
+        if ((p == text || !is_ident_char(p[-1])) && !is_ident_char(p[len]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int esc_texts(char **texts, int count, const char *name)
+{
+    for (int i = 0; texts && i < count; i++)
+    {
+        if (esc_text(texts[i], name))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int esc_list(ASTNode *n, const char *name)
+{
+    for (; n; n = n->next)
+    {
+        if (esc_node(n, name))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int is_var(ASTNode *n, const char *name)
+{
+    return n && n->type == NODE_EXPR_VAR && strcmp(n->var_ref.name, name) == 0;
+}
+
+static int esc_names(char **names, int count, const char *name)
+{
+    for (int i = 0; names && i < count; i++)
+    {
+        if (names[i] && strcmp(names[i], name) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int esc_call(ASTNode *n, const char *name)
+{
+    ASTNode *callee = n->call.callee;
+    if (!is_var(callee, name) && esc_node(callee, name))
+    {
+        return 1;
+    }
+    int i = 0;
+    for (ASTNode *arg = n->call.args; arg; arg = arg->next, i++)
+    {
+        if (!is_var(arg, name))
+        {
+            if (esc_node(arg, name))
+            {
+                return 1;
+            }
+            continue;
+        }
+        // Handed on: only fine if the callee is a known function that keeps
+        // it local too.
+        if (!callee || callee->type != NODE_EXPR_VAR || n->call.arg_names ||
+            is_var(callee, name) || !escape_param_is_local(callee->var_ref.name, i))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int esc_node(ASTNode *n, const char *name)
+{
+    if (!n)
+    {
+        return 0;
+    }
+    switch (n->type)
+    {
+    case NODE_EXPR_VAR:
+        return strcmp(n->var_ref.name, name) == 0;
+    case NODE_EXPR_CALL:
+        return esc_call(n, name);
+    case NODE_LAMBDA:
+        // Anything the body refers to from outside is in its captures.
+        return esc_texts(n->lambda.captured_vars, n->lambda.num_captures, name);
+
+    case NODE_RAW_STMT:
+        return esc_text(n->raw_stmt.content, name) ||
+               esc_texts(n->raw_stmt.used_symbols, n->raw_stmt.used_symbol_count, name);
+    case NODE_ASM:
+        return esc_text(n->asm_stmt.code, name) ||
+               esc_texts(n->asm_stmt.outputs, n->asm_stmt.num_outputs, name) ||
+               esc_texts(n->asm_stmt.inputs, n->asm_stmt.num_inputs, name);
+    case NODE_PLUGIN:
+        return esc_text(n->plugin_stmt.body, name);
+
+    case NODE_BLOCK:
+        return esc_list(n->block.statements, name);
+    case NODE_RETURN:
+        return esc_node(n->ret.value, name);
+    // Rebinding the name counts too, so that a use found later always means
+    // the closure.
+    case NODE_VAR_DECL:
+    case NODE_CONST:
+        if (n->var_decl.is_static)
+        {
+            esc_saw_static = 1;
+        }
+        return strcmp(n->var_decl.name, name) == 0 || esc_node(n->var_decl.init_expr, name);
+    case NODE_DESTRUCT_VAR:
+        return esc_names(n->destruct.names, n->destruct.count, name) ||
+               esc_node(n->destruct.init_expr, name) || esc_node(n->destruct.else_block, name);
+    case NODE_IF:
+        return esc_node(n->if_stmt.condition, name) || esc_node(n->if_stmt.then_body, name) ||
+               esc_node(n->if_stmt.else_body, name);
+    case NODE_WHILE:
+        return esc_node(n->while_stmt.condition, name) || esc_node(n->while_stmt.body, name);
+    case NODE_DO_WHILE:
+        return esc_node(n->do_while_stmt.condition, name) ||
+               esc_node(n->do_while_stmt.body, name);
+    case NODE_FOR:
+        return esc_node(n->for_stmt.init, name) || esc_node(n->for_stmt.condition, name) ||
+               esc_node(n->for_stmt.step, name) || esc_node(n->for_stmt.body, name);
+    case NODE_FOR_RANGE:
+        return (n->for_range.var_name && strcmp(n->for_range.var_name, name) == 0) ||
+               esc_node(n->for_range.start, name) || esc_node(n->for_range.end, name) ||
+               esc_text(n->for_range.step, name) || esc_node(n->for_range.body, name);
+    case NODE_LOOP:
+        return esc_node(n->loop_stmt.body, name);
+    case NODE_REPEAT:
+        return esc_text(n->repeat_stmt.count, name) || esc_node(n->repeat_stmt.body, name);
+    case NODE_UNLESS:
+        return esc_node(n->unless_stmt.condition, name) || esc_node(n->unless_stmt.body, name);
+    case NODE_GUARD:
+        return esc_node(n->guard_stmt.condition, name) || esc_node(n->guard_stmt.body, name);
+    case NODE_MATCH:
+        return esc_node(n->match_stmt.expr, name) || esc_list(n->match_stmt.cases, name);
+    case NODE_MATCH_CASE:
+        return esc_names(n->match_case.binding_names, n->match_case.binding_count, name) ||
+               esc_node(n->match_case.guard, name) || esc_node(n->match_case.body, name);
+    case NODE_DEFER:
+        return esc_node(n->defer_stmt.stmt, name);
+    case NODE_ASSERT:
+        return esc_node(n->assert_stmt.condition, name) || esc_text(n->assert_stmt.message, name);
+    case NODE_GOTO:
+        return esc_node(n->goto_stmt.goto_expr, name);
+    case NODE_TRY:
+        return esc_node(n->try_stmt.expr, name);
+    case NODE_REPL_PRINT:
+        return esc_node(n->repl_print.expr, name);
+
+    case NODE_EXPR_BINARY:
+        return esc_node(n->binary.left, name) || esc_node(n->binary.right, name);
+    case NODE_EXPR_UNARY:
+    case NODE_AWAIT:
+        return esc_node(n->unary.operand, name);
+    case NODE_TERNARY:
+        return esc_node(n->ternary.cond, name) || esc_node(n->ternary.true_expr, name) ||
+               esc_node(n->ternary.false_expr, name);
+    case NODE_EXPR_MEMBER:
+        return esc_node(n->member.target, name);
+    case NODE_EXPR_INDEX:
+        return esc_node(n->index.array, name) || esc_node(n->index.index, name);
+    case NODE_EXPR_SLICE:
+        return esc_node(n->slice.array, name) || esc_node(n->slice.start, name) ||
+               esc_node(n->slice.end, name);
+    case NODE_EXPR_CAST:
+        return esc_node(n->cast.expr, name);
+    case NODE_EXPR_ARRAY_LITERAL:
+        return esc_list(n->array_literal.elements, name);
+    case NODE_EXPR_STRUCT_INIT:
+        for (ASTNode *f = n->struct_init.fields; f; f = f->next)
+        {
+            if (esc_node(f->var_decl.init_expr, name))
+            {
+                return 1;
+            }
+        }
+        return 0;
+    case NODE_CUDA_LAUNCH:
+        return esc_node(n->cuda_launch.call, name) || esc_node(n->cuda_launch.grid, name) ||
+               esc_node(n->cuda_launch.block, name) ||
+               esc_node(n->cuda_launch.shared_mem, name) || esc_node(n->cuda_launch.stream, name);
+    case NODE_VA_START:
+        return esc_node(n->va_start.ap, name) || esc_node(n->va_start.last_arg, name);
+    case NODE_VA_END:
+        return esc_node(n->va_end.ap, name);
+    case NODE_VA_COPY:
+        return esc_node(n->va_copy.dest, name) || esc_node(n->va_copy.src, name);
+    case NODE_VA_ARG:
+        return esc_node(n->va_arg.ap, name);
+
+    // Not evaluated, or nothing to refer to.
+    case NODE_EXPR_SIZEOF:
+    case NODE_TYPEOF:
+    case NODE_EXPR_LITERAL:
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+    case NODE_LABEL:
+    case NODE_REFLECTION:
+    case NODE_AST_COMMENT:
+    case NODE_TYPE_ALIAS:
+    case NODE_INCLUDE:
+        return 0;
+
+    default:
+        return 1;
+    }
+}
+
+int escape_param_is_local(const char *c_name, int index)
+{
+    EscFunc *f = c_name ? esc_find(c_name) : NULL;
+    // An async function's body runs on another thread, after the caller's
+    // frame may be gone.
+    if (!f || f->fn->func.is_async || !f->fn->func.body || !f->fn->func.param_names ||
+        !f->fn->func.arg_types || index < 0 || index >= f->fn->func.arg_count)
+    {
+        return 0;
+    }
+    Type *t = f->fn->func.arg_types[index];
+    if (!t || t->kind != TYPE_FUNCTION || t->is_raw)
+    {
+        return 0;
+    }
+
+    int *state = &f->state[index];
+    if (*state == ESC_LOCAL)
+    {
+        return 1;
+    }
+    if (*state == ESC_ESCAPES)
+    {
+        return 0;
+    }
+    if (*state > 0)
+    {
+        // Recursion: assume local, and let the outer frame decide.
+        if (*state < esc_assumed)
+        {
+            esc_assumed = *state;
+        }
+        return 1;
+    }
+
+    int depth = ++esc_depth;
+    int saved = esc_assumed;
+    int saved_static = esc_saw_static;
+    esc_assumed = INT_MAX;
+    esc_saw_static = 0;
+    *state = depth;
+
+    int local = !esc_node(f->fn->func.body, f->fn->func.param_names[index]);
+    if (local)
+    {
+        // The whole body was walked.
+        f->statics = esc_saw_static;
+    }
+    esc_saw_static = saved_static;
+
+    esc_depth--;
+    if (!local)
+    {
+        *state = ESC_ESCAPES;
+    }
+    else
+    {
+        *state = esc_assumed < depth ? ESC_UNKNOWN : ESC_LOCAL;
+    }
+    if (esc_assumed < depth && esc_assumed < saved)
+    {
+        saved = esc_assumed;
+    }
+    esc_assumed = saved;
+    return local;
+}
+
+ASTNode *escape_function(const char *c_name, const char **impl_type, int *has_statics)
+{
+    EscFunc *f = c_name ? esc_find(c_name) : NULL;
+    if (!f)
+    {
+        return NULL;
+    }
+    if (impl_type)
+    {
+        *impl_type = f->impl_type;
+    }
+    if (has_statics)
+    {
+        *has_statics = f->statics != 0;
+    }
+    return f->fn;
+}
+
+int escape_local_is_local(const char *name, ASTNode *stmts)
+{
+    return name && !esc_list(stmts, name);
+}
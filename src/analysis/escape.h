@@ -0,0 +1,53 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include "ast/ast.h"
+
+// Escape analysis for closures.
+//
+// A closure that is only ever called, or handed on to parameters that are
+// themselves only called, cannot outlive the call or scope it was created
+// in, so its context does not need to live on the heap. Anything else -
+// returning it, storing it, taking its address, capturing it in another
+// lambda, naming it in raw C, declaring another variable of the same name -
+// counts as an escape.
+
+/**
+ * @brief Sets the functions that parameters are looked up in.
+ *
+ * @param funcs List of NODE_FUNCTION nodes, and NODE_IMPL / NODE_IMPL_TRAIT
+ *              nodes whose methods carry their mangled C names.
+ */
+void escape_set_functions(ASTNode *funcs);
+
+/**
+ * @brief Checks whether a closure passed as a parameter stays within the call.
+ *
+ * @param c_name The C name of the called function (`Type::m` is accepted too).
+ * @param index  Index of the parameter, counting `self` for methods.
+ * @return 1 if the function only calls the parameter, or passes it to
+ *         parameters that do; 0 if it may escape or the function is unknown.
+ */
+int escape_param_is_local(const char *c_name, int index);
+
+/**
+ * @brief Looks up a function registered with escape_set_functions().
+ *
+ * @param c_name      The C name of the function.
+ * @param impl_type   Set to the type whose impl block holds it, or NULL.
+ * @param has_statics Set to 1 if its body declares static locals, or if
+ *                    that is not known yet (no parameter found local).
+ * @return The NODE_FUNCTION node, or NULL.
+ */
+ASTNode *escape_function(const char *c_name, const char **impl_type, int *has_statics);
+
+/**
+ * @brief Checks whether a closure bound to a local stays within its scope.
+ *
+ * @param name  The variable the closure is bound to.
+ * @param stmts The statements following the declaration in its block.
+ * @return 1 if no use of `name` in `stmts` lets it escape.
+ */
+int escape_local_is_local(const char *name, ASTNode *stmts);
+
+#endif
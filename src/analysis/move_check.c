@@ -4,7 +4,7 @@
 #include <string.h>
 #include <stdlib.h>
 
-extern ParserContext *g_parser_ctx;
+extern ZC_THREAD_LOCAL ParserContext *g_parser_ctx;
 
 #include "zprep.h"
 
@@ -11,7 +11,7 @@ typedef struct TraitReg
     struct TraitReg *next;
 } TraitReg;
 
-static TraitReg *registered_traits = NULL;
+static ZC_THREAD_LOCAL TraitReg *registered_traits = NULL;
 
 void register_trait(const char *name)
 {
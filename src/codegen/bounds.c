@@ -0,0 +1,808 @@
+#include "bounds.h"
+#include "codegen.h"
+#include "zprep.h"
+#include <ctype.h>
+#include <string.h>
+
+typedef struct
+{
+    char **items;
+    int count;
+    int cap;
+} BcNames;
+
+typedef struct
+{
+    ASTNode *index;
+    int stable;     // The indexed variable cannot change in the loop.
+    BoundsPlan plan;
+    int fixed_size; // What the plan was made for; 0 for a slice.
+    int guard;
+} BcSite;
+
+typedef struct
+{
+    ASTNode *loop;
+    int lo_const;       // lo is a constant >= 0.
+    long long hi_const; // Exclusive bound if hi is a constant, else -1.
+    char *hi_len;       // X if hi is `X.len` of a stable slice X.
+    int invariant;      // lo and hi can be evaluated again before the loop.
+    BcSite *sites;
+    int site_count;
+    int site_cap;
+    int opened;
+} BcLoop;
+
+// What is known of the function (or test) a loop is in.
+typedef struct
+{
+    BcNames declared; // Parameters and locals, lambdas' included.
+    BcNames escaped;  // Address taken, or written by a lambda.
+    int opaque;       // Inline asm or a plugin: nothing is known.
+} BcFunc;
+
+static BcNames bc_globals;
+static BcLoop *bc_loops = NULL;
+static int bc_loop_count = 0;
+static int bc_loop_cap = 0;
+static BcLoop **bc_active = NULL; // Loops being written, innermost last.
+static int bc_active_count = 0;
+static int bc_active_cap = 0;
+static int bc_guard_count = 0;
+static int bc_elided = 0;
+static int bc_hoisted = 0;
+
+static void bc_add_name(BcNames *set, char *name)
+{
+    if (!name)
+    {
+        return;
+    }
+    if (set->count == set->cap)
+    {
+        set->cap = set->cap ? set->cap * 2 : 16;
+        set->items = xrealloc(set->items, set->cap * sizeof(char *));
+    }
+    set->items[set->count++] = name;
+}
+
+static int bc_has_name(const BcNames *set, const char *name)
+{
+    for (int i = 0; i < set->count; i++)
+    {
+        if (strcmp(set->items[i], name) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Every identifier in raw C, which may do anything to the variables it names.
+static void bc_add_raw_names(BcNames *set, const char *text)
+{
+    const char *p = text;
+    while (p && *p)
+    {
+        if (isalpha((unsigned char)*p) || *p == '_')
+        {
+            const char *start = p;
+            while (isalnum((unsigned char)*p) || *p == '_')
+            {
+                p++;
+            }
+            char *name = xmalloc(p - start + 1);
+            memcpy(name, start, p - start);
+            name[p - start] = 0;
+            bc_add_name(set, name);
+        }
+        else if (*p == '"' || *p == '\'')
+        {
+            char quote = *p++;
+            while (*p && *p != quote)
+            {
+                p += (p[0] == '\\' && p[1]) ? 2 : 1;
+            }
+            p += *p ? 1 : 0;
+        }
+        else
+        {
+            p++;
+        }
+    }
+}
+
+// Calls `fn` on `n` and, while it returns 1, on everything under it.
+typedef int (*BcVisitor)(ASTNode *n, void *ud);
+
+static void bc_visit(ASTNode *n, BcVisitor fn, void *ud);
+
+static void bc_visit_list(ASTNode *n, BcVisitor fn, void *ud)
+{
+    for (; n; n = n->next)
+    {
+        bc_visit(n, fn, ud);
+    }
+}
+
+static void bc_visit(ASTNode *n, BcVisitor fn, void *ud)
+{
+    if (!n || !fn(n, ud))
+    {
+        return;
+    }
+    switch (n->type)
+    {
+    case NODE_FUNCTION:
+        bc_visit(n->func.body, fn, ud);
+        break;
+    case NODE_TEST:
+        bc_visit(n->test_stmt.body, fn, ud);
+        break;
+    case NODE_LAMBDA:
+        bc_visit(n->lambda.body, fn, ud);
+        break;
+    case NODE_BLOCK:
+        bc_visit_list(n->block.statements, fn, ud);
+        break;
+    case NODE_RETURN:
+        bc_visit(n->ret.value, fn, ud);
+        break;
+    case NODE_VAR_DECL:
+    case NODE_CONST:
+        bc_visit(n->var_decl.init_expr, fn, ud);
+        break;
+    case NODE_DESTRUCT_VAR:
+        bc_visit(n->destruct.init_expr, fn, ud);
+        bc_visit(n->destruct.else_block, fn, ud);
+        break;
+    case NODE_IF:
+        bc_visit(n->if_stmt.condition, fn, ud);
+        bc_visit(n->if_stmt.then_body, fn, ud);
+        bc_visit(n->if_stmt.else_body, fn, ud);
+        break;
+    case NODE_WHILE:
+        bc_visit(n->while_stmt.condition, fn, ud);
+        bc_visit(n->while_stmt.body, fn, ud);
+        break;
+    case NODE_DO_WHILE:
+        bc_visit(n->do_while_stmt.condition, fn, ud);
+        bc_visit(n->do_while_stmt.body, fn, ud);
+        break;
+    case NODE_FOR:
+        bc_visit(n->for_stmt.init, fn, ud);
+        bc_visit(n->for_stmt.condition, fn, ud);
+        bc_visit(n->for_stmt.step, fn, ud);
+        bc_visit(n->for_stmt.body, fn, ud);
+        break;
+    case NODE_FOR_RANGE:
+        bc_visit(n->for_range.start, fn, ud);
+        bc_visit(n->for_range.end, fn, ud);
+        bc_visit(n->for_range.body, fn, ud);
+        break;
+    case NODE_LOOP:
+        bc_visit(n->loop_stmt.body, fn, ud);
+        break;
+    case NODE_REPEAT:
+        bc_visit(n->repeat_stmt.body, fn, ud);
+        break;
+    case NODE_UNLESS:
+        bc_visit(n->unless_stmt.condition, fn, ud);
+        bc_visit(n->unless_stmt.body, fn, ud);
+        break;
+    case NODE_GUARD:
+        bc_visit(n->guard_stmt.condition, fn, ud);
+        bc_visit(n->guard_stmt.body, fn, ud);
+        break;
+    case NODE_MATCH:
+        bc_visit(n->match_stmt.expr, fn, ud);
+        bc_visit_list(n->match_stmt.cases, fn, ud);
+        break;
+    case NODE_MATCH_CASE:
+        bc_visit(n->match_case.guard, fn, ud);
+        bc_visit(n->match_case.body, fn, ud);
+        break;
+    case NODE_DEFER:
+        bc_visit(n->defer_stmt.stmt, fn, ud);
+        break;
+    case NODE_ASSERT:
+        bc_visit(n->assert_stmt.condition, fn, ud);
+        break;
+    case NODE_GOTO:
+        bc_visit(n->goto_stmt.goto_expr, fn, ud);
+        break;
+    case NODE_TRY:
+        bc_visit(n->try_stmt.expr, fn, ud);
+        break;
+    case NODE_REPL_PRINT:
+        bc_visit(n->repl_print.expr, fn, ud);
+        break;
+    case NODE_EXPR_BINARY:
+        bc_visit(n->binary.left, fn, ud);
+        bc_visit(n->binary.right, fn, ud);
+        break;
+    case NODE_EXPR_UNARY:
+    case NODE_AWAIT:
+        bc_visit(n->unary.operand, fn, ud);
+        break;
+    case NODE_TERNARY:
+        bc_visit(n->ternary.cond, fn, ud);
+        bc_visit(n->ternary.true_expr, fn, ud);
+        bc_visit(n->ternary.false_expr, fn, ud);
+        break;
+    case NODE_EXPR_CALL:
+        bc_visit(n->call.callee, fn, ud);
+        bc_visit_list(n->call.args, fn, ud);
+        break;
+    case NODE_EXPR_MEMBER:
+        bc_visit(n->member.target, fn, ud);
+        break;
+    case NODE_EXPR_INDEX:
+        bc_visit(n->index.array, fn, ud);
+        bc_visit(n->index.index, fn, ud);
+        break;
+    case NODE_EXPR_SLICE:
+        bc_visit(n->slice.array, fn, ud);
+        bc_visit(n->slice.start, fn, ud);
+        bc_visit(n->slice.end, fn, ud);
+        break;
+    case NODE_EXPR_CAST:
+        bc_visit(n->cast.expr, fn, ud);
+        break;
+    case NODE_EXPR_ARRAY_LITERAL:
+        bc_visit_list(n->array_literal.elements, fn, ud);
+        break;
+    case NODE_EXPR_STRUCT_INIT:
+        bc_visit_list(n->struct_init.fields, fn, ud);
+        break;
+    case NODE_CUDA_LAUNCH:
+        bc_visit(n->cuda_launch.call, fn, ud);
+        bc_visit(n->cuda_launch.grid, fn, ud);
+        bc_visit(n->cuda_launch.block, fn, ud);
+        bc_visit(n->cuda_launch.shared_mem, fn, ud);
+        bc_visit(n->cuda_launch.stream, fn, ud);
+        break;
+    default:
+        break;
+    }
+}
+
+// The variable `n` names, or whose fields it names.
+static char *bc_root_var(ASTNode *n)
+{
+    while (n && n->type == NODE_EXPR_MEMBER)
+    {
+        n = n->member.target;
+    }
+    return (n && n->type == NODE_EXPR_VAR) ? n->var_ref.name : NULL;
+}
+
+static int bc_is_assign_op(const char *op)
+{
+    size_t len = op ? strlen(op) : 0;
+    return len > 0 && op[len - 1] == '=' && strcmp(op, "==") != 0 && strcmp(op, "!=") != 0 &&
+           strcmp(op, "<=") != 0 && strcmp(op, ">=") != 0;
+}
+
+static int bc_is_step_op(const char *op)
+{
+    return strcmp(op, "++") == 0 || strcmp(op, "--") == 0 || strcmp(op, "_post++") == 0 ||
+           strcmp(op, "_post--") == 0;
+}
+
+// Adds the names `n` declares to `set`.
+static void bc_declared_by(ASTNode *n, BcNames *set)
+{
+    switch (n->type)
+    {
+    case NODE_VAR_DECL:
+    case NODE_CONST:
+        bc_add_name(set, n->var_decl.name);
+        break;
+    case NODE_FOR_RANGE:
+        bc_add_name(set, n->for_range.var_name);
+        break;
+    case NODE_DESTRUCT_VAR:
+        for (int i = 0; i < n->destruct.count; i++)
+        {
+            bc_add_name(set, n->destruct.names[i]);
+        }
+        break;
+    case NODE_MATCH_CASE:
+        for (int i = 0; i < n->match_case.binding_count; i++)
+        {
+            bc_add_name(set, n->match_case.binding_names[i]);
+        }
+        break;
+    case NODE_LAMBDA:
+        for (int i = 0; i < n->lambda.num_params; i++)
+        {
+            bc_add_name(set, n->lambda.param_names[i]);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Names that `n` may change: assigned, stepped, address taken, method called
+// on, or declared again.
+static int bc_collect_writes(ASTNode *n, void *ud)
+{
+    BcNames *set = ud;
+    bc_declared_by(n, set);
+    if (n->type == NODE_RAW_STMT)
+    {
+        bc_add_raw_names(set, n->raw_stmt.content);
+    }
+    else if (n->type == NODE_EXPR_BINARY && bc_is_assign_op(n->binary.op))
+    {
+        bc_add_name(set, bc_root_var(n->binary.left));
+    }
+    else if (n->type == NODE_EXPR_UNARY &&
+             (bc_is_step_op(n->unary.op) || strcmp(n->unary.op, "&") == 0))
+    {
+        bc_add_name(set, bc_root_var(n->unary.operand));
+    }
+    else if (n->type == NODE_EXPR_CALL && n->call.callee &&
+             n->call.callee->type == NODE_EXPR_MEMBER)
+    {
+        bc_add_name(set, bc_root_var(n->call.callee->member.target));
+    }
+    return 1;
+}
+
+static int bc_scan_function(ASTNode *n, void *ud)
+{
+    BcFunc *f = ud;
+    bc_declared_by(n, &f->declared);
+    switch (n->type)
+    {
+    case NODE_RAW_STMT:
+        bc_add_raw_names(&f->escaped, n->raw_stmt.content);
+        break;
+    case NODE_ASM:
+    case NODE_PLUGIN:
+        f->opaque = 1;
+        break;
+    case NODE_LAMBDA:
+        // A lambda may run at any point of the function.
+        bc_visit(n->lambda.body, bc_collect_writes, &f->escaped);
+        break;
+    case NODE_EXPR_UNARY:
+        if (strcmp(n->unary.op, "&") == 0)
+        {
+            bc_add_name(&f->escaped, bc_root_var(n->unary.operand));
+        }
+        break;
+    case NODE_EXPR_CALL:
+        // Methods may take `self` by pointer.
+        if (n->call.callee && n->call.callee->type == NODE_EXPR_MEMBER)
+        {
+            bc_add_name(&f->escaped, bc_root_var(n->call.callee->member.target));
+        }
+        break;
+    default:
+        break;
+    }
+    return 1;
+}
+
+typedef struct
+{
+    BcFunc *func;
+    BcNames writes;
+} BcLoopScope;
+
+// A local of the function that nothing but the loop's own writes could change.
+static int bc_stable(BcLoopScope *s, const char *name)
+{
+    return !s->func->opaque && bc_has_name(&s->func->declared, name) &&
+           !bc_has_name(&bc_globals, name) && !bc_has_name(&s->func->escaped, name) &&
+           !bc_has_name(&s->writes, name);
+}
+
+// `X.len` of a slice variable, with X returned.
+static char *bc_slice_len(ASTNode *n)
+{
+    if (!n || n->type != NODE_EXPR_MEMBER || n->member.is_pointer_access ||
+        strcmp(n->member.field, "len") != 0)
+    {
+        return NULL;
+    }
+    ASTNode *t = n->member.target;
+    if (t->type != NODE_EXPR_VAR || !t->type_info || t->type_info->kind != TYPE_ARRAY ||
+        t->type_info->array_size != 0)
+    {
+        return NULL;
+    }
+    return t->var_ref.name;
+}
+
+// Side-effect free and, if `stable`, unchanged while the loop runs.
+static int bc_pure(BcLoopScope *s, ASTNode *n, int stable)
+{
+    if (!n)
+    {
+        return 0;
+    }
+    switch (n->type)
+    {
+    case NODE_EXPR_LITERAL:
+        return n->literal.type_kind == LITERAL_INT;
+    case NODE_EXPR_VAR:
+        return !stable || bc_stable(s, n->var_ref.name);
+    case NODE_EXPR_MEMBER:
+    {
+        char *slice = bc_slice_len(n);
+        return slice && (!stable || bc_stable(s, slice));
+    }
+    case NODE_EXPR_BINARY:
+        return (strcmp(n->binary.op, "+") == 0 || strcmp(n->binary.op, "-") == 0 ||
+                strcmp(n->binary.op, "*") == 0) &&
+               bc_pure(s, n->binary.left, stable) && bc_pure(s, n->binary.right, stable);
+    default:
+        return 0;
+    }
+}
+
+typedef struct
+{
+    BcLoop *loop;
+    BcLoopScope *scope;
+} BcSiteScan;
+
+static int bc_collect_sites(ASTNode *n, void *ud)
+{
+    BcSiteScan *scan = ud;
+    const char *var = scan->loop->loop->for_range.var_name;
+    if (n->type == NODE_LAMBDA ||
+        (n->type == NODE_FOR_RANGE && strcmp(n->for_range.var_name, var) == 0))
+    {
+        return 0;
+    }
+    if (n->type == NODE_EXPR_INDEX && n->index.index && n->index.index->type == NODE_EXPR_VAR &&
+        strcmp(n->index.index->var_ref.name, var) == 0)
+    {
+        BcLoop *l = scan->loop;
+        if (l->site_count == l->site_cap)
+        {
+            l->site_cap = l->site_cap ? l->site_cap * 2 : 4;
+            l->sites = xrealloc(l->sites, l->site_cap * sizeof(BcSite));
+        }
+        BcSite *site = &l->sites[l->site_count++];
+        memset(site, 0, sizeof(*site));
+        site->index = n;
+        ASTNode *arr = n->index.array;
+        site->stable = arr->type == NODE_EXPR_VAR && bc_stable(scan->scope, arr->var_ref.name);
+    }
+    return 1;
+}
+
+// A step that is a positive integer constant.
+static int bc_step_is_positive(const char *step)
+{
+    if (!step)
+    {
+        return 1;
+    }
+    int nonzero = 0;
+    for (const char *p = step; *p; p++)
+    {
+        if (*p < '0' || *p > '9')
+        {
+            return 0;
+        }
+        nonzero |= *p != '0';
+    }
+    return nonzero;
+}
+
+static void bc_analyze_loop(BcFunc *func, ASTNode *loop)
+{
+    if (!bc_step_is_positive(loop->for_range.step))
+    {
+        return;
+    }
+    BcLoopScope scope = {func, {0}};
+    bc_visit(loop->for_range.body, bc_collect_writes, &scope.writes);
+    if (bc_has_name(&scope.writes, loop->for_range.var_name))
+    {
+        return;
+    }
+
+    if (bc_loop_count == bc_loop_cap)
+    {
+        bc_loop_cap = bc_loop_cap ? bc_loop_cap * 2 : 16;
+        bc_loops = xrealloc(bc_loops, bc_loop_cap * sizeof(BcLoop));
+    }
+    BcLoop *l = &bc_loops[bc_loop_count];
+    memset(l, 0, sizeof(*l));
+    l->loop = loop;
+    BcSiteScan scan = {l, &scope};
+    bc_visit(loop->for_range.body, bc_collect_sites, &scan);
+    if (l->site_count == 0)
+    {
+        return;
+    }
+    bc_loop_count++;
+
+    ASTNode *lo = loop->for_range.start;
+    ASTNode *hi = loop->for_range.end;
+    int inclusive = loop->for_range.is_inclusive;
+    l->lo_const = lo && lo->type == NODE_EXPR_LITERAL && lo->literal.type_kind == LITERAL_INT &&
+                  lo->literal.int_val <= 0x7fffffff;
+    l->hi_const = -1;
+    if (hi && hi->type == NODE_EXPR_LITERAL && hi->literal.type_kind == LITERAL_INT &&
+        hi->literal.int_val <= 0x7fffffff)
+    {
+        l->hi_const = (long long)hi->literal.int_val + inclusive;
+    }
+    char *slice = bc_slice_len(hi);
+    if (slice && !inclusive && bc_stable(&scope, slice))
+    {
+        l->hi_len = slice;
+    }
+    l->invariant = bc_pure(&scope, lo, 0) && bc_pure(&scope, hi, 1);
+}
+
+static int bc_find_loops(ASTNode *n, void *ud)
+{
+    if (n->type == NODE_FOR_RANGE)
+    {
+        bc_analyze_loop(ud, n);
+    }
+    return 1;
+}
+
+static void bc_analyze_body(ASTNode *fn)
+{
+    BcFunc func;
+    memset(&func, 0, sizeof(func));
+    if (fn->type == NODE_FUNCTION)
+    {
+        for (int i = 0; fn->func.param_names && i < fn->func.arg_count; i++)
+        {
+            bc_add_name(&func.declared, fn->func.param_names[i]);
+        }
+    }
+    bc_visit(fn, bc_scan_function, &func);
+    bc_visit(fn, bc_find_loops, &func);
+}
+
+static void bc_analyze_decl(ASTNode *n)
+{
+    switch (n->type)
+    {
+    case NODE_FUNCTION:
+    case NODE_TEST:
+        bc_analyze_body(n);
+        break;
+    case NODE_IMPL:
+        for (ASTNode *m = n->impl.methods; m; m = m->next)
+        {
+            bc_analyze_decl(m);
+        }
+        break;
+    case NODE_IMPL_TRAIT:
+        for (ASTNode *m = n->impl_trait.methods; m; m = m->next)
+        {
+            bc_analyze_decl(m);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void bc_add_global(ASTNode *n)
+{
+    if (n->type == NODE_VAR_DECL || n->type == NODE_CONST)
+    {
+        bc_add_name(&bc_globals, n->var_decl.name);
+    }
+}
+
+void bounds_analyze(ParserContext *ctx, ASTNode *root)
+{
+    bc_loop_count = 0;
+    bc_active_count = 0;
+    bc_globals.count = 0;
+    if (g_config.bounds_checks != BOUNDS_CHECKS_ELIDE)
+    {
+        return;
+    }
+
+    ASTNode *top = (root && root->type == NODE_ROOT) ? root->root.children : NULL;
+    for (ASTNode *n = top; n; n = n->next)
+    {
+        bc_add_global(n);
+    }
+    for (StructRef *r = ctx->parsed_globals_list; r; r = r->next)
+    {
+        bc_add_global(r->node);
+    }
+
+    for (ASTNode *n = top; n; n = n->next)
+    {
+        bc_analyze_decl(n);
+    }
+    for (ASTNode *n = ctx->instantiated_funcs; n; n = n->next)
+    {
+        bc_analyze_decl(n);
+    }
+    for (StructRef *r = ctx->parsed_funcs_list; r; r = r->next)
+    {
+        bc_analyze_decl(r->node);
+    }
+    for (StructRef *r = ctx->parsed_impls_list; r; r = r->next)
+    {
+        bc_analyze_decl(r->node);
+    }
+}
+
+static BcLoop *bc_find_loop(ASTNode *loop)
+{
+    for (int i = 0; i < bc_loop_count; i++)
+    {
+        if (bc_loops[i].loop == loop)
+        {
+            return &bc_loops[i];
+        }
+    }
+    return NULL;
+}
+
+static void bc_emit_guard(ParserContext *ctx, BcLoop *l, BcSite *site, FILE *out)
+{
+    ASTNode *loop = l->loop;
+    if (!l->opened)
+    {
+        fprintf(out, "{ ");
+        l->opened = 1;
+    }
+    site->guard = bc_guard_count++;
+    fprintf(out, "const int _z_inb_%d = (long long)(", site->guard);
+    codegen_expression(ctx, loop->for_range.start, out);
+    fprintf(out, ") >= 0 && (unsigned long long)(");
+    codegen_expression(ctx, loop->for_range.end, out);
+    fprintf(out, ") %s (unsigned long long)(", loop->for_range.is_inclusive ? "<" : "<=");
+    if (site->fixed_size > 0)
+    {
+        fprintf(out, "%d", site->fixed_size);
+    }
+    else
+    {
+        codegen_expression(ctx, site->index->index.array, out);
+        fprintf(out, ".len");
+    }
+    fprintf(out, "); ");
+}
+
+void bounds_loop_begin(ParserContext *ctx, ASTNode *loop, FILE *out)
+{
+    BcLoop *l = g_config.bounds_checks == BOUNDS_CHECKS_ELIDE ? bc_find_loop(loop) : NULL;
+    if (!l)
+    {
+        return;
+    }
+    l->opened = 0;
+    for (int i = 0; i < l->site_count; i++)
+    {
+        BcSite *site = &l->sites[i];
+        int fixed_size = 0;
+        int kind = codegen_index_limit(ctx, site->index, &fixed_size);
+        site->plan = BOUNDS_CHECK;
+        site->fixed_size = fixed_size;
+        if (kind == 1 && site->stable)
+        {
+            const char *name = site->index->index.array->var_ref.name;
+            if (l->lo_const && l->hi_len && strcmp(l->hi_len, name) == 0)
+            {
+                site->plan = BOUNDS_ELIDE;
+            }
+            else if (l->invariant)
+            {
+                site->plan = BOUNDS_GUARD;
+            }
+        }
+        else if (kind == 2)
+        {
+            if (l->lo_const && l->hi_const >= 0 && l->hi_const <= fixed_size)
+            {
+                site->plan = BOUNDS_ELIDE;
+            }
+            else if (l->invariant)
+            {
+                site->plan = BOUNDS_GUARD;
+            }
+        }
+        if (site->plan != BOUNDS_GUARD)
+        {
+            continue;
+        }
+
+        // Accesses checked against the same limit share one comparison.
+        BcSite *same = NULL;
+        for (int j = 0; j < i && !same; j++)
+        {
+            BcSite *other = &l->sites[j];
+            if (other->plan == BOUNDS_GUARD && other->fixed_size == fixed_size &&
+                (fixed_size > 0 || strcmp(other->index->index.array->var_ref.name,
+                                          site->index->index.array->var_ref.name) == 0))
+            {
+                same = other;
+            }
+        }
+        if (same)
+        {
+            site->guard = same->guard;
+        }
+        else
+        {
+            bc_emit_guard(ctx, l, site, out);
+        }
+    }
+
+    if (bc_active_count == bc_active_cap)
+    {
+        bc_active_cap = bc_active_cap ? bc_active_cap * 2 : 8;
+        bc_active = xrealloc(bc_active, bc_active_cap * sizeof(BcLoop *));
+    }
+    bc_active[bc_active_count++] = l;
+}
+
+void bounds_loop_end(ASTNode *loop, FILE *out)
+{
+    if (bc_active_count == 0 || bc_active[bc_active_count - 1]->loop != loop)
+    {
+        return;
+    }
+    BcLoop *l = bc_active[--bc_active_count];
+    if (l->opened)
+    {
+        fprintf(out, "}");
+    }
+}
+
+BoundsPlan bounds_plan(ASTNode *index, int fixed_size, int *guard)
+{
+    if (g_config.bounds_checks == BOUNDS_CHECKS_OFF)
+    {
+        bc_elided++;
+        return BOUNDS_ELIDE;
+    }
+    for (int i = bc_active_count - 1; i >= 0; i--)
+    {
+        BcLoop *l = bc_active[i];
+        for (int j = 0; j < l->site_count; j++)
+        {
+            BcSite *site = &l->sites[j];
+            if (site->index != index)
+            {
+                continue;
+            }
+            if (site->plan == BOUNDS_CHECK || site->fixed_size != fixed_size)
+            {
+                return BOUNDS_CHECK;
+            }
+            if (site->plan == BOUNDS_GUARD)
+            {
+                *guard = site->guard;
+                bc_hoisted++;
+            }
+            else
+            {
+                bc_elided++;
+            }
+            return site->plan;
+        }
+    }
+    return BOUNDS_CHECK;
+}
+
+void bounds_counts(int *elided, int *hoisted)
+{
+    *elided = bc_elided;
+    *hoisted = bc_hoisted;
+}
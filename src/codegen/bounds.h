@@ -0,0 +1,61 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "parser.h"
+#include <stdio.h>
+
+// Bounds-check elimination for indexing.
+//
+// Indexing a slice variable or a fixed-size array goes through
+// `_z_check_bounds`. Inside `for i in lo..hi` (no step, or a positive one),
+// an index that is the loop variable itself lies in [lo, hi) as long as the
+// body never assigns it. When lo is a constant >= 0 and hi is `s.len` of
+// the slice being indexed, or a constant no larger than the array, the
+// check is left out.
+//
+// Otherwise, if lo, hi and the limit cannot change while the loop runs -
+// constants, and locals the loop never writes and nothing ever takes the
+// address of - the comparison is hoisted: it is made once before the loop,
+// and each access only tests its result.
+
+typedef enum
+{
+    BOUNDS_CHECK, ///< Emit `_z_check_bounds` as usual.
+    BOUNDS_ELIDE, ///< The index is known to be in range.
+    BOUNDS_GUARD  ///< Use the hoisted comparison, checking only if it failed.
+} BoundsPlan;
+
+/**
+ * @brief Finds the loop-variable indexes of every function and test.
+ *
+ * Does nothing unless bounds checks are elided (the default).
+ */
+void bounds_analyze(ParserContext *ctx, ASTNode *root);
+
+/**
+ * @brief Plans the accesses of a range loop and emits its hoisted checks.
+ *
+ * Called right before the loop is written. If any check is hoisted, this
+ * opens a block that bounds_loop_end() closes.
+ */
+void bounds_loop_begin(ParserContext *ctx, ASTNode *loop, FILE *out);
+
+/**
+ * @brief Closes what bounds_loop_begin() opened for @p loop.
+ */
+void bounds_loop_end(ASTNode *loop, FILE *out);
+
+/**
+ * @brief Returns how the access @p index (a NODE_EXPR_INDEX) is checked.
+ *
+ * @param fixed_size The array size it is checked against, or 0 for a slice.
+ * @param guard      Set to the number of the `_z_inb_N` flag for BOUNDS_GUARD.
+ */
+BoundsPlan bounds_plan(ASTNode *index, int fixed_size, int *guard);
+
+/**
+ * @brief Number of checks left out, and of those hoisted out of loops.
+ */
+void bounds_counts(int *elided, int *hoisted);
+
+#endif
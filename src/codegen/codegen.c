@@ -1,4 +1,6 @@
 #include "codegen.h"
+#include "analysis/escape.h"
+#include "bounds.h"
 #include "zprep.h"
 #include "../constants.h"
 #include <ctype.h>
@@ -44,7 +46,21 @@ static void codegen_literal_expr(ASTNode *node, FILE *out)
     }
     else if (node->literal.type_kind == LITERAL_FLOAT)
     {
-        fprintf(out, "%f", node->literal.float_val);
+        // Shortest spelling that reads back as the same double.
+        char buf[64];
+        for (int prec = 15; prec <= 17; prec++)
+        {
+            snprintf(buf, sizeof(buf), "%.*g", prec, node->literal.float_val);
+            if (strtod(buf, NULL) == node->literal.float_val)
+            {
+                break;
+            }
+        }
+        if (!strpbrk(buf, ".eEni"))
+        {
+            strcat(buf, ".0");
+        }
+        fprintf(out, "%s", buf);
     }
     else // LITERAL_INT
     {
@@ -143,12 +159,89 @@ static void codegen_var_expr(ParserContext *ctx, ASTNode *node, FILE *out)
     fprintf(out, "%s", node->var_ref.name);
 }
 
-// Emit lambda expression
+// Emits what a by-reference capture points at: the variable itself, or,
+// inside another lambda, the enclosing context's copy of it.
+static void codegen_capture_ref(ASTNode *node, int i, FILE *out)
+{
+    const char *name = node->lambda.captured_vars[i];
+    if (g_current_lambda)
+    {
+        for (int k = 0; k < g_current_lambda->lambda.num_captures; k++)
+        {
+            if (strcmp(name, g_current_lambda->lambda.captured_vars[k]) == 0)
+            {
+                if (g_current_lambda->lambda.capture_modes &&
+                    g_current_lambda->lambda.capture_modes[k] == 1)
+                {
+                    fprintf(out, "ctx->%s", name);
+                }
+                else
+                {
+                    fprintf(out, "&ctx->%s", name);
+                }
+                return;
+            }
+        }
+    }
+    fprintf(out, "&%s", name);
+}
+
+static void codegen_capture_value(ParserContext *ctx, ASTNode *node, int i, FILE *out)
+{
+    ASTNode *var_node = ast_create(NODE_EXPR_VAR);
+    var_node->var_ref.name = xstrdup(node->lambda.captured_vars[i]);
+    var_node->token = node->token;
+
+    if (node->lambda.captured_types && node->lambda.captured_types[i])
+    {
+        var_node->resolved_type = xstrdup(node->lambda.captured_types[i]);
+    }
+    else
+    {
+        // Should rely on analysis, but fallback just in case.
+        var_node->resolved_type = xstrdup("int");
+    }
+
+    codegen_expression_with_move(ctx, var_node, out);
+
+    ast_free(var_node);
+}
+
+// Emit lambda expression. A capturing lambda that escape analysis found to
+// stay within its call or block (g_stack_lambda) gets its context as a
+// compound literal in the enclosing block; any other is heap-allocated and
+// belongs to whoever ends up holding the closure.
 static void codegen_lambda_expr(ParserContext *ctx, ASTNode *node, FILE *out)
 {
+    int on_stack = (node == g_stack_lambda);
+    if (on_stack)
+    {
+        g_stack_lambda = NULL;
+    }
+
     if (node->lambda.num_captures > 0)
     {
         int lid = node->lambda.lambda_id;
+        if (on_stack && !g_config.use_cpp)
+        {
+            fprintf(out, "((z_closure_T){.func = _lambda_%d, .ctx = &(struct Lambda_%d_Ctx){", lid,
+                    lid);
+            for (int i = 0; i < node->lambda.num_captures; i++)
+            {
+                fprintf(out, "%s.%s = ", i > 0 ? ", " : "", node->lambda.captured_vars[i]);
+                if (node->lambda.capture_modes && node->lambda.capture_modes[i] == 1)
+                {
+                    codegen_capture_ref(node, i, out);
+                }
+                else
+                {
+                    codegen_capture_value(ctx, node, i, out);
+                }
+            }
+            fprintf(out, "}})");
+            return;
+        }
+
         if (g_config.use_cpp)
         {
             fprintf(
@@ -166,73 +259,23 @@ static void codegen_lambda_expr(ParserContext *ctx, ASTNode *node, FILE *out)
         }
         for (int i = 0; i < node->lambda.num_captures; i++)
         {
+            fprintf(out, "_z_ctx_%d->%s = ", lid, node->lambda.captured_vars[i]);
             if (node->lambda.capture_modes && node->lambda.capture_modes[i] == 1)
             {
-                int found = 0;
-                if (g_current_lambda)
-                {
-                    for (int k = 0; k < g_current_lambda->lambda.num_captures; k++)
-                    {
-                        if (strcmp(node->lambda.captured_vars[i],
-                                   g_current_lambda->lambda.captured_vars[k]) == 0)
-                        {
-                            if (g_current_lambda->lambda.capture_modes &&
-                                g_current_lambda->lambda.capture_modes[k] == 1)
-                            {
-                                fprintf(out, "_z_ctx_%d->%s = ctx->%s;\n", lid,
-                                        node->lambda.captured_vars[i],
-                                        node->lambda.captured_vars[i]);
-                            }
-                            else
-                            {
-                                fprintf(out, "_z_ctx_%d->%s = &ctx->%s;\n", lid,
-                                        node->lambda.captured_vars[i],
-                                        node->lambda.captured_vars[i]);
-                            }
-                            found = 1;
-                            break;
-                        }
-                    }
-                }
-                if (!found)
-                {
-                    fprintf(out, "_z_ctx_%d->%s = &%s;\n", lid, node->lambda.captured_vars[i],
-                            node->lambda.captured_vars[i]);
-                }
+                codegen_capture_ref(node, i, out);
             }
             else
             {
-                fprintf(out, "_z_ctx_%d->%s = ", lid, node->lambda.captured_vars[i]);
-
-                ASTNode *var_node = ast_create(NODE_EXPR_VAR);
-                var_node->var_ref.name = xstrdup(node->lambda.captured_vars[i]);
-                var_node->token = node->token;
-
-                if (node->lambda.captured_types && node->lambda.captured_types[i])
-                {
-                    var_node->resolved_type = xstrdup(node->lambda.captured_types[i]);
-                }
-                else
-                {
-                    // Should rely on analysis, but fallback just in case.
-                    var_node->resolved_type = xstrdup("int");
-                }
-
-                codegen_expression_with_move(ctx, var_node, out);
-
-                ast_free(var_node);
-
-                fprintf(out, ";\n");
+                codegen_capture_value(ctx, node, i, out);
             }
+            fprintf(out, ";\n");
         }
         if (g_config.use_cpp)
         {
-            fprintf(out, "_z_closure_ctx_stash[%d] = _z_ctx_%d;\n", lid, lid);
             fprintf(out, "z_closure_T _cl = {(void*)_lambda_%d, _z_ctx_%d}; _cl; })", lid, lid);
         }
         else
         {
-            fprintf(out, "_z_closure_ctx_stash[%d] = _z_ctx_%d;\n", lid, lid);
             fprintf(out, "(z_closure_T){.func = _lambda_%d, .ctx = _z_ctx_%d}; })", lid, lid);
         }
     }
@@ -250,6 +293,242 @@ static void codegen_lambda_expr(ParserContext *ctx, ASTNode *node, FILE *out)
     }
 }
 
+// Emits argument `index` of a call to the C function `fname`. A lambda
+// passed to a parameter that never lets it escape gets a stack context.
+static void codegen_call_arg(ParserContext *ctx, const char *fname, int index, ASTNode *arg,
+                             FILE *out)
+{
+    if (arg->type == NODE_LAMBDA && arg->lambda.num_captures > 0 && fname &&
+        escape_param_is_local(fname, index))
+    {
+        g_stack_lambda = arg;
+    }
+    codegen_expression_with_move(ctx, arg, out);
+}
+
+// Closure specialisation. A function whose closure parameter is only called
+// (or handed on) gets a clone per lambda passed to it, in which calls to the
+// parameter go straight to `_lambda_N` and so can be inlined.
+typedef struct SpecClone
+{
+    ASTNode *fn;
+    const char *impl_type;
+    int index;
+    ASTNode *lambda;
+    char *name;
+    int emitted;
+    struct SpecClone *next;
+} SpecClone;
+
+static SpecClone *spec_clones = NULL;
+static SpecClone *spec_current = NULL; // Clone whose body is being emitted
+
+// The lambda an argument is known to hold: a literal, or the parameter of
+// the clone being emitted.
+static ASTNode *spec_known_lambda(ASTNode *arg)
+{
+    if (arg->type == NODE_LAMBDA)
+    {
+        return arg;
+    }
+    if (spec_current && arg->type == NODE_EXPR_VAR &&
+        strcmp(arg->var_ref.name, spec_current->fn->func.param_names[spec_current->index]) == 0)
+    {
+        return spec_current->lambda;
+    }
+    return NULL;
+}
+
+// Returns the clone of `fname` to call instead, specialised on the first
+// argument that is a known lambda, or NULL. `first_index` is the parameter
+// index of the first argument (1 when `self` is passed separately).
+static SpecClone *spec_for_call(const char *fname, ASTNode *args, int first_index)
+{
+    if (!fname || g_config.use_cpp || g_config.use_cuda)
+    {
+        return NULL;
+    }
+    int index = first_index;
+    for (ASTNode *arg = args; arg; arg = arg->next, index++)
+    {
+        ASTNode *lambda = spec_known_lambda(arg);
+        if (!lambda || !escape_param_is_local(fname, index))
+        {
+            continue;
+        }
+        const char *impl_type = NULL;
+        int has_statics = 1;
+        ASTNode *fn = escape_function(fname, &impl_type, &has_statics);
+        // A clone would get its own copy of any static local.
+        if (!fn || fn->func.is_async || has_statics)
+        {
+            return NULL;
+        }
+        for (SpecClone *c = spec_clones; c; c = c->next)
+        {
+            if (c->fn == fn && c->index == index && c->lambda == lambda)
+            {
+                return c;
+            }
+        }
+        SpecClone *c = xmalloc(sizeof(SpecClone));
+        c->fn = fn;
+        c->impl_type = impl_type;
+        c->index = index;
+        c->lambda = lambda;
+        c->name = xmalloc(strlen(fn->func.name) + 48);
+        sprintf(c->name, "%s__lambda_%d_%d", fn->func.name, lambda->lambda.lambda_id, index);
+        c->emitted = 0;
+        c->next = spec_clones;
+        spec_clones = c;
+        return c;
+    }
+    return NULL;
+}
+
+// Opens a call to a clone. It is defined after everything else, so the call
+// declares it in a block of its own; closed by spec_call_close().
+static void spec_call_open(ParserContext *ctx, SpecClone *c, FILE *out)
+{
+    ASTNode decl = *c->fn;
+    decl.func.cuda_global = decl.func.cuda_device = decl.func.cuda_host = 0;
+    fprintf(out, "({ extern ");
+    emit_func_signature(ctx, out, &decl, c->name);
+    fprintf(out, "; %s(", c->name);
+}
+
+static void spec_call_close(FILE *out)
+{
+    fprintf(out, "); })");
+}
+
+void emit_closure_specializations(ParserContext *ctx, FILE *out)
+{
+    // Emitting a clone can ask for more (a parameter handed on to another
+    // function), so go round until nothing is left.
+    int pending = 1;
+    while (pending)
+    {
+        pending = 0;
+        for (SpecClone *c = spec_clones; c; c = c->next)
+        {
+            if (c->emitted)
+            {
+                continue;
+            }
+            c->emitted = 1;
+            pending = 1;
+
+            ASTNode copy = *c->fn;
+            copy.next = NULL;
+            copy.func.name = c->name;
+            copy.func.is_inline = 0;
+            copy.func.constructor = 0;
+            copy.func.destructor = 0;
+            copy.func.weak = 0;
+            copy.func.is_export = 0;
+            copy.func.section = NULL;
+            copy.func.attributes = NULL;
+
+            if (copy.cfg_condition)
+            {
+                fprintf(out, "#if %s\n", copy.cfg_condition);
+            }
+            char *prev_impl = g_current_impl_type;
+            g_current_impl_type = (char *)c->impl_type;
+            spec_current = c;
+            codegen_node_single(ctx, &copy, out);
+            spec_current = NULL;
+            g_current_impl_type = prev_impl;
+            if (copy.cfg_condition)
+            {
+                fprintf(out, "#endif\n");
+            }
+        }
+    }
+
+    while (spec_clones)
+    {
+        SpecClone *next = spec_clones->next;
+        free(spec_clones->name);
+        free(spec_clones);
+        spec_clones = next;
+    }
+}
+
+// `a[i]` on a slice struct, indexed through its `.data`.
+static int index_is_slice(ParserContext *ctx, ASTNode *node)
+{
+    ASTNode *arr = node->index.array;
+    if (arr->type_info && arr->type_info->kind == TYPE_ARRAY && arr->type_info->array_size == 0)
+    {
+        return 1;
+    }
+    if (arr->resolved_type)
+    {
+        return strncmp(arr->resolved_type, "Slice_", 6) == 0;
+    }
+    if (arr->type_info)
+    {
+        return 0;
+    }
+    char *inferred = infer_type(ctx, arr);
+    int is_slice = inferred && strncmp(inferred, "Slice_", 6) == 0;
+    if (inferred)
+    {
+        free(inferred);
+    }
+    return is_slice;
+}
+
+int codegen_index_limit(ParserContext *ctx, ASTNode *node, int *fixed_size)
+{
+    ASTNode *arr = node->index.array;
+    if (index_is_slice(ctx, node))
+    {
+        return arr->type == NODE_EXPR_VAR ? 1 : 0;
+    }
+    if (arr->type_info &&
+        (arr->type_info->kind == TYPE_ARRAY || arr->type_info->kind == TYPE_VECTOR) &&
+        arr->type_info->array_size > 0)
+    {
+        *fixed_size = arr->type_info->array_size;
+        return 2;
+    }
+    return 0;
+}
+
+// The index of `node`, checked against `fixed_size`, or the slice's length if
+// it is 0, unless range analysis made the check unnecessary.
+static void emit_checked_index(ParserContext *ctx, ASTNode *node, int fixed_size, FILE *out)
+{
+    int guard = -1;
+    BoundsPlan plan = bounds_plan(node, fixed_size, &guard);
+    if (plan == BOUNDS_ELIDE)
+    {
+        codegen_expression(ctx, node->index.index, out);
+        return;
+    }
+    if (plan == BOUNDS_GUARD)
+    {
+        fprintf(out, "_z_inb_%d ? ", guard);
+        codegen_expression(ctx, node->index.index, out);
+        fprintf(out, " : ");
+    }
+    fprintf(out, "_z_check_bounds(");
+    codegen_expression(ctx, node->index.index, out);
+    fprintf(out, ", ");
+    if (fixed_size > 0)
+    {
+        fprintf(out, "%d)", fixed_size);
+    }
+    else
+    {
+        codegen_expression(ctx, node->index.array, out);
+        fprintf(out, ".len)");
+    }
+}
+
 void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
 {
     if (!node)
@@ -600,17 +879,36 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                         }
                     }
 
-                    fprintf(out, "%s__%s((%s[]){", mangled_base, method, type_mangled);
+                    char fname[512];
+                    snprintf(fname, sizeof(fname), "%s__%s", mangled_base, method);
+                    SpecClone *spec = spec_for_call(fname, node->call.args, 1);
+                    if (spec)
+                    {
+                        spec_call_open(ctx, spec, out);
+                        fprintf(out, "(%s[]){", type_mangled);
+                    }
+                    else
+                    {
+                        fprintf(out, "%s((%s[]){", fname, type_mangled);
+                    }
                     codegen_expression(ctx, target, out);
                     fprintf(out, "}");
                     ASTNode *arg = node->call.args;
+                    int arg_idx = 1;
                     while (arg)
                     {
                         fprintf(out, ", ");
-                        codegen_expression_with_move(ctx, arg, out);
+                        codegen_call_arg(ctx, fname, arg_idx++, arg, out);
                         arg = arg->next;
                     }
-                    fprintf(out, ")");
+                    if (spec)
+                    {
+                        spec_call_close(out);
+                    }
+                    else
+                    {
+                        fprintf(out, ")");
+                    }
                 }
                 else
                 {
@@ -698,7 +996,17 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                         }
                     }
 
-                    fprintf(out, "%s__%s(", call_base, method);
+                    char fname[512];
+                    snprintf(fname, sizeof(fname), "%s__%s", call_base, method);
+                    SpecClone *spec = spec_for_call(fname, node->call.args, 1);
+                    if (spec)
+                    {
+                        spec_call_open(ctx, spec, out);
+                    }
+                    else
+                    {
+                        fprintf(out, "%s(", fname);
+                    }
                     if (need_cast)
                     {
                         fprintf(out, "(%s*)%s", call_base, strchr(type, '*') ? "" : "&");
@@ -709,13 +1017,21 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                     }
                     codegen_expression(ctx, target, out);
                     ASTNode *arg = node->call.args;
+                    int arg_idx = 1;
                     while (arg)
                     {
                         fprintf(out, ", ");
-                        codegen_expression_with_move(ctx, arg, out);
+                        codegen_call_arg(ctx, fname, arg_idx++, arg, out);
                         arg = arg->next;
                     }
-                    fprintf(out, ")");
+                    if (spec)
+                    {
+                        spec_call_close(out);
+                    }
+                    else
+                    {
+                        fprintf(out, ")");
+                    }
 
                     if (resolved_method_suffix)
                     {
@@ -742,6 +1058,23 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             }
         }
 
+        // Inside a clone, the specialised parameter is called directly.
+        if (spec_current && node->call.callee->type == NODE_EXPR_VAR &&
+            spec_known_lambda(node->call.callee) == spec_current->lambda)
+        {
+            fprintf(out, "_lambda_%d(%s.ctx", spec_current->lambda->lambda.lambda_id,
+                    node->call.callee->var_ref.name);
+            ASTNode *arg = node->call.args;
+            while (arg)
+            {
+                fprintf(out, ", ");
+                codegen_expression_with_move(ctx, arg, out);
+                arg = arg->next;
+            }
+            fprintf(out, ")");
+            break;
+        }
+
         if (node->call.callee->type_info && node->call.callee->type_info->kind == TYPE_FUNCTION &&
             !node->call.callee->type_info->is_raw)
         {
@@ -792,8 +1125,20 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             break;
         }
 
-        codegen_expression(ctx, node->call.callee, out);
-        fprintf(out, "(");
+        SpecClone *spec = NULL;
+        if (node->call.callee->type == NODE_EXPR_VAR && !node->call.arg_names)
+        {
+            spec = spec_for_call(node->call.callee->var_ref.name, node->call.args, 0);
+        }
+        if (spec)
+        {
+            spec_call_open(ctx, spec, out);
+        }
+        else
+        {
+            codegen_expression(ctx, node->call.callee, out);
+            fprintf(out, "(");
+        }
 
         if (node->call.arg_names && node->call.callee->type == NODE_EXPR_VAR)
         {
@@ -941,7 +1286,11 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                 }
                 else
                 {
-                    codegen_expression_with_move(ctx, arg, out);
+                    codegen_call_arg(ctx,
+                                     node->call.callee->type == NODE_EXPR_VAR
+                                         ? node->call.callee->var_ref.name
+                                         : NULL,
+                                     arg_idx, arg, out);
                 }
 
                 if (arg && arg->next)
@@ -955,7 +1304,14 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                 arg_idx++;
             }
         }
-        fprintf(out, ")");
+        if (spec)
+        {
+            spec_call_close(out);
+        }
+        else
+        {
+            fprintf(out, ")");
+        }
         break;
     }
     case NODE_EXPR_MEMBER:
@@ -1019,47 +1375,16 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
         break;
     case NODE_EXPR_INDEX:
     {
-        int is_slice_struct = 0;
-        if (node->index.array->type_info)
-        {
-            if (node->index.array->type_info->kind == TYPE_ARRAY &&
-                node->index.array->type_info->array_size == 0)
-            {
-                is_slice_struct = 1;
-            }
-        }
-
-        if (!is_slice_struct && node->index.array->resolved_type)
-        {
-            if (strncmp(node->index.array->resolved_type, "Slice_", 6) == 0)
-            {
-                is_slice_struct = 1;
-            }
-        }
-
-        if (!is_slice_struct && !node->index.array->type_info && !node->index.array->resolved_type)
-        {
-            char *inferred = infer_type(ctx, node->index.array);
-            if (inferred && strncmp(inferred, "Slice_", 6) == 0)
-            {
-                is_slice_struct = 1;
-            }
-            if (inferred)
-            {
-                free(inferred);
-            }
-        }
+        int is_slice_struct = index_is_slice(ctx, node);
 
         if (is_slice_struct)
         {
             if (node->index.array->type == NODE_EXPR_VAR)
             {
                 codegen_expression(ctx, node->index.array, out);
-                fprintf(out, ".data[_z_check_bounds(");
-                codegen_expression(ctx, node->index.index, out);
-                fprintf(out, ", ");
-                codegen_expression(ctx, node->index.array, out);
-                fprintf(out, ".len)]");
+                fprintf(out, ".data[");
+                emit_checked_index(ctx, node, 0, out);
+                fprintf(out, "]");
             }
             else
             {
@@ -1131,12 +1456,11 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                 fprintf(out, "[");
                 if (fixed_size > 0)
                 {
-                    fprintf(out, "_z_check_bounds(");
+                    emit_checked_index(ctx, node, fixed_size, out);
                 }
-                codegen_expression(ctx, node->index.index, out);
-                if (fixed_size > 0)
+                else
                 {
-                    fprintf(out, ", %d)", fixed_size);
+                    codegen_expression(ctx, node->index.index, out);
                 }
                 fprintf(out, "]");
             }
@@ -46,6 +46,14 @@ void codegen_expression_bare(ParserContext *ctx, ASTNode *node, FILE *out);
  */
 void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out, int use_result);
 
+/**
+ * @brief How an index expression is bounds checked.
+ *
+ * @return 1 against the `.len` of a slice variable, 2 against a fixed array
+ *         size (stored in @p fixed_size), 0 if it is not checked.
+ */
+int codegen_index_limit(ParserContext *ctx, ASTNode *node, int *fixed_size);
+
 // Utility functions (codegen_utils.c).
 char *infer_type(ParserContext *ctx, ASTNode *node);
 ASTNode *find_struct_def_codegen(ParserContext *ctx, const char *name);
@@ -100,10 +108,13 @@ extern int loop_defer_boundary[]; ///< Defer stack index at start of each loop.
 extern int loop_depth;            ///< Current loop nesting depth.
 extern int func_defer_boundary;   ///< Defer stack index at function entry.
 
-// Closure context free tracking
-#define MAX_PENDING_CLOSURE_FREES 64
-extern int pending_closure_frees[]; ///< Lambda IDs whose ctx needs freeing.
-extern int pending_closure_free_count;
-void emit_pending_closure_frees(FILE *out);
+// Closure contexts
+extern ASTNode *g_stack_lambda; ///< Lambda found not to escape; its ctx goes on the stack.
+
+/**
+ * @brief Emits the clones of functions specialised on the lambda they are
+ * passed, as requested while emitting calls. Called after all functions.
+ */
+void emit_closure_specializations(ParserContext *ctx, FILE *out);
 
 #endif
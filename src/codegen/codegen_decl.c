@@ -4,6 +4,7 @@
 #include "../zprep.h"
 #include "codegen.h"
 #include "compat.h"
+#include "dead_code.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,7 +35,6 @@ static void emit_freestanding_preamble(FILE *out)
           out);
     fputs("#define _z_arg(x) _Generic((x), _Bool: _z_bool_str(x), default: (x))\n", out);
     fputs("typedef struct { void *func; void *ctx; } z_closure_T;\n", out);
-    fputs("static void *_z_closure_ctx_stash[256];\n", out);
 
     // In true freestanding, explicit definitions of z_malloc/etc are removed.
     // The user must implement them if they use features requiring them.
@@ -113,7 +113,6 @@ void emit_preamble(ParserContext *ctx, FILE *out)
             fputs("typedef struct { pthread_t thread; void *result; } Async;\n", out);
         }
         fputs("typedef struct { void *func; void *ctx; } z_closure_T;\n", out);
-        fputs("static void *_z_closure_ctx_stash[256];\n", out);
         fputs("typedef void U0;\ntypedef int8_t I8;\ntypedef uint8_t U8;\ntypedef "
               "int16_t I16;\ntypedef uint16_t U16;\n",
               out);
@@ -166,32 +165,34 @@ void emit_preamble(ParserContext *ctx, FILE *out)
         {
             fputs(
                 "string _z_readln_raw() { "
-                "size_t cap = 64; size_t len = 0; "
+                "size_t cap = 128; size_t len = 0; "
                 "char *line = static_cast<char*>(malloc(cap)); "
                 "if(!line) return NULL; "
-                "int c; "
-                "while((c = fgetc(stdin)) != EOF) { "
-                "if(c == '\\n') break; "
-                "if(len + 1 >= cap) { cap *= 2; char *n = static_cast<char*>(realloc(line, cap)); "
+                "while(fgets(line + len, (int)(cap - len), stdin)) { "
+                "len += strlen(line + len); "
+                "if(len > 0 && line[len - 1] == '\\n') { line[--len] = 0; return line; } "
+                "if(len + 1 < cap) break; "
+                "cap *= 2; char *n = static_cast<char*>(realloc(line, cap)); "
                 "if(!n) { free(line); return NULL; } line = n; } "
-                "line[len++] = c; } "
-                "if(len == 0 && c == EOF) { free(line); return NULL; } "
+                "if(len == 0) { free(line); return NULL; } "
                 "line[len] = 0; return line; }\n",
                 out);
         }
         else
         {
+            // Reads in fgets-sized blocks; a full block without a newline
+            // doubles the buffer.
             fputs("string _z_readln_raw() { "
-                  "size_t cap = 64; size_t len = 0; "
+                  "size_t cap = 128; size_t len = 0; "
                   "char *line = z_malloc(cap); "
                   "if(!line) return NULL; "
-                  "int c; "
-                  "while((c = fgetc(stdin)) != EOF) { "
-                  "if(c == '\\n') break; "
-                  "if(len + 1 >= cap) { cap *= 2; char *n = z_realloc(line, cap); "
+                  "while(fgets(line + len, (int)(cap - len), stdin)) { "
+                  "len += strlen(line + len); "
+                  "if(len > 0 && line[len - 1] == '\\n') { line[--len] = 0; return line; } "
+                  "if(len + 1 < cap) break; "
+                  "cap *= 2; char *n = z_realloc(line, cap); "
                   "if(!n) { z_free(line); return NULL; } line = n; } "
-                  "line[len++] = c; } "
-                  "if(len == 0 && c == EOF) { z_free(line); return NULL; } "
+                  "if(len == 0) { z_free(line); return NULL; } "
                   "line[len] = 0; return line; }\n",
                   out);
         }
@@ -915,6 +916,7 @@ void emit_protos(ParserContext *ctx, ASTNode *node, FILE *out)
             {
                 fprintf(out, "#if %s\n", f->cfg_condition);
             }
+            long dce_start = f->func.body ? dce_unit_start(out) : -1;
             if (f->func.is_async)
             {
                 fprintf(out, "Async %s(%s);\n", f->func.name, f->func.args);
@@ -934,6 +936,7 @@ void emit_protos(ParserContext *ctx, ASTNode *node, FILE *out)
                 emit_func_signature(ctx, out, f, NULL);
                 fprintf(out, ";\n");
             }
+            dce_unit_end(out, DCE_PROTO, f->func.name, dce_start);
             if (f->cfg_condition)
             {
                 fprintf(out, "#endif\n");
@@ -1012,6 +1015,7 @@ void emit_protos(ParserContext *ctx, ASTNode *node, FILE *out)
                     sprintf(proto, "%s__%s", sname, fname);
                 }
 
+                long dce_start = dce_unit_start(out);
                 if (m->func.is_async)
                 {
                     fprintf(out, "Async %s(%s);\n", proto, m->func.args);
@@ -1021,6 +1025,7 @@ void emit_protos(ParserContext *ctx, ASTNode *node, FILE *out)
                     emit_func_signature(ctx, out, m, proto);
                     fprintf(out, ";\n");
                 }
+                dce_unit_end(out, DCE_PROTO, proto, dce_start);
 
                 free(proto);
                 m = m->next;
@@ -1085,6 +1090,7 @@ void emit_protos(ParserContext *ctx, ASTNode *node, FILE *out)
                     m = m->next;
                     continue;
                 }
+                long dce_start = dce_unit_start(out);
                 if (m->func.is_async)
                 {
                     fprintf(out, "Async %s(%s);\n", m->func.name, m->func.args);
@@ -1093,6 +1099,7 @@ void emit_protos(ParserContext *ctx, ASTNode *node, FILE *out)
                 {
                     fprintf(out, "%s %s(%s);\n", m->func.ret_type, m->func.name, m->func.args);
                 }
+                dce_unit_end(out, DCE_PROTO, m->func.name, dce_start);
                 m = m->next;
             }
         }
@@ -1207,6 +1214,7 @@ void emit_impl_vtables(ParserContext *ctx, FILE *out)
                 continue;
             }
 
+            long dce_start = dce_unit_start(out);
             fprintf(out, "%s_VTable %s_%s_VTable = {", trait, strct, trait);
 
             ASTNode *m = node->impl_trait.methods;
@@ -1235,6 +1243,10 @@ void emit_impl_vtables(ParserContext *ctx, FILE *out)
                 m = m->next;
             }
             fprintf(out, "};\n");
+
+            char vtable_name[512];
+            snprintf(vtable_name, sizeof(vtable_name), "%s_%s_VTable", strct, trait);
+            dce_unit_end(out, DCE_VTABLE, vtable_name, dce_start);
         }
         ref = ref->next;
     }
@@ -2,6 +2,7 @@
 #include "../ast/ast.h"
 #include "../zprep.h"
 #include "codegen.h"
+#include "analysis/escape.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -701,6 +702,7 @@ void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
             }
         }
 
+        escape_set_functions(merged_funcs);
         emit_protos(ctx, merged_funcs, out);
 
         emit_impl_vtables(ctx, out);
@@ -813,6 +815,9 @@ void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
             iter = iter->next;
         }
 
+        emit_closure_specializations(ctx, out);
+        escape_set_functions(NULL);
+
         int has_user_main = 0;
         ASTNode *chk = merged_funcs;
         while (chk)
@@ -1,8 +1,12 @@
 
 #include "codegen.h"
+#include "analysis/escape.h"
+#include "bounds.h"
+#include "dead_code.h"
 #include "zprep.h"
 #include "../constants.h"
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -190,6 +194,611 @@ static bool is_int_type(TypeKind k)
     }
 }
 
+// Set of the variant names a match's arms name, for the exhaustiveness check.
+typedef struct
+{
+    char **slots;
+    int mask;
+} VariantSet;
+
+static unsigned int variant_hash(const char *s)
+{
+    unsigned int h = 2166136261u;
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void variant_set_add(VariantSet *set, char *name)
+{
+    unsigned int i = variant_hash(name) & set->mask;
+    while (set->slots[i])
+    {
+        if (strcmp(set->slots[i], name) == 0)
+        {
+            return;
+        }
+        i = (i + 1) & set->mask;
+    }
+    set->slots[i] = name;
+}
+
+static int variant_set_has(VariantSet *set, const char *name)
+{
+    unsigned int i = variant_hash(name) & set->mask;
+    while (set->slots[i])
+    {
+        if (strcmp(set->slots[i], name) == 0)
+        {
+            return 1;
+        }
+        i = (i + 1) & set->mask;
+    }
+    return 0;
+}
+
+// Warns about the variants of the matched enum that no arm names. The arms'
+// patterns (including each side of an or-pattern) go into a hashed set once,
+// then the registered variants are walked a single time against it.
+static void check_match_exhaustive(ParserContext *ctx, ASTNode *node)
+{
+    int parts = 0;
+    for (ASTNode *c = node->match_stmt.cases; c; c = c->next)
+    {
+        if (strcmp(c->match_case.pattern, "_") == 0)
+        {
+            return;
+        }
+        parts++;
+        for (const char *p = c->match_case.pattern; *p; p++)
+        {
+            if (*p == '|')
+            {
+                parts++;
+            }
+        }
+    }
+
+    VariantSet set;
+    set.mask = 15;
+    while (set.mask < parts * 2)
+    {
+        set.mask = set.mask * 2 + 1;
+    }
+    set.slots = xcalloc(set.mask + 1, sizeof(char *));
+
+    char *enum_name = NULL;
+    char **copies = xmalloc(sizeof(char *) * (node->match_stmt.cases ? parts : 1));
+    int ncopies = 0;
+    for (ASTNode *c = node->match_stmt.cases; c; c = c->next)
+    {
+        char *pattern_copy = xstrdup(c->match_case.pattern);
+        copies[ncopies++] = pattern_copy;
+        char *saveptr;
+        char *part = strtok_r(pattern_copy, "|", &saveptr);
+        while (part)
+        {
+            variant_set_add(&set, part);
+            if (!enum_name)
+            {
+                EnumVariantReg *reg = find_enum_variant(ctx, part);
+                if (reg)
+                {
+                    enum_name = reg->enum_name;
+                }
+            }
+            part = strtok_r(NULL, "|", &saveptr);
+        }
+    }
+
+    if (enum_name)
+    {
+        for (EnumVariantReg *v = ctx->enum_variants; v; v = v->next)
+        {
+            if (strcmp(v->enum_name, enum_name) == 0 && !variant_set_has(&set, v->variant_name))
+            {
+                zwarn_at(node->token, "Non-exhaustive match: Missing variant '%s'",
+                         v->variant_name);
+            }
+        }
+    }
+
+    for (int i = 0; i < ncopies; i++)
+    {
+        free(copies[i]);
+    }
+    free(copies);
+    free(set.slots);
+}
+
+// Switch lowering.
+//
+// A match whose arms are all variants of one enum, or all integer and char
+// literals and ranges, dispatches through a C switch on the tag or value, so
+// the C compiler can pick a jump table or a binary search instead of testing
+// each arm in turn. The switch only jumps: the arms follow it as labelled
+// blocks, so a `break` or `continue` in an arm still reaches the enclosing
+// loop. Anything else (guards, strings, named constants, Option/Result, or
+// ranges that partly overlap) keeps the if-chain.
+
+#define MATCH_SWITCH_MIN_ARMS 3
+
+typedef struct
+{
+    long long lo;
+    long long hi;
+    int arm;
+} MatchLabel;
+
+typedef struct
+{
+    MatchLabel *labels;
+    int count;
+    int cap;
+    int is_enum;     ///< Switch on the tag rather than the value.
+    int default_arm; ///< Index of the `_` arm, or -1.
+    int arms;        ///< Arms that got at least one label.
+} MatchSwitch;
+
+// Parses an integer or plain char literal pattern.
+static int match_literal_value(const char *s, long long *out)
+{
+    if (s[0] == '\'')
+    {
+        const char *p = s + 1;
+        long long v;
+        if (*p == '\\')
+        {
+            p++;
+            switch (*p)
+            {
+            case 'n':
+                v = '\n';
+                break;
+            case 't':
+                v = '\t';
+                break;
+            case 'r':
+                v = '\r';
+                break;
+            case '0':
+                v = 0;
+                break;
+            case '\\':
+            case '\'':
+            case '"':
+                v = *p;
+                break;
+            default:
+                return 0;
+            }
+            p++;
+        }
+        else if (*p && *p != '\'' && !((unsigned char)*p & 0x80))
+        {
+            v = (unsigned char)*p++;
+        }
+        else
+        {
+            return 0;
+        }
+        if (p[0] != '\'' || p[1])
+        {
+            return 0;
+        }
+        *out = v;
+        return 1;
+    }
+
+    if (!isdigit((unsigned char)s[0]))
+    {
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    long long v = strtoll(s, &end, 0);
+    if (errno || *end)
+    {
+        return 0;
+    }
+    *out = v;
+    return 1;
+}
+
+// Parses one side of an or-pattern into an inclusive range of values.
+// Returns 0 if it is not a literal, and sets *empty for ranges like 8..8.
+static int match_part_range(const char *part, long long *lo, long long *hi, int *empty)
+{
+    *empty = 0;
+    const char *dots = strstr(part, "..");
+    if (!dots)
+    {
+        if (!match_literal_value(part, lo))
+        {
+            return 0;
+        }
+        *hi = *lo;
+        return 1;
+    }
+
+    int inclusive = (dots[2] == '=');
+    char *start = xmalloc(dots - part + 1);
+    strncpy(start, part, dots - part);
+    start[dots - part] = 0;
+    int ok = match_literal_value(start, lo) &&
+             match_literal_value(dots + (inclusive ? 3 : 2), hi);
+    free(start);
+    if (!ok)
+    {
+        return 0;
+    }
+    if (!inclusive)
+    {
+        if (*hi <= *lo)
+        {
+            *empty = 1;
+            return 1;
+        }
+        (*hi)--;
+    }
+    if (*hi < *lo)
+    {
+        *empty = 1;
+    }
+    return 1;
+}
+
+static void match_switch_add(MatchSwitch *sw, long long lo, long long hi, int arm)
+{
+    if (sw->count == sw->cap)
+    {
+        sw->cap = sw->cap ? sw->cap * 2 : 16;
+        sw->labels = xrealloc(sw->labels, sizeof(MatchLabel) * sw->cap);
+    }
+    sw->labels[sw->count].lo = lo;
+    sw->labels[sw->count].hi = hi;
+    sw->labels[sw->count].arm = arm;
+    sw->count++;
+}
+
+// Adds a label unless earlier arms already cover it, as the first arm that
+// matches wins. Returns 0 on a partial overlap, which a switch cannot express.
+static int match_switch_label(MatchSwitch *sw, long long lo, long long hi, int arm)
+{
+    for (int i = 0; i < sw->count; i++)
+    {
+        MatchLabel *l = &sw->labels[i];
+        if (hi < l->lo || lo > l->hi)
+        {
+            continue;
+        }
+        return (lo >= l->lo && hi <= l->hi);
+    }
+    match_switch_add(sw, lo, hi, arm);
+    return 1;
+}
+
+static int match_expr_is_integral(ParserContext *ctx, ASTNode *expr)
+{
+    if (expr->type_info)
+    {
+        return expr->type_info->kind != TYPE_ENUM && is_int_type(expr->type_info->kind);
+    }
+    char *t = infer_type(ctx, expr);
+    if (!t)
+    {
+        return 0;
+    }
+    static const char *int_types[] = {"int",      "char",     "int8_t",  "uint8_t",  "int16_t",
+                                      "uint16_t", "int32_t",  "uint32_t", "int64_t", "uint64_t",
+                                      "size_t",   "ptrdiff_t", "unsigned int", "long", NULL};
+    for (int i = 0; int_types[i]; i++)
+    {
+        if (strcmp(t, int_types[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Works out the switch labels for a match. Returns 0 when it has to stay an
+// if-chain.
+static int match_switch_plan(ParserContext *ctx, ASTNode *node, MatchSwitch *sw)
+{
+    memset(sw, 0, sizeof(*sw));
+    sw->is_enum = -1;
+    sw->default_arm = -1;
+
+    const char *enum_name = NULL;
+    int arm = 0;
+    int ok = 1;
+    for (ASTNode *c = node->match_stmt.cases; c && ok; c = c->next, arm++)
+    {
+        if (c->match_case.guard)
+        {
+            ok = 0;
+            break;
+        }
+        if (strcmp(c->match_case.pattern, "_") == 0)
+        {
+            sw->default_arm = arm;
+            break;
+        }
+
+        int before = sw->count;
+        char *pattern_copy = xstrdup(c->match_case.pattern);
+        char *saveptr;
+        char *part = strtok_r(pattern_copy, "|", &saveptr);
+        while (part && ok)
+        {
+            EnumVariantReg *reg = find_enum_variant(ctx, part);
+            if (reg)
+            {
+                if (sw->is_enum == 0 || (enum_name && strcmp(enum_name, reg->enum_name) != 0))
+                {
+                    ok = 0;
+                    break;
+                }
+                sw->is_enum = 1;
+                enum_name = reg->enum_name;
+                ok = match_switch_label(sw, reg->tag_id, reg->tag_id, arm);
+            }
+            else
+            {
+                long long lo, hi;
+                int empty;
+                if (sw->is_enum == 1 || !match_part_range(part, &lo, &hi, &empty))
+                {
+                    ok = 0;
+                    break;
+                }
+                sw->is_enum = 0;
+                if (!empty)
+                {
+                    ok = match_switch_label(sw, lo, hi, arm);
+                }
+            }
+            part = strtok_r(NULL, "|", &saveptr);
+        }
+        free(pattern_copy);
+        if (sw->count > before)
+        {
+            sw->arms++;
+        }
+    }
+
+    if (ok && sw->is_enum == 0 && !match_expr_is_integral(ctx, node->match_stmt.expr))
+    {
+        ok = 0;
+    }
+    if (!ok || sw->arms < MATCH_SWITCH_MIN_ARMS)
+    {
+        free(sw->labels);
+        sw->labels = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+// Emits an arm's bindings and body as a block.
+static void emit_match_arm(ParserContext *ctx, ASTNode *c, int id, int is_expr, int is_option,
+                           int is_result, int has_ref_binding, FILE *out)
+{
+    fprintf(out, "{ ");
+    if (c->match_case.binding_count > 0)
+    {
+        for (int i = 0; i < c->match_case.binding_count; i++)
+        {
+            char *bname = c->match_case.binding_names[i];
+            int is_r = c->match_case.binding_refs ? c->match_case.binding_refs[i] : 0;
+
+            if (is_option)
+            {
+                if (is_r)
+                {
+                    fprintf(out, "ZC_AUTO_INIT(%s, &_m_%d->val); ", bname, id);
+                }
+                else if (has_ref_binding)
+                {
+                    fprintf(out, "ZC_AUTO_INIT(%s, _m_%d->val); ", bname, id);
+                }
+                else
+                {
+                    fprintf(out, "ZC_AUTO_INIT(%s, _m_%d.val); ", bname, id);
+                }
+            }
+            else if (is_result)
+            {
+                char *field = "val";
+                if (strcmp(c->match_case.pattern, "Err") == 0)
+                {
+                    field = "err";
+                }
+
+                if (is_r)
+                {
+                    fprintf(out, "ZC_AUTO_INIT(%s, &_m_%d->%s); ", bname, id, field);
+                }
+                else if (has_ref_binding)
+                {
+                    fprintf(out, "ZC_AUTO_INIT(%s, _m_%d->%s); ", bname, id, field);
+                }
+                else
+                {
+                    fprintf(out, "ZC_AUTO_INIT(%s, _m_%d.%s); ", bname, id, field);
+                }
+            }
+            else
+            {
+                char *v = strrchr(c->match_case.pattern, '_');
+                if (v)
+                {
+                    v++;
+                }
+                else
+                {
+                    v = c->match_case.pattern;
+                }
+
+                if (c->match_case.binding_count > 1)
+                {
+                    // Tuple destructuring: data.Variant.vI
+                    if (is_r)
+                    {
+                        fprintf(out, "ZC_AUTO_INIT(%s, &_m_%d->data.%s.v%d); ", bname, id, v, i);
+                    }
+                    else if (has_ref_binding)
+                    {
+                        fprintf(out, "ZC_AUTO_INIT(%s, _m_%d->data.%s.v%d); ", bname, id, v, i);
+                    }
+                    else
+                    {
+                        fprintf(out, "ZC_AUTO_INIT(%s, _m_%d.data.%s.v%d); ", bname, id, v, i);
+                    }
+                }
+                else
+                {
+                    // Single destructuring: data.Variant
+                    if (is_r)
+                    {
+                        fprintf(out, "ZC_AUTO_INIT(%s, &_m_%d->data.%s); ", bname, id, v);
+                    }
+                    else if (has_ref_binding)
+                    {
+                        fprintf(out, "ZC_AUTO_INIT(%s, _m_%d->data.%s); ", bname, id, v);
+                    }
+                    else
+                    {
+                        fprintf(out, "ZC_AUTO_INIT(%s, _m_%d.data.%s); ", bname, id, v);
+                    }
+                }
+            }
+        }
+    }
+
+    // Check if body is a string literal (should auto-print).
+    ASTNode *body = c->match_case.body;
+    int is_string_literal =
+        (body->type == NODE_EXPR_LITERAL && body->literal.type_kind == LITERAL_STRING);
+
+    if (is_expr)
+    {
+        fprintf(out, "_r_%d = ", id);
+        if (is_string_literal)
+        {
+            codegen_node_single(ctx, body, out);
+        }
+        else
+        {
+            if (body->type == NODE_BLOCK)
+            {
+                int saved = defer_count;
+                fprintf(out, "({ ");
+                ASTNode *stmt = body->block.statements;
+                while (stmt)
+                {
+                    codegen_node_single(ctx, stmt, out);
+                    stmt = stmt->next;
+                }
+                for (int i = defer_count - 1; i >= saved; i--)
+                {
+                    codegen_node_single(ctx, defer_stack[i], out);
+                }
+                defer_count = saved;
+                fprintf(out, " })");
+            }
+            else
+            {
+                codegen_node_single(ctx, body, out);
+            }
+        }
+        fprintf(out, ";");
+    }
+    else
+    {
+        if (is_string_literal)
+        {
+            char *inner = body->literal.string_val;
+            char *code = process_printf_sugar(ctx, inner, 1, "stdout", NULL, NULL, 0);
+            fprintf(out, "%s;", code);
+            free(code);
+        }
+        else
+        {
+            codegen_node_single(ctx, body, out);
+        }
+    }
+
+    fprintf(out, " }");
+}
+
+// Emits the switch planned by match_switch_plan() and the arms it jumps to.
+static void emit_match_switch(ParserContext *ctx, ASTNode *node, MatchSwitch *sw, int id,
+                              int is_expr, int has_ref_binding, FILE *out)
+{
+    if (sw->is_enum)
+    {
+        fprintf(out, "switch (_m_%d%stag) { ", id, has_ref_binding ? "->" : ".");
+    }
+    else
+    {
+        fprintf(out, "switch (%s_m_%d) { ", has_ref_binding ? "*" : "", id);
+    }
+
+    // Labels were collected arm by arm, so each arm's labels are contiguous.
+    for (int i = 0; i < sw->count; i++)
+    {
+        MatchLabel *l = &sw->labels[i];
+        if (l->lo == l->hi)
+        {
+            fprintf(out, "case %lld: ", l->lo);
+        }
+        else
+        {
+            fprintf(out, "case %lld ... %lld: ", l->lo, l->hi);
+        }
+        if (i + 1 == sw->count || sw->labels[i + 1].arm != l->arm)
+        {
+            fprintf(out, "goto _mc_%d_%d; ", id, l->arm);
+        }
+    }
+    if (sw->default_arm >= 0)
+    {
+        fprintf(out, "default: goto _mc_%d_%d; } ", id, sw->default_arm);
+    }
+    else
+    {
+        fprintf(out, "default: goto _me_%d; } ", id);
+    }
+
+    int arm = 0;
+    int next_label = 0;
+    for (ASTNode *c = node->match_stmt.cases; c; c = c->next, arm++)
+    {
+        int has_label = (next_label < sw->count && sw->labels[next_label].arm == arm);
+        while (next_label < sw->count && sw->labels[next_label].arm == arm)
+        {
+            next_label++;
+        }
+        if (!has_label && arm != sw->default_arm)
+        {
+            continue; // Unreachable: every value it names is taken by an earlier arm.
+        }
+        fprintf(out, "_mc_%d_%d: ", id, arm);
+        emit_match_arm(ctx, c, id, is_expr, 0, 0, has_ref_binding, out);
+        fprintf(out, " goto _me_%d; ", id);
+        if (arm == sw->default_arm)
+        {
+            break;
+        }
+    }
+    fprintf(out, "_me_%d:;", id);
+}
+
 void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out, int use_result)
 {
     int id = tmp_counter++;
@@ -277,252 +886,69 @@ void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out, int us
     int is_option = (expr_type && strncmp(expr_type, "Option_", 7) == 0);
     int is_result = (expr_type && strncmp(expr_type, "Result_", 7) == 0);
 
-    char *enum_name = NULL;
-    ASTNode *chk = node->match_stmt.cases;
-    int has_wildcard = 0;
-    while (chk)
-    {
-        if (strcmp(chk->match_case.pattern, "_") == 0)
-        {
-            has_wildcard = 1;
-        }
-        else if (!enum_name)
-        {
-            EnumVariantReg *reg = find_enum_variant(ctx, chk->match_case.pattern);
-            if (reg)
-            {
-                enum_name = reg->enum_name;
-            }
-        }
-        chk = chk->next;
-    }
+    check_match_exhaustive(ctx, node);
 
-    if (enum_name && !has_wildcard)
+    MatchSwitch sw;
+    if (!is_option && !is_result && match_switch_plan(ctx, node, &sw))
     {
-        // Iterate through all registered variants for this enum
-        EnumVariantReg *v = ctx->enum_variants;
-        while (v)
-        {
-            if (strcmp(v->enum_name, enum_name) == 0)
-            {
-                int covered = 0;
-                ASTNode *c2 = node->match_stmt.cases;
-                while (c2)
-                {
-                    if (strcmp(c2->match_case.pattern, v->variant_name) == 0)
-                    {
-                        covered = 1;
-                        break;
-                    }
-                    c2 = c2->next;
-                }
-                if (!covered)
-                {
-                    zwarn_at(node->token, "Non-exhaustive match: Missing variant '%s'",
-                             v->variant_name);
-                }
-            }
-            v = v->next;
-        }
+        emit_match_switch(ctx, node, &sw, id, is_expr, has_ref_binding, out);
+        free(sw.labels);
     }
-
-    ASTNode *c = node->match_stmt.cases;
-    int first = 1;
-    while (c)
+    else
     {
-        if (!first)
-        {
-            fprintf(out, " else ");
-        }
-        fprintf(out, "if (");
-        if (strcmp(c->match_case.pattern, "_") == 0)
-        {
-            fprintf(out, "1");
-        }
-        else if (is_option)
-        {
-            if (strcmp(c->match_case.pattern, "Some") == 0)
-            {
-                fprintf(out, "_m_%d->is_some", id);
-            }
-            else if (strcmp(c->match_case.pattern, "None") == 0)
-            {
-                fprintf(out, "!_m_%d->is_some", id);
-            }
-            else
-            {
-                fprintf(out, "1");
-            }
-        }
-        else if (is_result)
+        ASTNode *c = node->match_stmt.cases;
+        int first = 1;
+        while (c)
         {
-            if (strcmp(c->match_case.pattern, "Ok") == 0)
-            {
-                fprintf(out, "_m_%d->is_ok", id);
-            }
-            else if (strcmp(c->match_case.pattern, "Err") == 0)
+            if (!first)
             {
-                fprintf(out, "!_m_%d->is_ok", id);
+                fprintf(out, " else ");
             }
-            else
+            fprintf(out, "if (");
+            if (strcmp(c->match_case.pattern, "_") == 0)
             {
                 fprintf(out, "1");
             }
-        }
-        else
-        {
-            // Use helper for OR patterns, range patterns, and simple patterns
-            emit_pattern_condition(ctx, c->match_case.pattern, id, has_ref_binding, out);
-        }
-        fprintf(out, ") { ");
-        if (c->match_case.binding_count > 0)
-        {
-            for (int i = 0; i < c->match_case.binding_count; i++)
+            else if (is_option)
             {
-                char *bname = c->match_case.binding_names[i];
-                int is_r = c->match_case.binding_refs ? c->match_case.binding_refs[i] : 0;
-
-                if (is_option)
+                if (strcmp(c->match_case.pattern, "Some") == 0)
                 {
-                    if (is_r)
-                    {
-                        fprintf(out, "ZC_AUTO_INIT(%s, &_m_%d->val); ", bname, id);
-                    }
-                    else if (has_ref_binding)
-                    {
-                        fprintf(out, "ZC_AUTO_INIT(%s, _m_%d->val); ", bname, id);
-                    }
-                    else
-                    {
-                        fprintf(out, "ZC_AUTO_INIT(%s, _m_%d.val); ", bname, id);
-                    }
+                    fprintf(out, "_m_%d->is_some", id);
                 }
-                else if (is_result)
+                else if (strcmp(c->match_case.pattern, "None") == 0)
                 {
-                    char *field = "val";
-                    if (strcmp(c->match_case.pattern, "Err") == 0)
-                    {
-                        field = "err";
-                    }
-
-                    if (is_r)
-                    {
-                        fprintf(out, "ZC_AUTO_INIT(%s, &_m_%d->%s); ", bname, id, field);
-                    }
-                    else if (has_ref_binding)
-                    {
-                        fprintf(out, "ZC_AUTO_INIT(%s, _m_%d->%s); ", bname, id, field);
-                    }
-                    else
-                    {
-                        fprintf(out, "ZC_AUTO_INIT(%s, _m_%d.%s); ", bname, id, field);
-                    }
+                    fprintf(out, "!_m_%d->is_some", id);
                 }
                 else
                 {
-                    char *v = strrchr(c->match_case.pattern, '_');
-                    if (v)
-                    {
-                        v++;
-                    }
-                    else
-                    {
-                        v = c->match_case.pattern;
-                    }
-
-                    if (c->match_case.binding_count > 1)
-                    {
-                        // Tuple destructuring: data.Variant.vI
-                        if (is_r)
-                        {
-                            fprintf(out, "ZC_AUTO_INIT(%s, &_m_%d->data.%s.v%d); ", bname, id, v,
-                                    i);
-                        }
-                        else if (has_ref_binding)
-                        {
-                            fprintf(out, "ZC_AUTO_INIT(%s, _m_%d->data.%s.v%d); ", bname, id, v, i);
-                        }
-                        else
-                        {
-                            fprintf(out, "ZC_AUTO_INIT(%s, _m_%d.data.%s.v%d); ", bname, id, v, i);
-                        }
-                    }
-                    else
-                    {
-                        // Single destructuring: data.Variant
-                        if (is_r)
-                        {
-                            fprintf(out, "ZC_AUTO_INIT(%s, &_m_%d->data.%s); ", bname, id, v);
-                        }
-                        else if (has_ref_binding)
-                        {
-                            fprintf(out, "ZC_AUTO_INIT(%s, _m_%d->data.%s); ", bname, id, v);
-                        }
-                        else
-                        {
-                            fprintf(out, "ZC_AUTO_INIT(%s, _m_%d.data.%s); ", bname, id, v);
-                        }
-                    }
+                    fprintf(out, "1");
                 }
             }
-        }
-
-        // Check if body is a string literal (should auto-print).
-        ASTNode *body = c->match_case.body;
-        int is_string_literal =
-            (body->type == NODE_EXPR_LITERAL && body->literal.type_kind == LITERAL_STRING);
-
-        if (is_expr)
-        {
-            fprintf(out, "_r_%d = ", id);
-            if (is_string_literal)
+            else if (is_result)
             {
-                codegen_node_single(ctx, body, out);
-            }
-            else
-            {
-                if (body->type == NODE_BLOCK)
+                if (strcmp(c->match_case.pattern, "Ok") == 0)
                 {
-                    int saved = defer_count;
-                    fprintf(out, "({ ");
-                    ASTNode *stmt = body->block.statements;
-                    while (stmt)
-                    {
-                        codegen_node_single(ctx, stmt, out);
-                        stmt = stmt->next;
-                    }
-                    for (int i = defer_count - 1; i >= saved; i--)
-                    {
-                        codegen_node_single(ctx, defer_stack[i], out);
-                    }
-                    defer_count = saved;
-                    fprintf(out, " })");
+                    fprintf(out, "_m_%d->is_ok", id);
+                }
+                else if (strcmp(c->match_case.pattern, "Err") == 0)
+                {
+                    fprintf(out, "!_m_%d->is_ok", id);
                 }
                 else
                 {
-                    codegen_node_single(ctx, body, out);
+                    fprintf(out, "1");
                 }
             }
-            fprintf(out, ";");
-        }
-        else
-        {
-            if (is_string_literal)
-            {
-                char *inner = body->literal.string_val;
-                char *code = process_printf_sugar(ctx, inner, 1, "stdout", NULL, NULL, 0);
-                fprintf(out, "%s;", code);
-                free(code);
-            }
             else
             {
-                codegen_node_single(ctx, body, out);
+                // Use helper for OR patterns, range patterns, and simple patterns
+                emit_pattern_condition(ctx, c->match_case.pattern, id, has_ref_binding, out);
             }
+            fprintf(out, ") ");
+            emit_match_arm(ctx, c, id, is_expr, is_option, is_result, has_ref_binding, out);
+            first = 0;
+            c = c->next;
         }
-
-        fprintf(out, " }");
-        first = 0;
-        c = c->next;
     }
 
     if (is_expr)
@@ -534,12 +960,26 @@ void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out, int us
         fprintf(out, " }");
     }
 }
+// Functions that are used without being named in the generated C: the entry
+// point, and anything the linker or loader keeps on its own.
+static int is_dce_root(ASTNode *fn)
+{
+    return strcmp(fn->func.name, "main") == 0 || fn->func.constructor || fn->func.destructor ||
+           fn->func.weak || fn->func.is_export || fn->func.section || fn->func.attributes;
+}
+
 void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
 {
     if (!node)
     {
         return;
     }
+    long dce_start = -1;
+    if (node->type == NODE_FUNCTION && node->func.body && !node->func.generic_params &&
+        !is_dce_root(node))
+    {
+        dce_start = dce_unit_start(out);
+    }
     switch (node->type)
     {
     case NODE_AST_COMMENT:
@@ -967,9 +1407,13 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
     }
     case NODE_VAR_DECL:
     {
-        // Save pending closure free count — if the init expr creates a closure,
-        // the variable takes ownership and we should NOT free the context.
-        int saved_closure_frees = pending_closure_free_count;
+        // A closure bound to a local that is only ever called keeps its
+        // context in the enclosing block.
+        if (node->var_decl.init_expr && node->var_decl.init_expr->type == NODE_LAMBDA &&
+            escape_local_is_local(node->var_decl.name, node->next))
+        {
+            g_stack_lambda = node->var_decl.init_expr;
+        }
 
         if (strcmp(node->var_decl.name, "_") == 0 && node->var_decl.init_expr)
         {
@@ -1160,6 +1604,13 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
                     {
                         add_symbol(ctx, node->var_decl.name, inferred, NULL);
                     }
+                    else if (tname)
+                    {
+                        // Declared `void*` (e.g. `let p: void* = NULL`): nothing to infer
+                        // from the initializer, but the name must still shadow any
+                        // earlier symbol of the same name.
+                        add_symbol(ctx, node->var_decl.name, tname, node->type_info);
+                    }
 
                     fprintf(out, " = ");
                     codegen_expression(ctx, node->var_decl.init_expr, out);
@@ -1173,8 +1624,6 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
             }
         }
 
-        // Suppress pending frees - variable owns the closure context
-        pending_closure_free_count = saved_closure_frees;
         break;
     }
     case NODE_CONST:
@@ -1369,6 +1818,7 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
         // Track loop entry for defer boundary
         loop_defer_boundary[loop_depth++] = defer_count;
 
+        bounds_loop_begin(ctx, node, out);
         fprintf(out, "for (");
         if (strstr(g_config.cc, "tcc"))
         {
@@ -1414,6 +1864,7 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
             fprintf(out, "++) ");
         }
         codegen_node_single(ctx, node->for_range.body, out);
+        bounds_loop_end(node, out);
 
         loop_depth--;
         break;
@@ -1607,8 +2058,6 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
     }
     case NODE_RETURN:
     {
-        // Suppress pending closure frees — returned closures escape the scope
-        pending_closure_free_count = 0;
         int has_defers = (defer_count > func_defer_boundary);
         int handled = 0;
 
@@ -1937,32 +2386,12 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
     default:
         codegen_expression(ctx, node, out);
         fprintf(out, ";\n");
-        // Suppress closure context free for Thread::spawn calls —
-        // the thread trampoline takes ownership of the closure context.
-        if (node->type == NODE_EXPR_CALL && node->call.callee && pending_closure_free_count > 0)
-        {
-            int is_thread_spawn = 0;
-            if (node->call.callee->type == NODE_EXPR_VAR && node->call.callee->var_ref.name &&
-                strstr(node->call.callee->var_ref.name, "Thread::spawn"))
-            {
-                is_thread_spawn = 1;
-            }
-            else if (node->call.callee->type == NODE_EXPR_MEMBER &&
-                     node->call.callee->member.target &&
-                     node->call.callee->member.target->type == NODE_EXPR_VAR &&
-                     strcmp(node->call.callee->member.target->var_ref.name, "Thread") == 0 &&
-                     strcmp(node->call.callee->member.field, "spawn") == 0)
-            {
-                is_thread_spawn = 1;
-            }
-            if (is_thread_spawn)
-            {
-                pending_closure_free_count = 0;
-            }
-        }
-        emit_pending_closure_frees(out);
         break;
     }
+    if (dce_start >= 0)
+    {
+        dce_unit_end(out, DCE_DEF, node->func.name, dce_start);
+    }
 }
 
 // Walks AST nodes and generates code.
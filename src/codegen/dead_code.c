@@ -0,0 +1,330 @@
+#include "dead_code.h"
+#include "../zprep.h"
+#include <string.h>
+
+typedef struct
+{
+    DceKind kind;
+    long start;
+    long end;
+    int name;     // Index into dce_names.
+    int next_def; // Next DCE_DEF/DCE_VTABLE unit of the same name, or -1.
+} DceUnit;
+
+typedef struct
+{
+    char *text;
+    size_t len;
+    int first_def; // First DCE_DEF/DCE_VTABLE unit of this name, or -1.
+    int live;
+} DceName;
+
+static FILE *dce_out = NULL;
+static DceUnit *dce_units = NULL;
+static int dce_unit_count = 0;
+static int dce_unit_cap = 0;
+static DceName *dce_names = NULL;
+static int dce_name_count = 0;
+static int dce_name_cap = 0;
+static int *dce_buckets = NULL; // Open addressing over dce_names; -1 is empty.
+static size_t dce_bucket_cap = 0;
+
+static size_t dce_hash(const char *s, size_t len)
+{
+    size_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void dce_rehash(void)
+{
+    size_t cap = dce_bucket_cap ? dce_bucket_cap * 2 : 256;
+    int *buckets = xmalloc(cap * sizeof(int));
+    for (size_t i = 0; i < cap; i++)
+    {
+        buckets[i] = -1;
+    }
+    for (int n = 0; n < dce_name_count; n++)
+    {
+        size_t b = dce_hash(dce_names[n].text, dce_names[n].len) & (cap - 1);
+        while (buckets[b] >= 0)
+        {
+            b = (b + 1) & (cap - 1);
+        }
+        buckets[b] = n;
+    }
+    free(dce_buckets);
+    dce_buckets = buckets;
+    dce_bucket_cap = cap;
+}
+
+// Returns the index of the name, adding it if `create` is set; -1 otherwise.
+static int dce_find(const char *s, size_t len, int create)
+{
+    if (create && (size_t)(dce_name_count + 1) * 2 > dce_bucket_cap)
+    {
+        dce_rehash();
+    }
+    if (!dce_bucket_cap)
+    {
+        return -1;
+    }
+    size_t b = dce_hash(s, len) & (dce_bucket_cap - 1);
+    while (dce_buckets[b] >= 0)
+    {
+        DceName *n = &dce_names[dce_buckets[b]];
+        if (n->len == len && memcmp(n->text, s, len) == 0)
+        {
+            return dce_buckets[b];
+        }
+        b = (b + 1) & (dce_bucket_cap - 1);
+    }
+    if (!create)
+    {
+        return -1;
+    }
+    if (dce_name_count == dce_name_cap)
+    {
+        dce_name_cap = dce_name_cap ? dce_name_cap * 2 : 256;
+        dce_names = xrealloc(dce_names, dce_name_cap * sizeof(DceName));
+    }
+    DceName *n = &dce_names[dce_name_count];
+    n->text = xmalloc(len + 1);
+    memcpy(n->text, s, len);
+    n->text[len] = 0;
+    n->len = len;
+    n->first_def = -1;
+    n->live = 0;
+    dce_buckets[b] = dce_name_count;
+    return dce_name_count++;
+}
+
+// Frees the tables of the previous recording.
+static void dce_reset(void)
+{
+    for (int i = 0; i < dce_name_count; i++)
+    {
+        free(dce_names[i].text);
+    }
+    free(dce_names);
+    free(dce_units);
+    free(dce_buckets);
+    dce_names = NULL;
+    dce_name_count = 0;
+    dce_name_cap = 0;
+    dce_units = NULL;
+    dce_unit_count = 0;
+    dce_unit_cap = 0;
+    dce_buckets = NULL;
+    dce_bucket_cap = 0;
+}
+
+void dce_begin(FILE *out)
+{
+    dce_reset();
+    dce_out = out;
+}
+
+long dce_unit_start(FILE *out)
+{
+    if (!out || out != dce_out)
+    {
+        return -1;
+    }
+    return ftell(out);
+}
+
+void dce_unit_end(FILE *out, DceKind kind, const char *name, long start)
+{
+    if (start < 0 || !out || out != dce_out || !name)
+    {
+        return;
+    }
+    if (dce_unit_count == dce_unit_cap)
+    {
+        dce_unit_cap = dce_unit_cap ? dce_unit_cap * 2 : 256;
+        dce_units = xrealloc(dce_units, dce_unit_cap * sizeof(DceUnit));
+    }
+    DceUnit *u = &dce_units[dce_unit_count];
+    u->kind = kind;
+    u->start = start;
+    u->end = ftell(out);
+    u->name = dce_find(name, strlen(name), 1);
+    u->next_def = -1;
+    if (kind != DCE_PROTO)
+    {
+        u->next_def = dce_names[u->name].first_def;
+        dce_names[u->name].first_def = dce_unit_count;
+    }
+    dce_unit_count++;
+}
+
+typedef struct
+{
+    int *items;
+    int count;
+    int cap;
+} DceWork;
+
+static void dce_mark(DceWork *w, int name)
+{
+    DceName *n = &dce_names[name];
+    if (n->live || n->first_def < 0)
+    {
+        return;
+    }
+    n->live = 1;
+    if (w->count == w->cap)
+    {
+        w->cap = w->cap ? w->cap * 2 : 256;
+        w->items = xrealloc(w->items, w->cap * sizeof(int));
+    }
+    w->items[w->count++] = name;
+}
+
+// Marks every recorded name that appears as an identifier in src[a, b).
+static void dce_scan(DceWork *w, const char *src, long a, long b)
+{
+    long i = a;
+    while (i < b)
+    {
+        char c = src[i];
+        int is_start = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        int is_word = is_start || (c >= '0' && c <= '9');
+        if (!is_word)
+        {
+            i++;
+            continue;
+        }
+        long s = i;
+        while (i < b && ((src[i] >= 'a' && src[i] <= 'z') || (src[i] >= 'A' && src[i] <= 'Z') ||
+                         (src[i] >= '0' && src[i] <= '9') || src[i] == '_'))
+        {
+            i++;
+        }
+        if (is_start)
+        {
+            int name = dce_find(src + s, (size_t)(i - s), 0);
+            if (name >= 0)
+            {
+                dce_mark(w, name);
+            }
+        }
+    }
+}
+
+static int dce_is_kept(const DceUnit *u)
+{
+    const DceName *n = &dce_names[u->name];
+    return n->live || (u->kind == DCE_PROTO && n->first_def < 0);
+}
+
+// Marks the live names of `src` and rewrites `path` without the rest.
+static int dce_prune_source(const char *path, const char *src, long len, DceWork *w)
+{
+    // Units are recorded in output order and never nest; anything else
+    // means the positions cannot be trusted, so the file is left alone.
+    long pos = 0;
+    for (int i = 0; i < dce_unit_count; i++)
+    {
+        if (dce_units[i].start < pos || dce_units[i].end < dce_units[i].start ||
+            dce_units[i].end > len)
+        {
+            return 0;
+        }
+        pos = dce_units[i].end;
+    }
+
+    pos = 0;
+    for (int i = 0; i < dce_unit_count; i++)
+    {
+        dce_scan(w, src, pos, dce_units[i].start);
+        pos = dce_units[i].end;
+    }
+    dce_scan(w, src, pos, len);
+
+    while (w->count > 0)
+    {
+        int name = w->items[--w->count];
+        for (int u = dce_names[name].first_def; u >= 0; u = dce_units[u].next_def)
+        {
+            dce_scan(w, src, dce_units[u].start, dce_units[u].end);
+        }
+    }
+
+    int removed = 0;
+    for (int i = 0; i < dce_unit_count; i++)
+    {
+        if (dce_units[i].kind != DCE_PROTO && !dce_is_kept(&dce_units[i]))
+        {
+            removed++;
+        }
+    }
+    if (removed == 0)
+    {
+        return 0;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        return -1;
+    }
+    pos = 0;
+    for (int i = 0; i < dce_unit_count; i++)
+    {
+        DceUnit *u = &dce_units[i];
+        fwrite(src + pos, 1, u->start - pos, f);
+        if (dce_is_kept(u))
+        {
+            fwrite(src + u->start, 1, u->end - u->start, f);
+        }
+        pos = u->end;
+    }
+    fwrite(src + pos, 1, len - pos, f);
+    if (fclose(f) != 0)
+    {
+        return -1;
+    }
+    return removed;
+}
+
+int dce_prune_file(const char *path)
+{
+    dce_out = NULL;
+    if (dce_unit_count == 0)
+    {
+        dce_reset();
+        return 0;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        dce_reset();
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *src = len < 0 ? NULL : xmalloc(len + 1);
+    if (!src || fread(src, 1, len, f) != (size_t)len)
+    {
+        fclose(f);
+        free(src);
+        dce_reset();
+        return -1;
+    }
+    fclose(f);
+    src[len] = 0;
+
+    DceWork w = {NULL, 0, 0};
+    int removed = dce_prune_source(path, src, len, &w);
+    free(w.items);
+    free(src);
+    dce_reset();
+    return removed;
+}
@@ -0,0 +1,54 @@
+#ifndef DEAD_CODE_H
+#define DEAD_CODE_H
+
+#include <stdio.h>
+
+// Removal of unused functions from the generated C.
+//
+// Every parsed function, generic instantiation, impl method and trait
+// vtable is emitted, so a single import can pull thousands of unused lines
+// into the backend compile. While the output is written, the position of
+// each of those definitions (and of its prototype) is recorded; afterwards
+// everything outside them - main, tests, globals, lambdas, drop glue, raw C
+// - is scanned for identifiers, and a definition is kept only if it is named
+// there or in another definition that is kept. Codegen adds many calls of
+// its own (drop glue, iterators, operator methods), which is why liveness is
+// taken from the emitted C rather than from the AST.
+
+typedef enum
+{
+    DCE_DEF,    ///< A function definition, named by its C symbol.
+    DCE_VTABLE, ///< A trait vtable instance (`Struct_Trait_VTable`).
+    DCE_PROTO   ///< A prototype; kept unless its definition is dropped.
+} DceKind;
+
+/**
+ * @brief Starts recording definitions written to @p out.
+ *
+ * Output written to any other stream is never recorded.
+ */
+void dce_begin(FILE *out);
+
+/**
+ * @brief Returns the current position of @p out, or -1 if it is not recorded.
+ */
+long dce_unit_start(FILE *out);
+
+/**
+ * @brief Records that @p out, from @p start to its current position, holds
+ *        the unit @p name of the given kind.
+ */
+void dce_unit_end(FILE *out, DceKind kind, const char *name, long start);
+
+/**
+ * @brief Rewrites @p path without the definitions that are never used.
+ *
+ * Stops recording and frees what was recorded. Only call it for a whole
+ * program: functions of a library, or of a file linked with other C
+ * sources, may be used from outside.
+ *
+ * @return The number of definitions removed, or -1 on I/O errors.
+ */
+int dce_prune_file(const char *path);
+
+#endif
@@ -51,6 +51,122 @@ static void get_params(cJSON *root, char **uri, int *line, int *col)
     }
 }
 
+int g_lsp_debounce_ms = 150;
+
+// Workspace indexing progress goes under a token the server creates with
+// window/workDoneProgress/create; the request uses the token as its id.
+#define INDEX_PROGRESS_TOKEN "zls/indexing"
+
+typedef enum
+{
+    PROGRESS_OFF,       ///< Not supported by the client, or over.
+    PROGRESS_REQUESTED, ///< Waiting for the client to accept the token.
+    PROGRESS_READY,     ///< Accepted; nothing reported yet.
+    PROGRESS_BEGUN      ///< "begin" sent.
+} ProgressState;
+
+static ProgressState index_progress = PROGRESS_OFF;
+
+static void send_json(cJSON *msg)
+{
+    char *str = cJSON_PrintUnformatted(msg);
+    fprintf(stdout, "Content-Length: %zu\r\n\r\n%s", strlen(str), str);
+    fflush(stdout);
+    free(str);
+    cJSON_Delete(msg);
+}
+
+static void send_progress(cJSON *value)
+{
+    cJSON *msg = cJSON_CreateObject();
+    cJSON_AddStringToObject(msg, "jsonrpc", "2.0");
+    cJSON_AddStringToObject(msg, "method", "$/progress");
+    cJSON *params = cJSON_AddObjectToObject(msg, "params");
+    cJSON_AddStringToObject(params, "token", INDEX_PROGRESS_TOKEN);
+    cJSON_AddItemToObject(params, "value", value);
+    send_json(msg);
+}
+
+void lsp_report_index_progress(int done, int total, int finished)
+{
+    if (index_progress != PROGRESS_READY && index_progress != PROGRESS_BEGUN)
+    {
+        return;
+    }
+
+    if (index_progress == PROGRESS_READY)
+    {
+        cJSON *begin = cJSON_CreateObject();
+        cJSON_AddStringToObject(begin, "kind", "begin");
+        cJSON_AddStringToObject(begin, "title", "Indexing");
+        cJSON_AddNumberToObject(begin, "percentage", 0);
+        send_progress(begin);
+        index_progress = PROGRESS_BEGUN;
+    }
+
+    char message[64];
+    snprintf(message, sizeof(message), "%d/%d files", done, total);
+    cJSON *value = cJSON_CreateObject();
+    if (finished)
+    {
+        cJSON_AddStringToObject(value, "kind", "end");
+        cJSON_AddStringToObject(value, "message", message);
+        index_progress = PROGRESS_OFF;
+    }
+    else
+    {
+        cJSON_AddStringToObject(value, "kind", "report");
+        cJSON_AddStringToObject(value, "message", message);
+        cJSON_AddNumberToObject(value, "percentage", total > 0 ? done * 100 / total : 0);
+    }
+    send_progress(value);
+}
+
+// Applies didChange edits to the document's buffer. It is parsed and checked
+// once edits stop for g_lsp_debounce_ms, or before a request needs it.
+static void apply_changes(const char *uri, cJSON *changes)
+{
+    cJSON *change = NULL;
+    cJSON_ArrayForEach(change, changes)
+    {
+        cJSON *text = cJSON_GetObjectItem(change, "text");
+        if (!text || !text->valuestring)
+        {
+            continue;
+        }
+        LSPDocument *doc = lsp_project_document(uri);
+        cJSON *range = cJSON_GetObjectItem(change, "range");
+        if (!range)
+        {
+            if (doc)
+            {
+                lsp_doc_set(doc, text->valuestring);
+            }
+            else
+            {
+                lsp_project_open_file(uri, text->valuestring);
+            }
+            continue;
+        }
+        if (!doc)
+        {
+            continue;
+        }
+        cJSON *start = cJSON_GetObjectItem(range, "start");
+        cJSON *end = cJSON_GetObjectItem(range, "end");
+        cJSON *sl = cJSON_GetObjectItem(start, "line");
+        cJSON *sc = cJSON_GetObjectItem(start, "character");
+        cJSON *el = cJSON_GetObjectItem(end, "line");
+        cJSON *ec = cJSON_GetObjectItem(end, "character");
+        if (sl && sc && el && ec)
+        {
+            lsp_doc_replace(doc, sl->valueint, sc->valueint, el->valueint, ec->valueint,
+                            text->valuestring);
+        }
+    }
+    lsp_project_schedule_check(uri, g_lsp_debounce_ms);
+}
+
 void handle_request(const char *json_str)
 {
     cJSON *json = cJSON_Parse(json_str);
@@ -69,11 +185,30 @@ void handle_request(const char *json_str)
     cJSON *method_item = cJSON_GetObjectItem(json, "method");
     if (!method_item || !method_item->valuestring)
     {
+        // A response: the only request the server sends is for the token.
+        if (index_progress == PROGRESS_REQUESTED && cJSON_IsString(id_item) &&
+            strcmp(id_item->valuestring, INDEX_PROGRESS_TOKEN) == 0)
+        {
+            index_progress = cJSON_GetObjectItem(json, "error") ? PROGRESS_OFF : PROGRESS_READY;
+        }
         cJSON_Delete(json);
         return;
     }
     char *method = method_item->valuestring;
 
+    // Requests about a document answer from its latest text.
+    if (strncmp(method, "textDocument/", 13) == 0 && strncmp(method + 13, "did", 3) != 0)
+    {
+        char *uri = NULL;
+        int line = 0, col = 0;
+        get_params(json, &uri, &line, &col);
+        if (uri)
+        {
+            lsp_project_flush_file(uri);
+            free(uri);
+        }
+    }
+
     if (strcmp(method, "initialize") == 0)
     {
         cJSON *params = cJSON_GetObjectItem(json, "params");
@@ -111,7 +246,7 @@ void handle_request(const char *json_str)
         const char *response =
             "{\"jsonrpc\":\"2.0\",\"id\":0,\"result\":{"
             "\"serverInfo\":{\"name\":\"ZenC LS\",\"version\": \"1.0.0\"},"
-            "\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":1},"
+            "\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
             "\"definitionProvider\":true,\"hoverProvider\":true,"
             "\"referencesProvider\":true,\"documentSymbolProvider\":true,"
             "\"renameProvider\":true,"
@@ -137,34 +272,54 @@ void handle_request(const char *json_str)
         free(str);
         cJSON_Delete(res_json);
         fflush(stdout);
+
+        // Indexing runs on; ask for a token to report its progress under.
+        cJSON *caps = cJSON_GetObjectItem(params, "capabilities");
+        cJSON *window = cJSON_GetObjectItem(caps, "window");
+        if (g_project && g_project->indexing &&
+            cJSON_IsTrue(cJSON_GetObjectItem(window, "workDoneProgress")))
+        {
+            cJSON *req = cJSON_CreateObject();
+            cJSON_AddStringToObject(req, "jsonrpc", "2.0");
+            cJSON_AddStringToObject(req, "id", INDEX_PROGRESS_TOKEN);
+            cJSON_AddStringToObject(req, "method", "window/workDoneProgress/create");
+            cJSON *req_params = cJSON_AddObjectToObject(req, "params");
+            cJSON_AddStringToObject(req_params, "token", INDEX_PROGRESS_TOKEN);
+            send_json(req);
+            index_progress = PROGRESS_REQUESTED;
+        }
     }
-    else if (strcmp(method, "textDocument/didOpen") == 0 ||
-             strcmp(method, "textDocument/didChange") == 0)
+    else if (strcmp(method, "textDocument/didOpen") == 0)
     {
         cJSON *params = cJSON_GetObjectItem(json, "params");
-        if (params)
+        cJSON *doc = cJSON_GetObjectItem(params, "textDocument");
+        cJSON *uri = cJSON_GetObjectItem(doc, "uri");
+        cJSON *text = cJSON_GetObjectItem(doc, "text");
+        if (uri && uri->valuestring && text && text->valuestring)
         {
-            cJSON *doc = cJSON_GetObjectItem(params, "textDocument");
-            if (doc)
-            {
-                cJSON *uri = cJSON_GetObjectItem(doc, "uri");
-                cJSON *text = cJSON_GetObjectItem(doc, "text");
-                // For didChange, text is inside contentChanges
-                if (!text && strcmp(method, "textDocument/didChange") == 0)
-                {
-                    cJSON *changes = cJSON_GetObjectItem(params, "contentChanges");
-                    if (changes && cJSON_GetArraySize(changes) > 0)
-                    {
-                        cJSON *change = cJSON_GetArrayItem(changes, 0);
-                        text = cJSON_GetObjectItem(change, "text");
-                    }
-                }
-
-                if (uri && uri->valuestring && text && text->valuestring)
-                {
-                    lsp_check_file(uri->valuestring, text->valuestring, id);
-                }
-            }
+            lsp_project_open_file(uri->valuestring, text->valuestring);
+        }
+    }
+    else if (strcmp(method, "textDocument/didChange") == 0)
+    {
+        cJSON *params = cJSON_GetObjectItem(json, "params");
+        cJSON *doc = cJSON_GetObjectItem(params, "textDocument");
+        cJSON *uri = cJSON_GetObjectItem(doc, "uri");
+        cJSON *changes = cJSON_GetObjectItem(params, "contentChanges");
+        if (uri && uri->valuestring && changes)
+        {
+            apply_changes(uri->valuestring, changes);
+        }
+    }
+    else if (strcmp(method, "textDocument/didClose") == 0)
+    {
+        char *uri = NULL;
+        int line = 0, col = 0;
+        get_params(json, &uri, &line, &col);
+        if (uri)
+        {
+            lsp_project_close_file(uri);
+            free(uri);
         }
     }
     else if (strcmp(method, "textDocument/definition") == 0)
@@ -284,6 +439,19 @@ void handle_request(const char *json_str)
             free(uri);
         }
     }
+    else if (strcmp(method, "shutdown") == 0)
+    {
+        cJSON *res_json = cJSON_CreateObject();
+        cJSON_AddStringToObject(res_json, "jsonrpc", "2.0");
+        cJSON_AddNumberToObject(res_json, "id", id);
+        cJSON_AddNullToObject(res_json, "result");
+        send_json(res_json);
+    }
+    else if (strcmp(method, "exit") == 0)
+    {
+        cJSON_Delete(json);
+        exit(0);
+    }
 
     cJSON_Delete(json);
 }
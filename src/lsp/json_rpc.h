@@ -12,4 +12,19 @@
  */
 void handle_request(const char *json_str);
 
+/**
+ * @brief Milliseconds without edits before a changed document is checked.
+ */
+extern int g_lsp_debounce_ms;
+
+/**
+ * @brief Reports workspace indexing progress with `$/progress`.
+ *
+ * Does nothing unless the client accepted a progress token when the server
+ * asked for one after `initialize`.
+ *
+ * @param finished 1 once indexing is over; ends the progress.
+ */
+void lsp_report_index_progress(int done, int total, int finished);
+
 #endif
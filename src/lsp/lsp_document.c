@@ -0,0 +1,250 @@
+#include "lsp_document.h"
+#include "zprep.h"
+#include <string.h>
+
+// Once edits have cut the text into this many pieces, it is rebuilt as one.
+#define DOC_MAX_PIECES 1024
+
+typedef struct
+{
+    int added;    // In the add buffer rather than the original text.
+    size_t start; // Offset in that buffer.
+    size_t len;
+    int lines; // Newlines in the piece.
+} Piece;
+
+struct LSPDocument
+{
+    char *orig;
+    char *add;
+    size_t add_len;
+    size_t add_cap;
+    Piece *pieces;
+    int count;
+    int cap;
+    char *flat; // Contiguous text, or NULL once an edit made it stale.
+};
+
+static const char *piece_data(const LSPDocument *doc, const Piece *p)
+{
+    return (p->added ? doc->add : doc->orig) + p->start;
+}
+
+static int count_lines(const char *s, size_t len)
+{
+    int lines = 0;
+    const char *end = s + len;
+    while ((s = memchr(s, '\n', end - s)) != NULL)
+    {
+        lines++;
+        s++;
+    }
+    return lines;
+}
+
+static void insert_piece(LSPDocument *doc, int at, Piece p)
+{
+    if (doc->count == doc->cap)
+    {
+        doc->cap = doc->cap ? doc->cap * 2 : 16;
+        doc->pieces = xrealloc(doc->pieces, doc->cap * sizeof(Piece));
+    }
+    memmove(&doc->pieces[at + 1], &doc->pieces[at], (doc->count - at) * sizeof(Piece));
+    doc->pieces[at] = p;
+    doc->count++;
+}
+
+LSPDocument *lsp_doc_new(const char *text)
+{
+    LSPDocument *doc = xcalloc(1, sizeof(LSPDocument));
+    lsp_doc_set(doc, text);
+    return doc;
+}
+
+void lsp_doc_free(LSPDocument *doc)
+{
+    if (!doc)
+    {
+        return;
+    }
+    free(doc->orig);
+    free(doc->add);
+    free(doc->pieces);
+    free(doc->flat);
+    free(doc);
+}
+
+void lsp_doc_set(LSPDocument *doc, const char *text)
+{
+    free(doc->orig);
+    doc->orig = xstrdup(text ? text : "");
+    doc->add_len = 0;
+    doc->count = 0;
+    free(doc->flat);
+    doc->flat = NULL;
+    size_t len = strlen(doc->orig);
+    if (len > 0)
+    {
+        Piece p = {0, 0, len, count_lines(doc->orig, len)};
+        insert_piece(doc, 0, p);
+    }
+}
+
+// Byte offset of an LSP position.
+static size_t doc_offset(const LSPDocument *doc, int line, int character)
+{
+    size_t off = 0;
+    int cur_line = 0;
+    int i = 0;
+    // Whole pieces before the line.
+    for (; i < doc->count && cur_line + doc->pieces[i].lines < line; i++)
+    {
+        cur_line += doc->pieces[i].lines;
+        off += doc->pieces[i].len;
+    }
+
+    int units = 0;
+    for (; i < doc->count; i++)
+    {
+        const Piece *p = &doc->pieces[i];
+        const unsigned char *s = (const unsigned char *)piece_data(doc, p);
+        for (size_t j = 0; j < p->len; j++, off++)
+        {
+            if (cur_line < line)
+            {
+                cur_line += s[j] == '\n';
+                continue;
+            }
+            if (s[j] == '\n' || s[j] == '\r')
+            {
+                return off;
+            }
+            // Characters are counted on their first byte; four-byte UTF-8
+            // sequences are surrogate pairs in UTF-16.
+            if ((s[j] & 0xC0) != 0x80)
+            {
+                if (units >= character)
+                {
+                    return off;
+                }
+                units += s[j] >= 0xF0 ? 2 : 1;
+            }
+        }
+    }
+    return off;
+}
+
+// Index of the piece that starts at byte `off`, splitting one if needed.
+static int split_at(LSPDocument *doc, size_t off)
+{
+    size_t pos = 0;
+    for (int i = 0; i < doc->count; i++)
+    {
+        Piece *p = &doc->pieces[i];
+        if (off == pos)
+        {
+            return i;
+        }
+        if (off < pos + p->len)
+        {
+            size_t head = off - pos;
+            const char *data = piece_data(doc, p);
+            Piece tail = {p->added, p->start + head, p->len - head, 0};
+            // Count newlines in the shorter half.
+            if (head < tail.len)
+            {
+                int head_lines = count_lines(data, head);
+                tail.lines = p->lines - head_lines;
+                p->lines = head_lines;
+            }
+            else
+            {
+                tail.lines = count_lines(data + head, tail.len);
+                p->lines -= tail.lines;
+            }
+            p->len = head;
+            insert_piece(doc, i + 1, tail);
+            return i + 1;
+        }
+        pos += p->len;
+    }
+    return doc->count;
+}
+
+void lsp_doc_replace(LSPDocument *doc, int start_line, int start_char, int end_line,
+                     int end_char, const char *text)
+{
+    size_t start = doc_offset(doc, start_line, start_char);
+    size_t end = doc_offset(doc, end_line, end_char);
+    if (end < start)
+    {
+        size_t t = start;
+        start = end;
+        end = t;
+    }
+    free(doc->flat);
+    doc->flat = NULL;
+
+    int first = split_at(doc, start);
+    if (end > start)
+    {
+        int last = split_at(doc, end);
+        memmove(&doc->pieces[first], &doc->pieces[last], (doc->count - last) * sizeof(Piece));
+        doc->count -= last - first;
+    }
+
+    size_t len = text ? strlen(text) : 0;
+    if (len > 0)
+    {
+        if (doc->add_len + len > doc->add_cap)
+        {
+            doc->add_cap = (doc->add_len + len) * 2;
+            doc->add = xrealloc(doc->add, doc->add_cap);
+        }
+        memcpy(doc->add + doc->add_len, text, len);
+        int lines = count_lines(text, len);
+
+        // Typing extends the piece the previous keystroke added.
+        Piece *prev = first > 0 ? &doc->pieces[first - 1] : NULL;
+        if (prev && prev->added && prev->start + prev->len == doc->add_len)
+        {
+            prev->len += len;
+            prev->lines += lines;
+        }
+        else
+        {
+            Piece p = {1, doc->add_len, len, lines};
+            insert_piece(doc, first, p);
+        }
+        doc->add_len += len;
+    }
+
+    if (doc->count > DOC_MAX_PIECES)
+    {
+        char *text_now = xstrdup(lsp_doc_text(doc));
+        lsp_doc_set(doc, text_now);
+        free(text_now);
+    }
+}
+
+const char *lsp_doc_text(LSPDocument *doc)
+{
+    if (doc->flat)
+    {
+        return doc->flat;
+    }
+    size_t len = 0;
+    for (int i = 0; i < doc->count; i++)
+    {
+        len += doc->pieces[i].len;
+    }
+    doc->flat = xmalloc(len + 1);
+    char *out = doc->flat;
+    for (int i = 0; i < doc->count; i++)
+    {
+        memcpy(out, piece_data(doc, &doc->pieces[i]), doc->pieces[i].len);
+        out += doc->pieces[i].len;
+    }
+    *out = 0;
+    return doc->flat;
+}
@@ -0,0 +1,47 @@
+#ifndef LSP_DOCUMENT_H
+#define LSP_DOCUMENT_H
+
+#include <stddef.h>
+
+/**
+ * @brief Text of an open document, edited in place as the client types.
+ *
+ * A piece table: the text is a sequence of pieces, each a span of either the
+ * text the document was opened with or an append-only buffer of inserted
+ * text. An edit splits at most two pieces and adds one, so its cost does not
+ * depend on the size of the file; the contiguous text is only built when the
+ * document is parsed.
+ */
+typedef struct LSPDocument LSPDocument;
+
+/**
+ * @brief Creates a document holding @p text.
+ */
+LSPDocument *lsp_doc_new(const char *text);
+
+/**
+ * @brief Frees a document.
+ */
+void lsp_doc_free(LSPDocument *doc);
+
+/**
+ * @brief Replaces the whole text of the document.
+ */
+void lsp_doc_set(LSPDocument *doc, const char *text);
+
+/**
+ * @brief Replaces a range of the document with @p text.
+ *
+ * Positions are LSP positions: zero-based lines, and characters counted in
+ * UTF-16 code units. Positions past the end of a line or of the document are
+ * clamped to it.
+ */
+void lsp_doc_replace(LSPDocument *doc, int start_line, int start_char, int end_line,
+                     int end_char, const char *text);
+
+/**
+ * @brief Returns the current text, valid until the next edit.
+ */
+const char *lsp_doc_text(LSPDocument *doc);
+
+#endif
@@ -0,0 +1,445 @@
+#include "lsp_indexer.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// The parser recurses deeply; secondary threads can default to small stacks.
+#define INDEX_STACK_SIZE (8 * 1024 * 1024)
+
+// Directories that hold build output rather than sources.
+static const char *build_dirs[] = {"build", "out", "obj", "target", "node_modules", NULL};
+
+typedef struct IgnoreRule
+{
+    const char *base; // Directory of the .gitignore, relative to the root.
+    char *pattern;
+    int negate;   // `!pattern`: re-include.
+    int dir_only; // `pattern/`: directories only.
+    int anchored; // Has a slash: matched against the path below `base`.
+    struct IgnoreRule *next;
+} IgnoreRule;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    char *root;
+    int jobs;
+    char **paths;       // Files found by the walk.
+    int count;
+    int cap;
+    int next_path;      // Next file to hand to a worker.
+    int done;           // Files parsed.
+    int listed;         // The walk has finished.
+    int running;        // Started and not yet finished.
+    IndexedFile *ready; // Parsed and not yet taken.
+    IndexedFile **tail; // Where the next parsed file is appended.
+} Indexer;
+
+static Indexer indexer = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+void lsp_default_on_error(void *data, Token t, const char *msg);
+
+// Matches a gitignore glob: `*` and `?` stop at slashes, `**` does not.
+static int glob_match(const char *p, const char *s)
+{
+    while (*p)
+    {
+        if (*p == '*')
+        {
+            int deep = p[1] == '*';
+            while (*p == '*')
+            {
+                p++;
+            }
+            // "a/**/b" also matches "a/b".
+            if (deep && *p == '/' && glob_match(p + 1, s))
+            {
+                return 1;
+            }
+            for (;; s++)
+            {
+                if (glob_match(p, s))
+                {
+                    return 1;
+                }
+                if (!*s || (*s == '/' && !deep))
+                {
+                    return 0;
+                }
+            }
+        }
+        if (!*s)
+        {
+            return 0;
+        }
+        if (*p == '?')
+        {
+            if (*s == '/')
+            {
+                return 0;
+            }
+        }
+        else if (*p == '[' && strchr(p + 1, ']'))
+        {
+            const char *q = p + 1;
+            int negate = *q == '!' || *q == '^';
+            q += negate;
+            int hit = 0;
+            do
+            {
+                if (q[1] == '-' && q[2] && q[2] != ']')
+                {
+                    hit |= *s >= q[0] && *s <= q[2];
+                    q += 2;
+                }
+                else
+                {
+                    hit |= *q == *s;
+                }
+                q++;
+            } while (*q != ']');
+            if (hit == negate)
+            {
+                return 0;
+            }
+            p = q;
+        }
+        else
+        {
+            if (*p == '\\' && p[1])
+            {
+                p++;
+            }
+            if (*p != *s)
+            {
+                return 0;
+            }
+        }
+        p++;
+        s++;
+    }
+    return !*s;
+}
+
+// Adds the rules of `dir`/.gitignore in front of `rules`, so that a later
+// (or deeper) rule overrides an earlier one.
+static IgnoreRule *load_gitignore(const char *dir, const char *rel, IgnoreRule *rules)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/.gitignore", dir);
+    char *text = load_file(path);
+    if (!text)
+    {
+        return rules;
+    }
+
+    char *base = xstrdup(rel);
+    char *next = text;
+    while (next)
+    {
+        char *line = next;
+        next = strchr(line, '\n');
+        if (next)
+        {
+            *next++ = 0;
+        }
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' '))
+        {
+            line[--len] = 0;
+        }
+        if (len == 0 || line[0] == '#')
+        {
+            continue;
+        }
+
+        IgnoreRule *r = xcalloc(1, sizeof(IgnoreRule));
+        r->base = base;
+        if (line[0] == '!')
+        {
+            r->negate = 1;
+            line++;
+            len--;
+        }
+        if (len > 0 && line[len - 1] == '/')
+        {
+            r->dir_only = 1;
+            line[--len] = 0;
+        }
+        r->anchored = strchr(line, '/') != NULL;
+        if (line[0] == '/')
+        {
+            line++;
+        }
+        if (!*line)
+        {
+            continue;
+        }
+        r->pattern = xstrdup(line);
+        r->next = rules;
+        rules = r;
+    }
+    free(text);
+    return rules;
+}
+
+// `rel` is the entry's path relative to the root, `name` its last component.
+static int is_ignored(IgnoreRule *rules, const char *rel, const char *name, int is_dir)
+{
+    for (IgnoreRule *r = rules; r; r = r->next)
+    {
+        if (r->dir_only && !is_dir)
+        {
+            continue;
+        }
+        const char *subject = name;
+        if (r->anchored)
+        {
+            size_t base_len = strlen(r->base);
+            if (base_len == 0)
+            {
+                subject = rel;
+            }
+            else if (strncmp(rel, r->base, base_len) == 0 && rel[base_len] == '/')
+            {
+                subject = rel + base_len + 1;
+            }
+            else
+            {
+                continue;
+            }
+        }
+        if (glob_match(r->pattern, subject))
+        {
+            return !r->negate;
+        }
+    }
+    return 0;
+}
+
+static int is_build_dir(const char *name)
+{
+    for (int i = 0; build_dirs[i]; i++)
+    {
+        if (strcmp(name, build_dirs[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void add_path(const char *path)
+{
+    if (indexer.count == indexer.cap)
+    {
+        indexer.cap = indexer.cap ? indexer.cap * 2 : 64;
+        indexer.paths = xrealloc(indexer.paths, indexer.cap * sizeof(char *));
+    }
+    indexer.paths[indexer.count++] = xstrdup(path);
+}
+
+static void walk(const char *dir, const char *rel, IgnoreRule *rules)
+{
+    rules = load_gitignore(dir, rel, rules);
+
+    DIR *d = opendir(dir);
+    if (!d)
+    {
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        // Hidden entries, including .git.
+        if (ent->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        char path[1024];
+        char sub[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        snprintf(sub, sizeof(sub), "%s%s%s", rel, *rel ? "/" : "", ent->d_name);
+
+        struct stat st;
+        if (stat(path, &st) != 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            if (!is_build_dir(ent->d_name) && !is_ignored(rules, sub, ent->d_name, 1))
+            {
+                walk(path, sub, rules);
+            }
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            const char *ext = strrchr(ent->d_name, '.');
+            if (ext && strcmp(ext, ".zc") == 0 && !is_ignored(rules, sub, ent->d_name, 0))
+            {
+                add_path(path);
+            }
+        }
+    }
+    closedir(d);
+}
+
+static IndexedFile *index_file(const char *path)
+{
+    if (g_config.verbose)
+    {
+        fprintf(stderr, "zls: Indexing %s\n", path);
+    }
+
+    char *src = load_file(path);
+    if (!src)
+    {
+        return NULL;
+    }
+
+    IndexedFile *f = xcalloc(1, sizeof(IndexedFile));
+    size_t uri_len = strlen(path) + 8;
+    f->uri = xmalloc(uri_len);
+    snprintf(f->uri, uri_len, "file://%s", path);
+    f->source = src;
+
+    f->ctx = xcalloc(1, sizeof(ParserContext));
+    f->ctx->is_fault_tolerant = 1;
+    f->ctx->on_error = lsp_default_on_error;
+
+    g_current_filename = f->uri;
+    Lexer l;
+    lexer_init(&l, src);
+    f->ast = parse_program(f->ctx, &l);
+
+    f->index = lsp_index_new();
+    if (f->ast)
+    {
+        lsp_build_index(f->index, f->ast);
+        validate_types(f->ctx);
+    }
+    return f;
+}
+
+static void *index_worker(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        pthread_mutex_lock(&indexer.lock);
+        char *path = indexer.next_path < indexer.count ? indexer.paths[indexer.next_path++] : NULL;
+        pthread_mutex_unlock(&indexer.lock);
+        if (!path)
+        {
+            return NULL;
+        }
+
+        IndexedFile *f = index_file(path);
+
+        pthread_mutex_lock(&indexer.lock);
+        if (f)
+        {
+            *indexer.tail = f;
+            indexer.tail = &f->next;
+        }
+        indexer.done++;
+        pthread_mutex_unlock(&indexer.lock);
+    }
+}
+
+static int spawn(pthread_t *thread, void *(*fn)(void *))
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, INDEX_STACK_SIZE);
+    int ok = pthread_create(thread, &attr, fn, NULL) == 0;
+    pthread_attr_destroy(&attr);
+    return ok;
+}
+
+// Lists the workspace, then parses it on `jobs` threads, this one included.
+static void *index_main(void *arg)
+{
+    (void)arg;
+    walk(indexer.root, "", NULL);
+    pthread_mutex_lock(&indexer.lock);
+    indexer.listed = 1;
+    pthread_mutex_unlock(&indexer.lock);
+
+    int workers = indexer.jobs - 1;
+    if (workers > indexer.count)
+    {
+        workers = indexer.count;
+    }
+    pthread_t *threads = xcalloc(workers > 0 ? workers : 1, sizeof(pthread_t));
+    int started = 0;
+    while (started < workers && spawn(&threads[started], index_worker))
+    {
+        started++;
+    }
+    index_worker(NULL);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&indexer.lock);
+    indexer.running = 0;
+    pthread_mutex_unlock(&indexer.lock);
+    return NULL;
+}
+
+void lsp_indexer_start(const char *root, int jobs)
+{
+    if (indexer.running)
+    {
+        return;
+    }
+    indexer.root = xstrdup(root);
+    indexer.jobs = jobs > 0 ? jobs : z_get_cpu_count();
+    indexer.tail = &indexer.ready;
+    indexer.running = 1;
+
+    pthread_t thread;
+    if (spawn(&thread, index_main))
+    {
+        pthread_detach(thread);
+    }
+    else
+    {
+        index_main(NULL);
+    }
+}
+
+IndexedFile *lsp_indexer_take(void)
+{
+    pthread_mutex_lock(&indexer.lock);
+    IndexedFile *f = indexer.ready;
+    if (f)
+    {
+        indexer.ready = f->next;
+        if (!indexer.ready)
+        {
+            indexer.tail = &indexer.ready;
+        }
+        f->next = NULL;
+    }
+    pthread_mutex_unlock(&indexer.lock);
+    return f;
+}
+
+int lsp_indexer_progress(int *done, int *total)
+{
+    pthread_mutex_lock(&indexer.lock);
+    *done = indexer.done;
+    *total = indexer.listed ? indexer.count : 0;
+    int running = indexer.running;
+    pthread_mutex_unlock(&indexer.lock);
+    return running;
+}
@@ -0,0 +1,47 @@
+#ifndef LSP_INDEXER_H
+#define LSP_INDEXER_H
+
+#include "lsp_index.h"
+#include "parser.h"
+
+/**
+ * @brief A workspace file parsed by the background indexer.
+ *
+ * Each file is parsed into a context of its own on a worker thread. The main
+ * thread takes finished files and merges their symbols into the project.
+ */
+typedef struct IndexedFile
+{
+    char *uri;          ///< file:// URI.
+    char *source;       ///< Content the file was parsed from.
+    ParserContext *ctx; ///< Context the file (and its imports) registered into.
+    ASTNode *ast;       ///< Parsed AST.
+    LSPIndex *index;    ///< Symbol index of the file.
+    struct IndexedFile *next;
+} IndexedFile;
+
+/**
+ * @brief Starts indexing the .zc files under @p root in the background.
+ *
+ * Directories named in .gitignore files, hidden directories and build
+ * output directories (build, out, obj, target, node_modules) are skipped.
+ *
+ * @param jobs Number of files parsed at once, or 0 for one per processor.
+ */
+void lsp_indexer_start(const char *root, int jobs);
+
+/**
+ * @brief Takes the next file the indexer has finished, or NULL if none is.
+ */
+IndexedFile *lsp_indexer_take(void);
+
+/**
+ * @brief Reports how far indexing has come.
+ *
+ * @param done  Set to the number of files parsed so far.
+ * @param total Set to the number of files to parse (0 while still listing).
+ * @return 1 while the indexer is running, 0 once every file is parsed.
+ */
+int lsp_indexer_progress(int *done, int *total);
+
+#endif
@@ -1,66 +1,174 @@
 
 #include "json_rpc.h"
+#include "lsp_project.h"
 #include "zprep.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-// Simple Main Loop for LSP.
+#define LSP_MAX_MESSAGE (10 * 1024 * 1024)
+
+// How often files indexed in the background are merged in while idle.
+#define LSP_INDEX_POLL_MS 50
+
+// Bytes read from the client that do not yet form a whole message.
+static char *in_buf = NULL;
+static size_t in_len = 0;
+static size_t in_cap = 0;
+
+// Removes the next complete message from the input buffer.
+// Returns NULL if it has not fully arrived, setting *bad on a malformed header.
+static char *take_message(int *bad)
+{
+    *bad = 0;
+    char *end = NULL;
+    for (size_t i = 0; i + 4 <= in_len; i++)
+    {
+        if (0 == memcmp(in_buf + i, "\r\n\r\n", 4))
+        {
+            end = in_buf + i;
+            break;
+        }
+    }
+    if (!end)
+    {
+        return NULL;
+    }
+    size_t header_len = end - in_buf + 4;
+
+    long content_len = 0;
+    const char *p = in_buf;
+    while (p < end)
+    {
+        if (0 == strncmp(p, "Content-Length: ", 16))
+        {
+            content_len = atol(p + 16);
+        }
+        const char *nl = memchr(p, '\n', end - p);
+        if (!nl)
+        {
+            break;
+        }
+        p = nl + 1;
+    }
+
+    if (content_len > LSP_MAX_MESSAGE)
+    {
+        fprintf(stderr, "zls: Content-Length too large (%ld)\n", content_len);
+        *bad = 1;
+        return NULL;
+    }
+    if (content_len <= 0)
+    {
+        // No body: drop the header.
+        memmove(in_buf, in_buf + header_len, in_len - header_len);
+        in_len -= header_len;
+        return NULL;
+    }
+    if (in_len < header_len + content_len)
+    {
+        return NULL;
+    }
+
+    char *body = xmalloc(content_len + 1);
+    memcpy(body, in_buf + header_len, content_len);
+    body[content_len] = 0;
+    size_t used = header_len + content_len;
+    memmove(in_buf, in_buf + used, in_len - used);
+    in_len -= used;
+    return body;
+}
+
+// Waits up to `timeout_ms` (-1: indefinitely) for input and reads it.
+// Returns 0 on end of input or a read error.
+static int fill_input(int timeout_ms)
+{
+    if (!z_wait_readable(0, timeout_ms))
+    {
+        return 1; // Timed out: time to run checks.
+    }
+
+    if (in_cap - in_len < 65536)
+    {
+        in_cap = in_cap ? in_cap * 2 : 131072;
+        in_buf = xrealloc(in_buf, in_cap);
+    }
+    ssize_t n = read(0, in_buf + in_len, in_cap - in_len);
+    if (n <= 0)
+    {
+        return 0;
+    }
+    in_len += n;
+    return 1;
+}
+
+// Main loop for LSP.
+//
+// Every message that has already arrived is handled before any pending
+// diagnostics run, so a burst of didChange notifications costs one reparse.
+// Files indexed in the background are merged in between messages.
 int lsp_main(int argc, char **argv)
 {
-    (void)argc;
-    (void)argv;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0)
+        {
+            g_config.verbose = 1;
+        }
+        else if (strncmp(argv[i], "--jobs=", 7) == 0)
+        {
+            g_lsp_index_jobs = atoi(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "--debounce=", 11) == 0)
+        {
+            g_lsp_debounce_ms = atoi(argv[i] + 11);
+            if (g_lsp_debounce_ms < 0)
+            {
+                g_lsp_debounce_ms = 0;
+            }
+        }
+    }
+
     fprintf(stderr, "zls: Zen Language Server starting...\n");
     g_config.mode_lsp = 1;
+    g_config.no_zen = 1;
 
     while (1)
     {
-        // Read headers
-        int content_len = 0;
-        char line[512];
-        while (fgets(line, sizeof(line), stdin))
+        int bad = 0;
+        char *body = take_message(&bad);
+        if (bad)
         {
-            if (0 == strcmp(line, "\r\n"))
-            {
-                break; // End of headers
-            }
-            if (0 == strncmp(line, "Content-Length: ", 16))
-            {
-                content_len = atoi(line + 16);
-            }
+            break;
         }
-
-        if (content_len <= 0)
+        if (body)
         {
-            if (feof(stdin))
+            // Process JSON-RPC.
+            if (g_config.verbose)
             {
-                break;
+                fprintf(stderr, "zls: Received: %s\n", body);
             }
+            handle_request(body);
+            free(body);
             continue;
         }
 
-        if (content_len > 10 * 1024 * 1024)
+        int indexing = lsp_project_merge_indexed();
+        long long wait = lsp_project_next_check();
+        if (wait == 0)
         {
-            fprintf(stderr, "zls: Content-Length too large (%d)\n", content_len);
-            break;
+            lsp_project_run_checks();
+            continue;
         }
-
-        // Read body.
-        char *body = malloc(content_len + 1);
-        if (fread(body, 1, content_len, stdin) != (size_t)content_len)
+        if (indexing && (wait < 0 || wait > LSP_INDEX_POLL_MS))
+        {
+            wait = LSP_INDEX_POLL_MS;
+        }
+        if (!fill_input(wait < 0 ? -1 : (int)wait))
         {
-            fprintf(stderr, "zls: Error reading body\n");
-            free(body);
             break;
         }
-        body[content_len] = 0;
-
-        // Process JSON-RPC.
-        fprintf(stderr, "zls: Received: %s\n", body);
-        handle_request(body);
-
-        free(body);
     }
 
     return 0;
@@ -1,13 +1,143 @@
 #include "lsp_project.h"
-#include <dirent.h>
+#include "json_rpc.h"
+#include "lsp_indexer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
 
 LSPProject *g_project = NULL;
+int g_lsp_index_jobs = 0;
 
-static void scan_dir(const char *dir_path);
+// Names in the project context's registries, keyed "<kind>:<name>", so that
+// a symbol many indexed files import is merged in once.
+typedef struct
+{
+    char **slots;
+    int cap;
+    int count;
+} NameSet;
+
+static NameSet merged_names;
+
+static unsigned int name_hash(char kind, const char *name)
+{
+    unsigned int h = 2166136261u ^ (unsigned char)kind;
+    for (; *name; name++)
+    {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return h;
+}
+
+static int name_slot(char **slots, int cap, char kind, const char *name)
+{
+    int i = name_hash(kind, name) & (cap - 1);
+    while (slots[i] && (slots[i][0] != kind || strcmp(slots[i] + 2, name) != 0))
+    {
+        i = (i + 1) & (cap - 1);
+    }
+    return i;
+}
+
+// Adds a name; returns 0 if it was already there.
+static int name_set_add(NameSet *set, char kind, const char *name)
+{
+    if ((set->count + 1) * 4 > set->cap * 3)
+    {
+        int cap = set->cap ? set->cap * 2 : 1024;
+        char **slots = xcalloc(cap, sizeof(char *));
+        for (int i = 0; i < set->cap; i++)
+        {
+            if (set->slots[i])
+            {
+                slots[name_slot(slots, cap, set->slots[i][0], set->slots[i] + 2)] = set->slots[i];
+            }
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->cap = cap;
+    }
+    int i = name_slot(set->slots, set->cap, kind, name);
+    if (set->slots[i])
+    {
+        return 0;
+    }
+    size_t len = strlen(name);
+    set->slots[i] = xmalloc(len + 3);
+    set->slots[i][0] = kind;
+    set->slots[i][1] = ':';
+    memcpy(set->slots[i] + 2, name, len + 1);
+    set->count++;
+    return 1;
+}
+
+// Heads of the registries the LSP looks symbols up in.
+typedef struct
+{
+    FuncSig *funcs;
+    StructDef *structs;
+    StructRef *globals;
+    ZenSymbol *symbols;
+    GenericTemplate *templates;
+    GenericFuncTemplate *func_templates;
+} RegistryHeads;
+
+static RegistryHeads registry_heads(ParserContext *ctx)
+{
+    RegistryHeads h = {ctx->func_registry, ctx->struct_defs,    ctx->parsed_globals_list,
+                       ctx->all_symbols,   ctx->templates,      ctx->func_templates};
+    return h;
+}
+
+static const char *global_name(StructRef *g)
+{
+    return g->node ? g->node->var_decl.name : NULL;
+}
+
+// Registries only ever grow at the front: records the names added in front
+// of `old` (the heads before a parse).
+static void note_names(ParserContext *ctx, RegistryHeads old)
+{
+#define NOTE(Type, list, old_head, kind, name)                                                     \
+    for (Type *e = ctx->list; e && e != old.old_head; e = e->next)                                 \
+    {                                                                                              \
+        if (name)                                                                                  \
+        {                                                                                          \
+            name_set_add(&merged_names, kind, name);                                               \
+        }                                                                                          \
+    }
+    NOTE(FuncSig, func_registry, funcs, 'f', e->name)
+    NOTE(StructDef, struct_defs, structs, 's', e->name)
+    NOTE(StructRef, parsed_globals_list, globals, 'g', global_name(e))
+    NOTE(ZenSymbol, all_symbols, symbols, 'v', e->name)
+    NOTE(GenericTemplate, templates, templates, 't', e->name)
+    NOTE(GenericFuncTemplate, func_templates, func_templates, 'T', e->name)
+#undef NOTE
+}
+
+// Moves the symbols of an indexed file's context into the project's,
+// skipping names the project already has.
+static void merge_names(ParserContext *into, ParserContext *from)
+{
+#define MERGE(Type, list, kind, name)                                                              \
+    for (Type *e = from->list, *next; e; e = next)                                                 \
+    {                                                                                              \
+        next = e->next;                                                                            \
+        if (name && name_set_add(&merged_names, kind, name))                                       \
+        {                                                                                          \
+            e->next = into->list;                                                                  \
+            into->list = e;                                                                        \
+        }                                                                                          \
+    }                                                                                              \
+    from->list = NULL;
+    MERGE(FuncSig, func_registry, 'f', e->name)
+    MERGE(StructDef, struct_defs, 's', e->name)
+    MERGE(StructRef, parsed_globals_list, 'g', global_name(e))
+    MERGE(ZenSymbol, all_symbols, 'v', e->name)
+    MERGE(GenericTemplate, templates, 't', e->name)
+    MERGE(GenericFuncTemplate, func_templates, 'T', e->name)
+#undef MERGE
+}
 
 void lsp_project_init(const char *root_path)
 {
@@ -30,8 +160,10 @@ void lsp_project_init(const char *root_path)
     void lsp_default_on_error(void *data, Token t, const char *msg);
     g_project->ctx->on_error = lsp_default_on_error;
 
-    // Scan workspace
-    scan_dir(root_path);
+    // Index the workspace in the background; initialize is answered at once
+    // and requests see files as they are merged in.
+    g_project->indexing = 1;
+    lsp_indexer_start(root_path, g_lsp_index_jobs);
 }
 
 // Default error handler for indexing phase
@@ -46,65 +178,6 @@ void lsp_default_on_error(void *data, Token t, const char *msg)
     // Since zpanic_at printed "error: ...", we don't need to print again.
 }
 
-static void scan_file(const char *path)
-{
-    // Skip if not .zc
-    const char *ext = strrchr(path, '.');
-    if (!ext || strcmp(ext, ".zc") != 0)
-    {
-        return;
-    }
-
-    fprintf(stderr, "zls: Indexing %s\n", path);
-
-    char *src = load_file(path);
-    if (!src)
-    {
-        return;
-    }
-
-    char uri[2048];
-    sprintf(uri, "file://%s", path);
-
-    lsp_project_update_file(uri, src);
-    free(src);
-}
-
-static void scan_dir(const char *dir_path)
-{
-    DIR *d = opendir(dir_path);
-    if (!d)
-    {
-        return;
-    }
-
-    struct dirent *dir;
-    while ((dir = readdir(d)) != NULL)
-    {
-        if (dir->d_name[0] == '.')
-        {
-            continue;
-        }
-
-        char path[1024];
-        snprintf(path, sizeof(path), "%s/%s", dir_path, dir->d_name);
-
-        struct stat st;
-        if (stat(path, &st) == 0)
-        {
-            if (S_ISDIR(st.st_mode))
-            {
-                scan_dir(path);
-            }
-            else if (S_ISREG(st.st_mode))
-            {
-                scan_file(path);
-            }
-        }
-    }
-    closedir(d);
-}
-
 ProjectFile *lsp_project_get_file(const char *uri)
 {
     if (!g_project)
@@ -149,7 +222,7 @@ void lsp_project_update_file(const char *uri, const char *src)
         return;
     }
 
-    extern char *g_current_filename;
+    extern ZC_THREAD_LOCAL char *g_current_filename;
     g_current_filename = (char *)uri;
 
     ProjectFile *pf = lsp_project_get_file(uri);
@@ -173,7 +246,9 @@ void lsp_project_update_file(const char *uri, const char *src)
     Lexer l;
     lexer_init(&l, src);
 
+    RegistryHeads heads = registry_heads(g_project->ctx);
     ASTNode *root = parse_program(g_project->ctx, &l);
+    note_names(g_project->ctx, heads);
 
     pf->ast = root;
 
@@ -185,6 +260,157 @@ void lsp_project_update_file(const char *uri, const char *src)
     }
 }
 
+static void merge_file(IndexedFile *f)
+{
+    // Opened in the editor meanwhile: its own parse is newer.
+    if (lsp_project_get_file(f->uri))
+    {
+        return;
+    }
+    ProjectFile *pf = add_project_file(f->uri);
+    pf->source = f->source;
+    pf->ast = f->ast;
+    pf->index = f->index;
+    merge_names(g_project->ctx, f->ctx);
+}
+
+int lsp_project_merge_indexed(void)
+{
+    if (!g_project || !g_project->indexing)
+    {
+        return 0;
+    }
+
+    // Everything is queued before the indexer stops running, so taking after
+    // this check cannot miss a file.
+    int done = 0;
+    int total = 0;
+    int running = lsp_indexer_progress(&done, &total);
+
+    int merged = 0;
+    IndexedFile *f;
+    while ((f = lsp_indexer_take()) != NULL)
+    {
+        merge_file(f);
+        merged++;
+    }
+
+    if (!running)
+    {
+        g_project->indexing = 0;
+        if (g_config.verbose)
+        {
+            fprintf(stderr, "zls: Indexed %d files\n", total);
+        }
+        lsp_report_index_progress(done, total, 1);
+        return 0;
+    }
+    if (merged)
+    {
+        lsp_report_index_progress(done, total, 0);
+    }
+    return 1;
+}
+
+void lsp_check_file(const char *uri, const char *src, int id);
+
+static long long now_ms(void)
+{
+    return (long long)(z_get_monotonic_time() * 1000.0);
+}
+
+void lsp_project_open_file(const char *uri, const char *text)
+{
+    lsp_check_file(uri, text, 0);
+    ProjectFile *pf = lsp_project_get_file(uri);
+    if (pf)
+    {
+        lsp_doc_free(pf->doc);
+        pf->doc = lsp_doc_new(text);
+        pf->dirty = 0;
+    }
+}
+
+void lsp_project_close_file(const char *uri)
+{
+    lsp_project_flush_file(uri);
+    ProjectFile *pf = lsp_project_get_file(uri);
+    if (pf)
+    {
+        lsp_doc_free(pf->doc);
+        pf->doc = NULL;
+    }
+}
+
+LSPDocument *lsp_project_document(const char *uri)
+{
+    ProjectFile *pf = lsp_project_get_file(uri);
+    if (!pf)
+    {
+        return NULL;
+    }
+    if (!pf->doc && pf->source)
+    {
+        pf->doc = lsp_doc_new(pf->source);
+    }
+    return pf->doc;
+}
+
+void lsp_project_schedule_check(const char *uri, int delay_ms)
+{
+    ProjectFile *pf = lsp_project_get_file(uri);
+    if (pf && pf->doc)
+    {
+        pf->dirty = 1;
+        pf->check_due = now_ms() + delay_ms;
+    }
+}
+
+long long lsp_project_next_check(void)
+{
+    long long next = -1;
+    for (ProjectFile *pf = g_project ? g_project->files : NULL; pf; pf = pf->next)
+    {
+        if (pf->dirty && (next < 0 || pf->check_due < next))
+        {
+            next = pf->check_due;
+        }
+    }
+    if (next < 0)
+    {
+        return -1;
+    }
+    long long wait = next - now_ms();
+    return wait > 0 ? wait : 0;
+}
+
+static void run_check(ProjectFile *pf)
+{
+    pf->dirty = 0;
+    lsp_check_file(pf->uri, lsp_doc_text(pf->doc), 0);
+}
+
+void lsp_project_run_checks(void)
+{
+    long long now = now_ms();
+    for (ProjectFile *pf = g_project ? g_project->files : NULL; pf; pf = pf->next)
+    {
+        if (pf->dirty && pf->check_due <= now)
+        {
+            run_check(pf);
+        }
+    }
+}
+
+void lsp_project_flush_file(const char *uri)
+{
+    ProjectFile *pf = lsp_project_get_file(uri);
+    if (pf && pf->dirty)
+    {
+        run_check(pf);
+    }
+}
+
 DefinitionResult lsp_project_find_definition(const char *name)
 {
     DefinitionResult res = {0};
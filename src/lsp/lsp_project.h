@@ -2,6 +2,7 @@
 #define LSP_PROJECT_H
 
 #include "parser.h"
+#include "lsp_document.h"
 #include "lsp_index.h"
 
 /**
@@ -9,11 +10,14 @@
  */
 typedef struct ProjectFile
 {
-    char *path;      ///< Absolute file path.
-    char *uri;       ///< file:// URI.
-    char *source;    ///< Cached source content (in-memory).
-    ASTNode *ast;    ///< Cached AST for semantic analysis.
-    LSPIndex *index; ///< File-specific symbol index.
+    char *path;          ///< Absolute file path.
+    char *uri;           ///< file:// URI.
+    char *source;        ///< Cached source content (in-memory).
+    ASTNode *ast;        ///< Cached AST for semantic analysis.
+    LSPIndex *index;     ///< File-specific symbol index.
+    LSPDocument *doc;    ///< Buffer the client edits, while the file is open.
+    int dirty;           ///< Edited since `source` and the index were rebuilt.
+    long long check_due; ///< When to rebuild them and publish diagnostics (ms).
     struct ProjectFile *next;
 } ProjectFile;
 
@@ -30,11 +34,15 @@ typedef struct
 
     ProjectFile *files; ///< List of tracked open files.
     char *root_path;    ///< Project root directory.
+    int indexing;       ///< The workspace is still being indexed in the background.
 } LSPProject;
 
 // Global project instance
 extern LSPProject *g_project;
 
+// Threads indexing the workspace (0: one per processor)
+extern int g_lsp_index_jobs;
+
 // Initialize the project with a root directory
 void lsp_project_init(const char *root_path);
 
@@ -44,6 +52,31 @@ ProjectFile *lsp_project_get_file(const char *uri);
 // Update a file (re-parse and re-index)
 void lsp_project_update_file(const char *uri, const char *src);
 
+// Add the files the background indexer has finished, reporting progress.
+// Returns 1 while indexing is still running.
+int lsp_project_merge_indexed(void);
+
+// Open a file in the editor: check it now and keep a buffer for its edits
+void lsp_project_open_file(const char *uri, const char *text);
+
+// Close a file: apply pending edits and drop its buffer
+void lsp_project_close_file(const char *uri);
+
+// Buffer of a file being edited, created from its cached source if needed
+LSPDocument *lsp_project_document(const char *uri);
+
+// Check an edited file once `delay_ms` pass without further edits
+void lsp_project_schedule_check(const char *uri, int delay_ms);
+
+// Milliseconds until the next scheduled check is due, or -1 if none is
+long long lsp_project_next_check(void);
+
+// Run the scheduled checks that are due
+void lsp_project_run_checks(void);
+
+// Run the scheduled check of a file now, so requests see its latest text
+void lsp_project_flush_file(const char *uri);
+
 // Find definition globally
 typedef struct
 {
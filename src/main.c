@@ -5,7 +5,12 @@
 #include "zen/zen_facts.h"
 #include "zprep.h"
 #include "analysis/typecheck.h"
+#include "analysis/const_fold.h"
 #include "codegen/compat.h"
+#include "codegen/bounds.h"
+#include "codegen/dead_code.h"
+#include "utils/build_cache.h"
+#include "utils/pgo.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdlib.h>
@@ -50,6 +55,62 @@ static void main_append_flag(char *dest, size_t max_size, const char *prefix, co
     }
 }
 
+static int main_has_flag(const char *flags, const char *flag)
+{
+    size_t len = strlen(flag);
+    const char *p = flags;
+    while ((p = strstr(p, flag)) != NULL)
+    {
+        if ((p == flags || p[-1] == ' ') && (p[len] == '\0' || p[len] == ' '))
+        {
+            return 1;
+        }
+        p += len;
+    }
+    return 0;
+}
+
+// Unused functions are only dropped from a whole program. Objects, shared
+// libraries and sources linked with other C files may be called from outside.
+static int main_prunes_dead_code(ParserContext *ctx, ASTNode *root)
+{
+    if (g_config.keep_dead_code || g_config.c_file_count > 0)
+    {
+        return 0;
+    }
+    const char *output_only[] = {"-c", "-S", "-E", "-shared", "--shared", NULL};
+    for (int i = 0; output_only[i]; i++)
+    {
+        if (main_has_flag(g_config.gcc_flags, output_only[i]) ||
+            main_has_flag(g_cflags, output_only[i]))
+        {
+            return 0;
+        }
+    }
+
+    for (StructRef *r = ctx->parsed_funcs_list; r; r = r->next)
+    {
+        if (r->node && r->node->type == NODE_FUNCTION && r->node->func.name &&
+            strcmp(r->node->func.name, "main") == 0)
+        {
+            return 1;
+        }
+    }
+    ASTNode *kids = root->root.children;
+    while (kids && kids->type == NODE_ROOT)
+    {
+        kids = kids->root.children;
+    }
+    for (; kids; kids = kids->next)
+    {
+        if (kids->type == NODE_TEST)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     memset(&g_config, 0, sizeof(g_config));
@@ -167,6 +228,83 @@ int main(int argc, char **argv)
         {
             g_config.no_zen = 1;
         }
+        else if (strcmp(arg, "--no-comptime-cache") == 0)
+        {
+            g_config.no_comptime_cache = 1;
+        }
+        else if (strcmp(arg, "--no-build-cache") == 0)
+        {
+            g_config.no_build_cache = 1;
+        }
+        else if (strcmp(arg, "--keep-dead-code") == 0)
+        {
+            g_config.keep_dead_code = 1;
+        }
+        else if (strncmp(arg, "--bounds-checks=", 16) == 0)
+        {
+            const char *mode = arg + 16;
+            if (strcmp(mode, "full") == 0)
+            {
+                g_config.bounds_checks = BOUNDS_CHECKS_FULL;
+            }
+            else if (strcmp(mode, "elide") == 0)
+            {
+                g_config.bounds_checks = BOUNDS_CHECKS_ELIDE;
+            }
+            else if (strcmp(mode, "off") == 0)
+            {
+                g_config.bounds_checks = BOUNDS_CHECKS_OFF;
+            }
+            else
+            {
+                fprintf(stderr,
+                        COLOR_BOLD COLOR_RED "error" COLOR_RESET
+                        ": unknown bounds check mode '%s' (expected full, elide or off)\n",
+                        mode);
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--release") == 0 || strcmp(arg, "--release-lto") == 0 ||
+                 strcmp(arg, "--size") == 0)
+        {
+            g_config.profile_name = arg + 2;
+        }
+        else if (strcmp(arg, "--profile") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                g_config.profile_name = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, COLOR_BOLD COLOR_RED "error" COLOR_RESET
+                                                     ": missing profile name after '--profile'\n");
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--pgo") == 0)
+        {
+            g_config.pgo = 1;
+        }
+        else if (strcmp(arg, "--pgo-hints") == 0)
+        {
+            g_config.pgo = 1;
+            g_config.pgo_hints = 1;
+        }
+        else if (strcmp(arg, "--pgo-train") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                g_config.pgo = 1;
+                g_config.pgo_train = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, COLOR_BOLD COLOR_RED "error" COLOR_RESET
+                                                     ": missing command after '--pgo-train'\n");
+                return 1;
+            }
+        }
         else if (strcmp(arg, "--check") == 0)
         {
             g_config.use_typecheck = 1;
@@ -413,6 +551,12 @@ int main(int argc, char **argv)
 
     // Load all configurations (system, hidden project, visible project)
     load_all_configs();
+    if (g_config.profile_name && !find_build_profile(g_config.profile_name, &g_config.profile))
+    {
+        fprintf(stderr, COLOR_BOLD COLOR_RED "error" COLOR_RESET ": unknown build profile '%s'\n",
+                g_config.profile_name);
+        return 1;
+    }
 
     // Parse context init
     ParserContext ctx;
@@ -660,8 +804,32 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    int prune = main_prunes_dead_code(&ctx, root);
+    if (prune)
+    {
+        dce_begin(out);
+    }
+    fold_constants(&ctx, root);
+    bounds_analyze(&ctx, root);
     codegen_node(&ctx, root, out);
     fclose(out);
+    int elided, hoisted;
+    bounds_counts(&elided, &hoisted);
+    if (g_config.verbose && elided + hoisted > 0)
+    {
+        printf(COLOR_BOLD COLOR_BLUE "      Elided" COLOR_RESET
+                                     " %d bounds checks, hoisted %d out of loops\n",
+               elided, hoisted);
+    }
+    if (prune)
+    {
+        int removed = dce_prune_file(temp_source_file);
+        if (g_config.verbose && removed > 0)
+        {
+            printf(COLOR_BOLD COLOR_BLUE "      Pruned" COLOR_RESET " %d unused definitions\n",
+                   removed);
+        }
+    }
 
     if (g_config.mode_transpile)
     {
@@ -695,24 +863,52 @@ int main(int argc, char **argv)
     char *outfile =
         g_config.output_file ? g_config.output_file : (z_is_windows() ? "a.exe" : "a.out");
 
-    ArgList compile_args;
-    arg_list_init(&compile_args);
+    int ret;
+    if (g_config.pgo)
+    {
+        ret = pgo_build(&ctx, src, outfile, temp_source_file);
+    }
+    else
+    {
+        ArgList compile_args;
+        arg_list_init(&compile_args);
 
-    // Build command
-    build_compile_arg_list(&compile_args, outfile, temp_source_file);
+        // Build command
+        build_compile_arg_list(&compile_args, outfile, temp_source_file);
 
-    if (g_config.verbose)
-    {
-        printf(COLOR_BOLD COLOR_BLUE "     Command" COLOR_RESET);
-        for (size_t i = 0; i < compile_args.count; i++)
+        // Profile builds are cached per profile; the slow part is the C compiler.
+        unsigned long long key = 0;
+        int cached = g_config.profile_name && !g_config.no_build_cache &&
+                     build_inputs_hash(&compile_args, &key);
+        if (cached && build_cache_fetch(g_config.profile.name, key, outfile))
         {
-            printf(" %s", compile_args.args[i]);
+            if (g_config.verbose)
+            {
+                printf(COLOR_BOLD COLOR_BLUE "      Cached" COLOR_RESET " %s build\n",
+                       g_config.profile.name);
+            }
+            ret = 0;
         }
-        printf("\n");
-    }
+        else
+        {
+            if (g_config.verbose)
+            {
+                printf(COLOR_BOLD COLOR_BLUE "     Command" COLOR_RESET);
+                for (size_t i = 0; i < compile_args.count; i++)
+                {
+                    printf(" %s", compile_args.args[i]);
+                }
+                printf("\n");
+            }
 
-    int ret = arg_run(&compile_args);
-    arg_list_free(&compile_args);
+            ret = arg_run(&compile_args);
+            if (ret == 0 && cached)
+            {
+                build_cache_store(g_config.profile.name, key, outfile);
+            }
+        }
+        arg_list_free(&compile_args);
+    }
 
     if (ret != 0)
     {
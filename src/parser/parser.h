@@ -37,7 +37,7 @@ typedef struct ParserContext ParserContext;
  */
 ASTNode *parse_program(ParserContext *ctx, Lexer *l);
 
-extern ParserContext *g_parser_ctx;
+extern ZC_THREAD_LOCAL ParserContext *g_parser_ctx;
 
 // Symbol table
 /**
@@ -1001,6 +1001,15 @@ ASTNode *parse_function(ParserContext *ctx, Lexer *l, int is_async);
  */
 ASTNode *parse_struct(ParserContext *ctx, Lexer *l, int is_union, int is_opaque);
 
+/**
+ * @brief Generates the impl source for @derive(Json).
+ *
+ * The impl streams fields through JsonWriter/JsonReader (std/json.zc)
+ * without building a JsonValue tree. Returns NULL if `strct` is not a
+ * struct.
+ */
+char *generate_json_derive(ParserContext *ctx, ASTNode *strct);
+
 /**
  * @brief Parses an enum definition.
  */
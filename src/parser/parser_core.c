@@ -1217,6 +1217,14 @@ static ASTNode *generate_derive_impls(ParserContext *ctx, ASTNode *strct, char *
             sprintf(code, "impl %s { fn from_json(j: JsonValue*) -> Result<%s> { %s } }", name,
                     name, body);
         }
+        else if (0 == strcmp(trait, "Json"))
+        {
+            code = generate_json_derive(ctx, strct);
+            if (!code)
+            {
+                continue;
+            }
+        }
         else if (0 == strcmp(trait, "ToJson"))
         {
             // Generate to_json(self) -> JsonValue
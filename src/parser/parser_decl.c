@@ -87,11 +87,12 @@ ASTNode *parse_function(ParserContext *ctx, Lexer *l, int is_async)
     if (gen_param)
     {
         char *tmp = xstrdup(gen_param);
-        char *tok = strtok(tmp, ",");
+        char *saveptr;
+        char *tok = strtok_r(tmp, ",", &saveptr);
         while (tok)
         {
             register_generic(ctx, tok);
-            tok = strtok(NULL, ",");
+            tok = strtok_r(NULL, ",", &saveptr);
         }
         free(tmp);
     }
@@ -128,7 +129,7 @@ ASTNode *parse_function(ParserContext *ctx, Lexer *l, int is_async)
         zpanic_at(lexer_peek(l), "Functions use '->' for the return type, not ':'");
     }
 
-    extern char *curr_func_ret;
+    extern ZC_THREAD_LOCAL char *curr_func_ret;
     curr_func_ret = ret;
 
     // Auto-prefix function name if in module context
@@ -1,6 +1,7 @@
 
 #include "parser.h"
 #include <ctype.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,11 +12,14 @@
 #include "../zen/zen_facts.h"
 #include "zprep_plugin.h"
 #include "../codegen/codegen.h"
+#include "analysis/comptime_eval.h"
+#include "analysis/const_fold.h"
 #include "analysis/move_check.h"
+#include "utils/hash.h"
 
-char *curr_func_ret = NULL;
+ZC_THREAD_LOCAL char *curr_func_ret = NULL;
 char *run_comptime_block(ParserContext *ctx, Lexer *l);
-extern char *g_current_filename;
+extern ZC_THREAD_LOCAL char *g_current_filename;
 
 /**
  * @brief Auto-imports std/slice.zc if not already imported.
@@ -1832,6 +1836,7 @@ char *process_printf_sugar(ParserContext *ctx, const char *content, int newline,
         lexer_init(&lex, clean_expr);
 
         ASTNode *expr_node = parse_expression(ctx, &lex);
+        fold_expr(ctx, expr_node);
 
         char *rw_expr = NULL;
         int used_codegen = 0;
@@ -3892,11 +3897,38 @@ ASTNode *parse_import(ParserContext *ctx, Lexer *l)
     return r;
 }
 
-// Helper: Execute comptime block and return generated source
-char *run_comptime_block(ParserContext *ctx, Lexer *l)
+// Comptime blocks that the interpreter (analysis/comptime_eval.c) cannot
+// run are compiled to a C program and executed. Their output is cached by
+// content, and all such blocks of a file are compiled and run as one
+// program the first time one of them is reached.
+
+#define COMPTIME_SEPARATOR "\036zc-comptime\036"
+
+typedef struct ComptimeBlock
+{
+    char *code;
+    ParserContext *cctx;
+    ASTNode *nodes;
+    char *out; // Set once the block has run.
+    char *err;
+    int needs_compile;
+    struct ComptimeBlock *next;
+} ComptimeBlock;
+
+// Blocks read ahead of the parser, in source order.
+static ZC_THREAD_LOCAL ComptimeBlock *g_comptime_ahead = NULL;
+
+typedef struct ComptimeSource
+{
+    const char *src;
+    struct ComptimeSource *next;
+} ComptimeSource;
+
+static ZC_THREAD_LOCAL ComptimeSource *g_comptime_batched = NULL;
+
+// Reads the body of `comptime { ... }`; the lexer is at the opening brace.
+static char *comptime_read_block(Lexer *l)
 {
-    (void)ctx;
-    expect(l, TOK_COMPTIME, "comptime");
     expect(l, TOK_LBRACE, "expected { after comptime");
 
     const char *start = l->src + l->pos;
@@ -3923,32 +3955,53 @@ char *run_comptime_block(ParserContext *ctx, Lexer *l)
     char *code = xmalloc(len + 1);
     strncpy(code, start, len);
     code[len] = 0;
+    return code;
+}
+
+static ComptimeBlock *comptime_parse_block(char *code)
+{
+    ComptimeBlock *b = xmalloc(sizeof(ComptimeBlock));
+    memset(b, 0, sizeof(*b));
+    b->code = code;
 
     // Wrap in block to parse mixed statements/declarations
-    int wrapped_len = len + 4; // "{ " + code + " }"
+    int wrapped_len = strlen(code) + 4; // "{ " + code + " }"
     char *wrapped_code = xmalloc(wrapped_len + 1);
     sprintf(wrapped_code, "{ %s }", code);
 
     Lexer cl;
     lexer_init(&cl, wrapped_code);
-    ParserContext cctx;
-    memset(&cctx, 0, sizeof(cctx));
-    enter_scope(&cctx); // Global scope
-    register_builtins(&cctx);
+    b->cctx = xmalloc(sizeof(ParserContext));
+    memset(b->cctx, 0, sizeof(ParserContext));
+    enter_scope(b->cctx); // Global scope
+    register_builtins(b->cctx);
 
-    ASTNode *block = parse_block(&cctx, &cl);
-    ASTNode *nodes = block ? block->block.statements : NULL;
+    ASTNode *block = parse_block(b->cctx, &cl);
+    b->nodes = block ? block->block.statements : NULL;
 
     free(wrapped_code);
+    return b;
+}
 
-    char filename[64];
-    sprintf(filename, "_tmp_comptime_%d.c", rand());
-    FILE *f = fopen(filename, "w");
-    if (!f)
+// Takes the read-ahead entry for a block, if there is one.
+static ComptimeBlock *comptime_take_ahead(const char *code)
+{
+    for (ComptimeBlock **p = &g_comptime_ahead; *p; p = &(*p)->next)
     {
-        zpanic_at(lexer_peek(l), "Could not create temp file %s", filename);
+        if (strcmp((*p)->code, code) == 0)
+        {
+            ComptimeBlock *b = *p;
+            *p = b->next;
+            b->next = NULL;
+            return b;
+        }
     }
+    return NULL;
+}
 
+// Helpers, build metadata and @comptime functions shared by every block.
+static void comptime_emit_prelude(ParserContext *ctx, FILE *f)
+{
     emit_preamble(ctx, f);
     fprintf(
         f,
@@ -3967,13 +4020,43 @@ char *run_comptime_block(ParserContext *ctx, Lexer *l)
     fprintf(f, "#define __COMPTIME_TARGET__ \"%s\"\n", z_get_system_name());
     fprintf(f, "#define __COMPTIME_FILE__ \"%s\"\n", g_current_filename);
 
-    ASTNode *curr = nodes;
+    StructRef *ref = ctx->parsed_funcs_list;
+    while (ref)
+    {
+        ASTNode *fn = ref->node;
+        if (fn && fn->type == NODE_FUNCTION && fn->func.is_comptime)
+        {
+            emit_func_signature(ctx, f, fn, NULL);
+            fprintf(f, ";\n");
+            codegen_node_single(ctx, fn, f);
+        }
+        ref = ref->next;
+    }
+}
+
+// Emits a block's declarations, then its statements as the body of `entry`.
+static void comptime_emit_block(ComptimeBlock *b, FILE *f, const char *entry)
+{
+    ParserContext *cctx = b->cctx;
     ASTNode *stmts = NULL;
     ASTNode *stmts_tail = NULL;
 
-    while (curr)
+    int count = 0;
+    for (ASTNode *n = b->nodes; n; n = n->next)
+    {
+        count++;
+    }
+    ASTNode **order = xmalloc(sizeof(ASTNode *) * (count + 1));
+    count = 0;
+    for (ASTNode *n = b->nodes; n; n = n->next)
+    {
+        order[count++] = n;
+    }
+    order[count] = NULL;
+
+    for (int i = 0; i < count; i++)
     {
-        ASTNode *next = curr->next;
+        ASTNode *curr = order[i];
         curr->next = NULL;
 
         if (curr->type == NODE_INCLUDE)
@@ -3982,7 +4065,7 @@ char *run_comptime_block(ParserContext *ctx, Lexer *l)
         }
         else if (curr->type == NODE_STRUCT)
         {
-            emit_struct_defs(&cctx, curr, f);
+            emit_struct_defs(cctx, curr, f);
         }
         else if (curr->type == NODE_ENUM)
         {
@@ -3990,11 +4073,11 @@ char *run_comptime_block(ParserContext *ctx, Lexer *l)
         }
         else if (curr->type == NODE_CONST)
         {
-            emit_globals(&cctx, curr, f);
+            emit_globals(cctx, curr, f);
         }
         else if (curr->type == NODE_FUNCTION)
         {
-            codegen_node_single(&cctx, curr, f);
+            codegen_node_single(cctx, curr, f);
         }
         else if (curr->type == NODE_IMPL)
         {
@@ -4013,42 +4096,35 @@ char *run_comptime_block(ParserContext *ctx, Lexer *l)
             }
             stmts_tail = curr;
         }
-        curr = next;
     }
 
-    {
-        StructRef *ref = ctx->parsed_funcs_list;
-        while (ref)
-        {
-            ASTNode *fn = ref->node;
-            if (fn && fn->type == NODE_FUNCTION && fn->func.is_comptime)
-            {
-                emit_func_signature(ctx, f, fn, NULL);
-                fprintf(f, ";\n");
-                codegen_node_single(ctx, fn, f);
-            }
-            ref = ref->next;
-        }
-    }
-
-    fprintf(f, "int main() {\n");
-    curr = stmts;
-    while (curr)
+    fprintf(f, "%s {\n", entry);
+    for (ASTNode *curr = stmts; curr; curr = curr->next)
     {
         if (curr->type >= NODE_EXPR_BINARY && curr->type <= NODE_EXPR_SLICE)
         {
-            codegen_expression(&cctx, curr, f);
+            codegen_expression(cctx, curr, f);
             fprintf(f, ";\n");
         }
         else
         {
-            codegen_node_single(&cctx, curr, f);
+            codegen_node_single(cctx, curr, f);
         }
-        curr = curr->next;
     }
     fprintf(f, "return 0;\n}\n");
-    fclose(f);
 
+    // Restore the block as parsed, in case it has to be emitted again.
+    for (int i = 0; i < count; i++)
+    {
+        order[i]->next = order[i + 1];
+    }
+    free(order);
+}
+
+// Compiles and runs a generated program. Returns 0 on success, 1 if it did
+// not compile and 2 if it failed; *out and *err hold what it printed.
+static int comptime_compile_and_run(const char *filename, char **out, char **err)
+{
     char cmdbuf[4096];
     char bin[1024];
 
@@ -4063,34 +4139,348 @@ char *run_comptime_block(ParserContext *ctx, Lexer *l)
         strcat(cmdbuf, z_get_null_redirect());
     }
 
-    int res = system(cmdbuf);
-    if (res != 0)
-    {
-        zpanic_at(lexer_peek(l), "Comptime compilation failed for:\n%s", code);
-    }
-
+    int status = 0;
     char out_file[1024];
+    char err_file[1024];
     sprintf(out_file, "%s.out", filename);
-
-    // Execution command
-    sprintf(cmdbuf, "%s%s > %s", z_get_run_prefix(), bin, out_file);
+    sprintf(err_file, "%s.err", filename);
 
     if (system(cmdbuf) != 0)
     {
-        zpanic_at(lexer_peek(l), "Comptime execution failed");
+        status = 1;
     }
-
-    char *output_src = load_file(out_file);
-    if (!output_src)
+    else
+    {
+        // Execution command
+        sprintf(cmdbuf, "%s%s > %s 2> %s", z_get_run_prefix(), bin, out_file, err_file);
+        if (system(cmdbuf) != 0)
+        {
+            status = 2;
+        }
+        *out = load_file(out_file);
+        *err = load_file(err_file);
+    }
+    if (!*out)
     {
-        output_src = xstrdup(""); // Empty output is valid
+        *out = xstrdup(""); // Empty output is valid
+    }
+    if (!*err)
+    {
+        *err = xstrdup("");
     }
 
     remove(filename);
     remove(bin);
     remove(out_file);
-    free(code);
+    remove(err_file);
+    return status;
+}
+
+// Path of a block's cache entry, without extension, or NULL if caching is off.
+static char *comptime_cache_path(ParserContext *ctx, const char *code)
+{
+    if (g_config.no_comptime_cache)
+    {
+        return NULL;
+    }
+    const char *cache = z_get_cache_dir();
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    char dir[MAX_PATH_SIZE];
+    snprintf(dir, sizeof(dir), "%s/comptime", cache);
+    z_mkdir_p(dir);
+
+    // The prelude carries the @comptime functions the block may call.
+    FILE *f = z_tmpfile();
+    if (!f)
+    {
+        return NULL;
+    }
+    comptime_emit_prelude(ctx, f);
+    long len = ftell(f);
+    char *prelude = xmalloc(len + 1);
+    fseek(f, 0, SEEK_SET);
+    len = (long)fread(prelude, 1, len, f);
+    fclose(f);
+
+    unsigned long long h = hash_fnv1a_str(HASH_FNV1A_SEED, hash_toolchain_id());
+    h = hash_fnv1a(h, prelude, len + 1);
+    h = hash_fnv1a(h, code, strlen(code));
+    free(prelude);
+
+    char *path = xmalloc(MAX_PATH_SIZE + 32);
+    snprintf(path, MAX_PATH_SIZE + 32, "%s/%016llx", dir, h);
+    return path;
+}
+
+static void comptime_write_file(const char *path, const char *data)
+{
+    char tmp[MAX_PATH_SIZE + 64];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, z_get_pid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f)
+    {
+        return;
+    }
+    size_t len = strlen(data);
+    int ok = fwrite(data, 1, len, f) == len;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0)
+    {
+        remove(tmp);
+    }
+}
+
+static int comptime_cache_load(ParserContext *ctx, ComptimeBlock *b)
+{
+    char *base = comptime_cache_path(ctx, b->code);
+    if (!base)
+    {
+        return 0;
+    }
+    char path[MAX_PATH_SIZE + 64];
+    snprintf(path, sizeof(path), "%s.out", base);
+    b->out = load_file(path);
+    if (b->out)
+    {
+        snprintf(path, sizeof(path), "%s.err", base);
+        b->err = load_file(path);
+        if (!b->err)
+        {
+            b->err = xstrdup("");
+        }
+    }
+    free(base);
+    return b->out != NULL;
+}
+
+static void comptime_cache_store(ParserContext *ctx, ComptimeBlock *b)
+{
+    char *base = comptime_cache_path(ctx, b->code);
+    if (!base)
+    {
+        return;
+    }
+    char path[MAX_PATH_SIZE + 64];
+    // The output goes last: its presence marks a complete entry.
+    snprintf(path, sizeof(path), "%s.err", base);
+    comptime_write_file(path, b->err);
+    snprintf(path, sizeof(path), "%s.out", base);
+    comptime_write_file(path, b->out);
+    free(base);
+}
+
+// Compiles `first` together with every later comptime block of its source
+// that needs compiling, and leaves their results in g_comptime_ahead.
+// Returns 0 (and leaves the blocks to be compiled one by one) if there is
+// nothing to batch or the combined program fails.
+static int comptime_run_batch(ParserContext *ctx, Lexer *l, ComptimeBlock *first)
+{
+    for (ComptimeSource *s = g_comptime_batched; s; s = s->next)
+    {
+        if (s->src == l->src)
+        {
+            return 0;
+        }
+    }
+    ComptimeSource *seen = xmalloc(sizeof(ComptimeSource));
+    seen->src = l->src;
+    seen->next = g_comptime_batched;
+    g_comptime_batched = seen;
+
+    ComptimeBlock **tail = &g_comptime_ahead;
+    while (*tail)
+    {
+        tail = &(*tail)->next;
+    }
+    ComptimeBlock **ahead_start = tail;
+
+    Lexer scan = *l;
+    Token t;
+    while ((t = lexer_next(&scan)).type != TOK_EOF)
+    {
+        if (t.type != TOK_COMPTIME || lexer_peek(&scan).type != TOK_LBRACE)
+        {
+            continue;
+        }
+        ComptimeBlock *b = comptime_parse_block(comptime_read_block(&scan));
+        ComptimeEvalResult r = comptime_eval(b->nodes, &b->out, &b->err);
+        if (r != COMPTIME_EVAL_OK)
+        {
+            // A compile_error() is reported when the parser gets there.
+            free(b->err);
+            b->err = NULL;
+            b->needs_compile = r == COMPTIME_EVAL_UNSUPPORTED && !comptime_cache_load(ctx, b);
+        }
+        *tail = b;
+        tail = &b->next;
+    }
+
+    int count = 1;
+    for (ComptimeBlock *b = *ahead_start; b; b = b->next)
+    {
+        count += b->needs_compile;
+    }
+    if (count < 2)
+    {
+        return 0;
+    }
+
+    char filename[64];
+    sprintf(filename, "_tmp_comptime_%d.c", rand());
+    FILE *f = fopen(filename, "w");
+    if (!f)
+    {
+        return 0;
+    }
+
+    comptime_emit_prelude(ctx, f);
+    ComptimeBlock **batch = xmalloc(sizeof(ComptimeBlock *) * count);
+    int n = 0;
+    batch[n++] = first;
+    for (ComptimeBlock *b = *ahead_start; b; b = b->next)
+    {
+        if (b->needs_compile)
+        {
+            batch[n++] = b;
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        char entry[64];
+        sprintf(entry, "static int _zc_comptime_%d(void)", i);
+        comptime_emit_block(batch[i], f, entry);
+    }
+    fprintf(f, "int main() {\n");
+    for (int i = 0; i < n; i++)
+    {
+        fprintf(f, "if (_zc_comptime_%d() != 0) return 1;\n", i);
+        fprintf(f, "fflush(stdout); fputs(\"%s\", stdout); fflush(stdout);\n", COMPTIME_SEPARATOR);
+        fprintf(f, "fputs(\"%s\", stderr);\n", COMPTIME_SEPARATOR);
+    }
+    fprintf(f, "return 0;\n}\n");
+    fclose(f);
+
+    char *out = NULL, *err = NULL;
+    int ok = comptime_compile_and_run(filename, &out, &err) == 0;
+
+    // Split the output at the separators printed after each block.
+    char *out_part = out, *err_part = err;
+    for (int i = 0; ok && i < n; i++)
+    {
+        char *out_end = strstr(out_part, COMPTIME_SEPARATOR);
+        char *err_end = strstr(err_part, COMPTIME_SEPARATOR);
+        if (!out_end || !err_end)
+        {
+            ok = 0;
+            break;
+        }
+        *out_end = 0;
+        *err_end = 0;
+        batch[i]->out = xstrdup(out_part);
+        batch[i]->err = xstrdup(err_part);
+        out_part = out_end + strlen(COMPTIME_SEPARATOR);
+        err_part = err_end + strlen(COMPTIME_SEPARATOR);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (ok)
+        {
+            comptime_cache_store(ctx, batch[i]);
+        }
+        else if (batch[i] != first)
+        {
+            free(batch[i]->out);
+            free(batch[i]->err);
+            batch[i]->out = NULL;
+            batch[i]->err = NULL;
+        }
+    }
+    if (!ok)
+    {
+        free(first->out);
+        free(first->err);
+        first->out = NULL;
+        first->err = NULL;
+    }
+    free(batch);
+    free(out);
+    free(err);
+    return ok;
+}
+
+// Compiling blocks goes through shared temporary and cache files.
+static pthread_mutex_t comptime_compile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Helper: Execute comptime block and return generated source
+char *run_comptime_block(ParserContext *ctx, Lexer *l)
+{
+    expect(l, TOK_COMPTIME, "comptime");
+    char *code = comptime_read_block(l);
+
+    ComptimeBlock *b = comptime_take_ahead(code);
+    if (b)
+    {
+        free(code);
+    }
+    else
+    {
+        b = comptime_parse_block(code);
+    }
+
+    if (!b->out)
+    {
+        ComptimeEvalResult r = comptime_eval(b->nodes, &b->out, &b->err);
+        if (r == COMPTIME_EVAL_FAILED)
+        {
+            fputs(b->err, stderr);
+            zpanic_at(lexer_peek(l), "Comptime execution failed");
+        }
+        if (r == COMPTIME_EVAL_UNSUPPORTED)
+        {
+            pthread_mutex_lock(&comptime_compile_lock);
+        }
+        if (r == COMPTIME_EVAL_UNSUPPORTED && !comptime_cache_load(ctx, b) &&
+            !comptime_run_batch(ctx, l, b))
+        {
+            char filename[64];
+            sprintf(filename, "_tmp_comptime_%d.c", rand());
+            FILE *f = fopen(filename, "w");
+            if (!f)
+            {
+                zpanic_at(lexer_peek(l), "Could not create temp file %s", filename);
+            }
+            comptime_emit_prelude(ctx, f);
+            comptime_emit_block(b, f, "int main()");
+            fclose(f);
+
+            int status = comptime_compile_and_run(filename, &b->out, &b->err);
+            fputs(b->err, stderr);
+            if (status == 1)
+            {
+                zpanic_at(lexer_peek(l), "Comptime compilation failed for:\n%s", b->code);
+            }
+            if (status == 2)
+            {
+                zpanic_at(lexer_peek(l), "Comptime execution failed");
+            }
+            comptime_cache_store(ctx, b);
+            b->err[0] = 0;
+        }
+        if (r == COMPTIME_EVAL_UNSUPPORTED)
+        {
+            pthread_mutex_unlock(&comptime_compile_lock);
+        }
+    }
 
+    fputs(b->err, stderr);
+    char *output_src = b->out;
+    free(b->err);
+    free(b->code);
+    free(b);
     return output_src;
 }
 
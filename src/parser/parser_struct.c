@@ -11,8 +11,9 @@
 #include "../zen/zen_facts.h"
 #include "zprep_plugin.h"
 #include "../codegen/codegen.h"
+#include "../utils/cmd.h"
 
-extern char *g_current_filename;
+extern ZC_THREAD_LOCAL char *g_current_filename;
 
 /**
  * @brief Auto-imports std/mem.zc if not already imported.
@@ -1259,3 +1260,423 @@ ASTNode *parse_enum(ParserContext *ctx, Lexer *l)
 
     return node;
 }
+
+// ** @derive(Json) **
+
+typedef enum
+{
+    JSON_FIELD_SKIP,
+    JSON_FIELD_INT,
+    JSON_FIELD_FLOAT,
+    JSON_FIELD_BOOL,
+    JSON_FIELD_CSTR,
+    JSON_FIELD_STRING,
+    JSON_FIELD_STRUCT,
+    JSON_FIELD_VEC
+} JsonFieldKind;
+
+static JsonFieldKind json_scalar_kind(ParserContext *ctx, const char *t)
+{
+    static const char *ints[] = {
+        "int",     "i8",      "i16",      "i32",      "i64",      "u8",      "u16",
+        "u32",     "u64",     "isize",    "usize",    "I8",       "I16",     "I32",
+        "I64",     "U8",      "U16",      "U32",      "U64",      "int8_t",  "int16_t",
+        "int32_t", "int64_t", "uint8_t",  "uint16_t", "uint32_t", "uint64_t", "size_t",
+        "c_int",   "c_uint",  "c_long",   "c_ulong",  "long",     "short",   NULL};
+    for (int i = 0; ints[i]; i++)
+    {
+        if (0 == strcmp(t, ints[i]))
+        {
+            return JSON_FIELD_INT;
+        }
+    }
+    if (0 == strcmp(t, "double") || 0 == strcmp(t, "float") || 0 == strcmp(t, "f32") ||
+        0 == strcmp(t, "f64"))
+    {
+        return JSON_FIELD_FLOAT;
+    }
+    if (0 == strcmp(t, "bool"))
+    {
+        return JSON_FIELD_BOOL;
+    }
+    if (0 == strcmp(t, "char*") || 0 == strcmp(t, "string"))
+    {
+        return JSON_FIELD_CSTR;
+    }
+    if (0 == strcmp(t, "String"))
+    {
+        return JSON_FIELD_STRING;
+    }
+    ASTNode *def = find_struct_def(ctx, t);
+    if (def && def->type == NODE_STRUCT)
+    {
+        return JSON_FIELD_STRUCT;
+    }
+    return JSON_FIELD_SKIP;
+}
+
+// Element type of a Vec field into `out`, or 0 if `t` is not a Vec. Field
+// types arrive mangled ("Vec<i64>" is "Vec_int64_t").
+static int json_vec_elem(const char *t, char *out, size_t cap)
+{
+    if (strncmp(t, "Vec_", 4) != 0 || strlen(t + 4) >= cap)
+    {
+        return 0;
+    }
+    if (0 == strcmp(t + 4, "charPtr"))
+    {
+        snprintf(out, cap, "char*");
+        return 1;
+    }
+    strcpy(out, t + 4);
+    return 1;
+}
+
+// Perfect hash over the field names:
+//   slot = (len * m1 + name[0] * m2 + name[len - 1]) % size
+// The smallest table (then multipliers) that separates every name wins,
+// so a lookup is one slot computation and a single memcmp. Returns 0 if
+// no such hash exists (names sharing length, first and last byte).
+static int json_field_hash(char **names, int count, int *size, int *m1, int *m2)
+{
+    char used[512];
+    for (int sz = count; sz <= 4 * count + 8 && sz <= (int)sizeof(used); sz++)
+    {
+        for (int a = 1; a < 32; a++)
+        {
+            for (int b = 1; b < 32; b++)
+            {
+                memset(used, 0, (size_t)sz);
+                int ok = 1;
+                for (int i = 0; i < count && ok; i++)
+                {
+                    size_t len = strlen(names[i]);
+                    unsigned h = (unsigned)(len * a + (unsigned char)names[i][0] * b +
+                                            (unsigned char)names[i][len - 1]) %
+                                 (unsigned)sz;
+                    ok = !used[h];
+                    used[h] = 1;
+                }
+                if (ok)
+                {
+                    *size = sz;
+                    *m1 = a;
+                    *m2 = b;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Decodes the value whose first event is in `ev` into `dst`.
+static void json_emit_decode(CmdBuilder *b, const char *sname, const char *fname,
+                             JsonFieldKind kind, const char *type, const char *ev, const char *dst)
+{
+    const char *want = NULL;
+    char assign[600];
+    switch (kind)
+    {
+    case JSON_FIELD_INT:
+    case JSON_FIELD_FLOAT:
+        want = "NUMBER";
+        snprintf(assign, sizeof(assign), "%s = (%s)r.number();", dst, type);
+        break;
+    case JSON_FIELD_BOOL:
+        want = "BOOL";
+        snprintf(assign, sizeof(assign), "%s = r.bool();", dst);
+        break;
+    case JSON_FIELD_CSTR:
+        want = "STRING";
+        snprintf(assign, sizeof(assign), "free(%s); %s = strdup(r.text());", dst, dst);
+        break;
+    case JSON_FIELD_STRING:
+        want = "STRING";
+        snprintf(assign, sizeof(assign), "%s.free(); %s = String::from_bytes(r.text(), r.text_len());",
+                 dst, dst);
+        break;
+    case JSON_FIELD_STRUCT:
+        cmd_add_fmt(b,
+                    "if (%s.tag != JsonEvent::NULL_VALUE().tag) { "
+                    "let _sub = %s::read_json_event(r, %s); "
+                    "if (_sub.is_err()) { return Result<%s>::Err(_sub.err); } "
+                    "%s = _sub.unwrap(); }",
+                    ev, type, ev, sname, dst);
+        return;
+    default:
+        return;
+    }
+    // null leaves the field at its zero value.
+    cmd_add_fmt(b,
+                "if (%s.tag == JsonEvent::%s().tag) { %s } "
+                "else if (%s.tag != JsonEvent::NULL_VALUE().tag) { "
+                "return Result<%s>::Err(\"%s.%s: expected %s\"); }",
+                ev, want, assign, ev, sname, sname, fname,
+                0 == strcmp(want, "NUMBER") ? "a number" : 0 == strcmp(want, "BOOL") ? "a bool" : "a string");
+}
+
+static void json_emit_encode(CmdBuilder *b, JsonFieldKind kind, const char *src)
+{
+    switch (kind)
+    {
+    case JSON_FIELD_INT:
+        cmd_add_fmt(b, "w.integer((i64)%s);", src);
+        break;
+    case JSON_FIELD_FLOAT:
+        cmd_add_fmt(b, "w.number((double)%s);", src);
+        break;
+    case JSON_FIELD_BOOL:
+        cmd_add_fmt(b, "w.bool(%s);", src);
+        break;
+    case JSON_FIELD_CSTR:
+        cmd_add_fmt(b, "if (%s == NULL) { w.null(); } else { w.string(%s); }", src, src);
+        break;
+    case JSON_FIELD_STRING:
+        cmd_add_fmt(b,
+                    "if (%s.vec.data == NULL) { w.string_bytes(\"\", 0); } "
+                    "else { w.string_bytes(%s.c_str(), %s.length()); }",
+                    src, src, src);
+        break;
+    case JSON_FIELD_STRUCT:
+        cmd_add_fmt(b, "%s.write_json(w);", src);
+        break;
+    default:
+        break;
+    }
+}
+
+char *generate_json_derive(ParserContext *ctx, ASTNode *strct)
+{
+    if (strct->type != NODE_STRUCT)
+    {
+        zwarn_at(strct->token, "@derive(Json) only works on structs");
+        return NULL;
+    }
+    char *name = strct->strct.name;
+
+    int count = 0;
+    for (ASTNode *f = strct->strct.fields; f; f = f->next)
+    {
+        if (f->type == NODE_FIELD && f->field.name && f->field.type)
+        {
+            count++;
+        }
+    }
+
+    char **names = xcalloc(count + 1, sizeof(char *));
+    char **types = xcalloc(count + 1, sizeof(char *));
+    char **elems = xcalloc(count + 1, sizeof(char *));
+    JsonFieldKind *kinds = xcalloc(count + 1, sizeof(JsonFieldKind));
+    JsonFieldKind *elem_kinds = xcalloc(count + 1, sizeof(JsonFieldKind));
+    int n = 0;
+    for (ASTNode *f = strct->strct.fields; f; f = f->next)
+    {
+        if (f->type != NODE_FIELD || !f->field.name || !f->field.type)
+        {
+            continue;
+        }
+        char elem[256];
+        JsonFieldKind kind = JSON_FIELD_SKIP;
+        JsonFieldKind ek = JSON_FIELD_SKIP;
+        if (json_vec_elem(f->field.type, elem, sizeof(elem)))
+        {
+            ek = json_scalar_kind(ctx, elem);
+            if (ek != JSON_FIELD_SKIP)
+            {
+                kind = JSON_FIELD_VEC;
+            }
+        }
+        else
+        {
+            kind = json_scalar_kind(ctx, f->field.type);
+        }
+        if (kind == JSON_FIELD_SKIP)
+        {
+            zwarn_at(f->token, "@derive(Json): field '%s' of type '%s' is not serializable; skipped",
+                     f->field.name, f->field.type);
+            continue;
+        }
+        names[n] = f->field.name;
+        types[n] = f->field.type;
+        elems[n] = kind == JSON_FIELD_VEC ? xstrdup(elem) : NULL;
+        kinds[n] = kind;
+        elem_kinds[n] = ek;
+        n++;
+    }
+
+    CmdBuilder b;
+    cmd_init(&b);
+    cmd_add_fmt(&b, "impl %s {", name);
+
+    // Encoding goes straight to a JsonWriter; no JsonValue is built.
+    cmd_add(&b, "fn write_json(self, w: JsonWriter*) { w.begin_object();");
+    for (int i = 0; i < n; i++)
+    {
+        cmd_add_fmt(&b, "w.key(\"%s\");", names[i]);
+        char src[300];
+        snprintf(src, sizeof(src), "self.%s", names[i]);
+        if (kinds[i] == JSON_FIELD_VEC)
+        {
+            cmd_add_fmt(&b, "w.begin_array(); for (let _i: usize = 0; _i < %s.length(); _i = _i + 1) {",
+                        src);
+            // Elements are used in place: a copy of a struct with Drop
+            // fields would be dropped at the end of the iteration.
+            char item[320];
+            snprintf(item, sizeof(item), "%s.data[_i]", src);
+            json_emit_encode(&b, elem_kinds[i], item);
+            cmd_add(&b, "} w.end_array();");
+        }
+        else
+        {
+            json_emit_encode(&b, kinds[i], src);
+        }
+    }
+    cmd_add(&b, "w.end_object(); }");
+
+    cmd_add_fmt(&b,
+                "fn to_json_string(self) -> String { let _w = JsonWriter::new(); "
+                "self.write_json(&_w); return _w.take(); }");
+
+    // Decoding pulls events from a JsonReader. Keys are resolved with the
+    // perfect hash above, or by switching on the length when there is none,
+    // then each field reads its own value.
+    int size = 0, m1 = 0, m2 = 0;
+    int hashed = n > 0 && json_field_hash(names, n, &size, &m1, &m2);
+    unsigned *slots = xcalloc(n + 1, sizeof(unsigned));
+    for (int i = 0; i < n; i++)
+    {
+        size_t len = strlen(names[i]);
+        slots[i] = hashed ? (unsigned)(len * m1 + (unsigned char)names[i][0] * m2 +
+                                       (unsigned char)names[i][len - 1]) %
+                                (unsigned)size
+                          : (unsigned)len;
+    }
+
+    cmd_add_fmt(&b, "fn read_json_event(r: JsonReader*, ev: JsonEvent) -> Result<%s> {", name);
+    cmd_add_fmt(&b, "let _out: %s;", name);
+    cmd_add_fmt(&b,
+                "if (ev.tag != JsonEvent::BEGIN_OBJECT().tag) { "
+                "return Result<%s>::Err(\"%s: expected an object\"); }",
+                name, name);
+    cmd_add(&b, "loop { let _e = r.next();");
+    cmd_add(&b, "if (_e.tag == JsonEvent::END_OBJECT().tag) { break; }");
+    // The reader enforces the grammar, so anything but a key is an error.
+    cmd_add_fmt(&b,
+                "if (_e.tag != JsonEvent::KEY().tag) { return Result<%s>::Err(r.error()); }",
+                name);
+    cmd_add(&b, "let _k = r.text(); let _n = r.text_len(); let _field = -1;");
+    if (n > 0)
+    {
+        if (hashed)
+        {
+            cmd_add_fmt(&b,
+                        "let _slot: usize = 0; if (_n > 0) { _slot = (_n * %d + (usize)(u8)_k[0] * "
+                        "%d + (usize)(u8)_k[_n - 1]) %% %d; }",
+                        m1, m2, size);
+        }
+        else
+        {
+            cmd_add(&b, "let _slot: usize = _n;");
+        }
+        cmd_add(&b, "match _slot {");
+        for (int i = 0; i < n; i++)
+        {
+            int first_in_slot = 1;
+            for (int j = 0; j < i; j++)
+            {
+                if (slots[j] == slots[i])
+                {
+                    first_in_slot = 0;
+                }
+            }
+            if (!first_in_slot)
+            {
+                continue;
+            }
+            cmd_add_fmt(&b, "%u => {", slots[i]);
+            for (int j = i; j < n; j++)
+            {
+                if (slots[j] != slots[i])
+                {
+                    continue;
+                }
+                size_t len = strlen(names[j]);
+                cmd_add_fmt(&b,
+                            "if (_n == %zu && memcmp(_k, \"%s\", %zu) == 0) { _field = %d; }", len,
+                            names[j], len, j);
+            }
+            cmd_add(&b, "},");
+        }
+        cmd_add(&b, "_ => {} }");
+    }
+    free(slots);
+    cmd_add(&b, "let _v = r.next();");
+    cmd_add_fmt(&b,
+                "if (_v.tag == JsonEvent::ERROR().tag) { "
+                "return Result<%s>::Err(r.error()); }",
+                name);
+    cmd_add(&b, "match _field {");
+    for (int i = 0; i < n; i++)
+    {
+        char dst[300];
+        snprintf(dst, sizeof(dst), "_out.%s", names[i]);
+        cmd_add_fmt(&b, "%d => {", i);
+        if (kinds[i] == JSON_FIELD_VEC)
+        {
+            cmd_add_fmt(&b,
+                        "if (_v.tag == JsonEvent::BEGIN_ARRAY().tag) { "
+                        "loop { let _ve = r.next(); "
+                        "if (_ve.tag == JsonEvent::END_ARRAY().tag) { break; } "
+                        "let _elem: %s;",
+                        elems[i]);
+            json_emit_decode(&b, name, names[i], elem_kinds[i], elems[i], "_ve", "_elem");
+            cmd_add_fmt(&b,
+                        "%s.push(_elem); } } "
+                        "else if (_v.tag != JsonEvent::NULL_VALUE().tag) { "
+                        "return Result<%s>::Err(\"%s.%s: expected an array\"); }",
+                        dst, name, name, names[i]);
+        }
+        else
+        {
+            json_emit_decode(&b, name, names[i], kinds[i], types[i], "_v", dst);
+        }
+        cmd_add(&b, "},");
+    }
+    cmd_add_fmt(&b,
+                "_ => { if (!r.skip_value()) { return Result<%s>::Err(r.error()); } } }",
+                name);
+    cmd_add_fmt(&b, "} return Result<%s>::Ok(_out); }", name);
+
+    cmd_add_fmt(&b,
+                "fn read_json(r: JsonReader*) -> Result<%s> { "
+                "let _ev = r.next(); "
+                "if (_ev.tag == JsonEvent::ERROR().tag) { return Result<%s>::Err(r.error()); } "
+                "if (_ev.tag == JsonEvent::END().tag) { return Result<%s>::Err(\"end of input\"); } "
+                "return %s::read_json_event(r, _ev); }",
+                name, name, name, name);
+
+    cmd_add_fmt(&b,
+                "fn from_json_string(s: char*) -> Result<%s> { "
+                "let _r = JsonReader::from_str(s); "
+                "let _res = %s::read_json(&_r); "
+                "if (_res.is_ok() && _r.next().tag != JsonEvent::END().tag) { "
+                "return Result<%s>::Err(\"%s: trailing data\"); } "
+                "return _res; }",
+                name, name, name, name);
+    cmd_add(&b, "}");
+
+    for (int i = 0; i < n; i++)
+    {
+        free(elems[i]);
+    }
+    free(names);
+    free(types);
+    free(elems);
+    free(kinds);
+    free(elem_kinds);
+
+    char *code = xstrdup(cmd_to_string(&b));
+    cmd_free(&b);
+    return code;
+}
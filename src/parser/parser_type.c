@@ -2,6 +2,7 @@
 #include "../ast/ast.h"
 #include "analysis/const_fold.h"
 #include "parser.h"
+#include "utils/embed.h"
 
 Type *parse_type_base(ParserContext *ctx, Lexer *l)
 {
@@ -1104,6 +1105,37 @@ char *parse_tuple_literal(ParserContext *ctx, Lexer *l, const char *tn)
     free(c);
     return o;
 }
+// Whether an embed of this type is just the file's bytes: a char slice, a
+// string, or an array of one-byte elements.
+static int embed_type_is_bytes(Type *t)
+{
+    if (!t)
+    {
+        return 1;
+    }
+    if (t->kind == TYPE_STRING || (t->kind == TYPE_POINTER && t->inner &&
+                                   (t->inner->kind == TYPE_CHAR || t->inner->kind == TYPE_C_CHAR)))
+    {
+        return 1;
+    }
+    if (t->kind != TYPE_ARRAY || !t->inner)
+    {
+        return 0;
+    }
+    switch (t->inner->kind)
+    {
+    case TYPE_CHAR:
+    case TYPE_I8:
+    case TYPE_U8:
+    case TYPE_BYTE:
+    case TYPE_C_CHAR:
+    case TYPE_C_UCHAR:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
 ASTNode *parse_embed(ParserContext *ctx, Lexer *l)
 {
     lexer_next(l);
@@ -1137,7 +1169,25 @@ ASTNode *parse_embed(ParserContext *ctx, Lexer *l)
     fread(b, 1, len, f);
     fclose(f);
 
-    size_t oc = len * 6 + 256;
+    // Large byte assets become a symbol holding the bytes (see utils/embed.h)
+    // rather than an initializer the C compiler has to parse. Arrays and
+    // slices are writable, so they get a copy of the shared bytes; a global
+    // can't be initialized with one and stays inline.
+    int writable = !target_type || target_type->kind == TYPE_ARRAY;
+    int global = !ctx->current_scope || !ctx->current_scope->parent;
+    const char *sym = NULL;
+    if (len > EMBED_INLINE_MAX && embed_type_is_bytes(target_type) && !(writable && global))
+    {
+        sym = embed_large(ctx, fn, b, len);
+    }
+    char copy[512] = {0};
+    if (sym && writable)
+    {
+        snprintf(copy, sizeof(copy), "memcpy(%s, %s, %ld)", embed_writable(ctx, sym, len), sym,
+                 len + 1);
+    }
+
+    size_t oc = sym ? 512 : len * 6 + 256;
     char *o = xmalloc(oc);
 
     // Default Type if none
@@ -1150,7 +1200,14 @@ ASTNode *parse_embed(ParserContext *ctx, Lexer *l)
         slice_type->name = xstrdup("Slice_char");
         target_type = slice_type;
 
-        sprintf(o, "(Slice_char){.data=(char[]){");
+        if (sym)
+        {
+            sprintf(o, "(Slice_char){.data=(char*)%s,.len=%ld,.cap=%ld}", copy, len, len);
+        }
+        else
+        {
+            sprintf(o, "(Slice_char){.data=(char[]){");
+        }
     }
     else
     {
@@ -1164,7 +1221,14 @@ ASTNode *parse_embed(ParserContext *ctx, Lexer *l)
             {
                 Type *ptr_type = type_new_ptr(target_type->inner); // Reuse inner
                 target_type = ptr_type;
-                sprintf(o, "(%s[]){", inner_ts);
+                if (sym)
+                {
+                    sprintf(o, "((%s*)%s)", inner_ts, copy);
+                }
+                else
+                {
+                    sprintf(o, "(%s[]){", inner_ts);
+                }
             }
             else
             {
@@ -1175,13 +1239,25 @@ ASTNode *parse_embed(ParserContext *ctx, Lexer *l)
                 Type *slice_t = type_new(TYPE_STRUCT);
                 slice_t->name = xstrdup(slice_name);
                 target_type = slice_t;
-                sprintf(o, "(%s){.data=(%s[]){", slice_name, inner_ts);
+                if (sym)
+                {
+                    sprintf(o, "(%s){.data=(%s*)%s,.len=%ld,.cap=%ld}", slice_name, inner_ts,
+                            copy, len, len);
+                }
+                else
+                {
+                    sprintf(o, "(%s){.data=(%s[]){", slice_name, inner_ts);
+                }
             }
             free(inner_ts);
         }
         else
         {
-            if (strcmp(ts, "string") == 0 || strcmp(ts, "char*") == 0)
+            if (sym)
+            {
+                sprintf(o, "((char*)%s)", sym);
+            }
+            else if (strcmp(ts, "string") == 0 || strcmp(ts, "char*") == 0)
             {
                 sprintf(o, "(char*)\"");
             }
@@ -1193,6 +1269,15 @@ ASTNode *parse_embed(ParserContext *ctx, Lexer *l)
         free(ts);
     }
 
+    if (sym)
+    {
+        // `b` stays with the embed, to compare later assets against.
+        ASTNode *n = ast_create(NODE_RAW_STMT);
+        n->raw_stmt.content = o;
+        n->type_info = target_type;
+        return n;
+    }
+
     char *p = o + strlen(o);
 
     // Check if string mode
@@ -1560,12 +1560,13 @@ char *replace_type_str(const char *src, const char *param, const char *concrete,
         p_suffix[0] = 0;
 
         char *p_temp = xstrdup(param);
-        char *tok = strtok(p_temp, ",");
+        char *saveptr;
+        char *tok = strtok_r(p_temp, ",", &saveptr);
         while (tok)
         {
             strcat(p_suffix, "_");
             strcat(p_suffix, tok);
-            tok = strtok(NULL, ",");
+            tok = strtok_r(NULL, ",", &saveptr);
         }
         free(p_temp);
 
@@ -1579,14 +1580,14 @@ char *replace_type_str(const char *src, const char *param, const char *concrete,
             c_suffix[0] = 0;
 
             char *c_temp = xstrdup(concrete);
-            tok = strtok(c_temp, ",");
+            tok = strtok_r(c_temp, ",", &saveptr);
             while (tok)
             {
                 strcat(c_suffix, "_");
                 char *clean = sanitize_mangled_name(tok);
                 strcat(c_suffix, clean);
                 free(clean);
-                tok = strtok(NULL, ",");
+                tok = strtok_r(NULL, ",", &saveptr);
             }
             free(c_temp);
 
@@ -1844,12 +1845,13 @@ Type *replace_type_formal(Type *t, const char *p, const char *c, const char *os,
             p_suffix[0] = 0;
 
             char *p_temp = xstrdup(p);
-            char *tok = strtok(p_temp, ",");
+            char *saveptr;
+            char *tok = strtok_r(p_temp, ",", &saveptr);
             while (tok)
             {
                 strcat(p_suffix, "_");
                 strcat(p_suffix, tok);
-                tok = strtok(NULL, ",");
+                tok = strtok_r(NULL, ",", &saveptr);
             }
             free(p_temp);
 
@@ -1861,14 +1863,14 @@ Type *replace_type_formal(Type *t, const char *p, const char *c, const char *os,
                 char c_suffix[1024];
                 c_suffix[0] = 0;
                 char *c_temp = xstrdup(c);
-                tok = strtok(c_temp, ",");
+                tok = strtok_r(c_temp, ",", &saveptr);
                 while (tok)
                 {
                     strcat(c_suffix, "_");
                     char *clean = sanitize_mangled_name(tok);
                     strcat(c_suffix, clean);
                     free(clean);
-                    tok = strtok(NULL, ",");
+                    tok = strtok_r(NULL, ",", &saveptr);
                 }
                 free(c_temp);
 
@@ -1892,7 +1894,8 @@ Type *replace_type_formal(Type *t, const char *p, const char *c, const char *os,
         }
     }
 
-    if (t->kind == TYPE_POINTER || t->kind == TYPE_ARRAY)
+    // For a function type, inner is the return type.
+    if (t->kind == TYPE_POINTER || t->kind == TYPE_ARRAY || t->kind == TYPE_FUNCTION)
     {
         n->inner = replace_type_formal(t->inner, p, c, os, ns);
     }
@@ -2599,12 +2602,13 @@ char *instantiate_function_template(ParserContext *ctx, const char *name, const
         char param_suffix[256];
         param_suffix[0] = 0;
         char *tmp = xstrdup(tpl->generic_param);
-        char *tokp = strtok(tmp, ",");
+        char *saveptr;
+        char *tokp = strtok_r(tmp, ",", &saveptr);
         while (tokp)
         {
             strcat(param_suffix, "_");
             strcat(param_suffix, tokp);
-            tokp = strtok(NULL, ",");
+            tokp = strtok_r(NULL, ",", &saveptr);
         }
         free(tmp);
 
@@ -2644,11 +2648,11 @@ char *instantiate_function_template(ParserContext *ctx, const char *name, const
                 char **args = xmalloc(sizeof(char *) * template_param_count);
                 int arg_count = 0;
                 char *types_copy = xstrdup(types_src);
-                char *tok = strtok(types_copy, ",");
+                char *tok = strtok_r(types_copy, ",", &saveptr);
                 while (tok && arg_count < template_param_count)
                 {
                     args[arg_count++] = xstrdup(tok);
-                    tok = strtok(NULL, ",");
+                    tok = strtok_r(NULL, ",", &saveptr);
                 }
                 free(types_copy);
 
@@ -2800,6 +2804,7 @@ char *process_fstring(ParserContext *ctx, const char *content, char ***used_syms
         Lexer expr_lex;
         lexer_init(&expr_lex, expr_str);
         ASTNode *expr_node = parse_expression(ctx, &expr_lex);
+        fold_expr(ctx, expr_node);
 
         // Codegen expression to temporary buffer
         char *code_buffer = NULL;
@@ -3199,6 +3204,7 @@ void instantiate_generic(ParserContext *ctx, const char *tpl, const char *arg,
     if (!t)
     {
         zpanic_at(token, "Unknown generic: %s", tpl);
+        return; // Reached when parsing fault-tolerantly (the LSP).
     }
 
     Instantiation *ni = xmalloc(sizeof(Instantiation));
@@ -3373,6 +3379,7 @@ void instantiate_generic_multi(ParserContext *ctx, const char *tpl, char **args,
     if (!t)
     {
         zpanic_at(token, "Unknown generic: %s", tpl);
+        return; // Reached when parsing fault-tolerantly (the LSP).
     }
 
     // Register instantiation first (to break cycles)
@@ -19,4 +19,12 @@ typedef SSIZE_T ssize_t;
 #define strcasecmp _stricmp
 #endif
 
+// Per-thread state: the parser runs on several threads when the language
+// server indexes a workspace.
+#ifdef _MSC_VER
+#define ZC_THREAD_LOCAL __declspec(thread)
+#else
+#define ZC_THREAD_LOCAL _Thread_local
+#endif
+
 #endif // ZC_PLATFORM_LANG_H
@@ -12,7 +12,9 @@
 #else
 #include <unistd.h>
 #include <time.h>
+#include <poll.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
 #endif
 
 void z_setup_terminal(void)
@@ -116,6 +118,132 @@ const char *z_get_temp_dir(void)
 #endif
 }
 
+int z_mkdir_p(char *path)
+{
+    for (char *p = path + 1; *p; p++)
+    {
+        if (*p != '/')
+        {
+            continue;
+        }
+        *p = 0;
+#if ZC_OS_WINDOWS
+        _mkdir(path);
+#else
+        mkdir(path, 0755);
+#endif
+        *p = '/';
+    }
+#if ZC_OS_WINDOWS
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+
+#if ZC_OS_WINDOWS
+    DWORD attr = GetFileAttributesA(path);
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+const char *z_get_cache_dir(void)
+{
+    static char dir[MAX_PATH_SIZE] = {0};
+    static int tried = 0;
+    if (tried)
+    {
+        return dir[0] ? dir : NULL;
+    }
+    tried = 1;
+
+    const char *env = getenv("ZC_CACHE_DIR");
+    if (env && env[0])
+    {
+        snprintf(dir, sizeof(dir), "%s", env);
+    }
+#if ZC_OS_WINDOWS
+    else if ((env = getenv("LOCALAPPDATA")) && env[0])
+    {
+        snprintf(dir, sizeof(dir), "%s/zenc", env);
+    }
+#else
+    else if ((env = getenv("XDG_CACHE_HOME")) && env[0])
+    {
+        snprintf(dir, sizeof(dir), "%s/zenc", env);
+    }
+    else if ((env = getenv("HOME")) && env[0])
+    {
+        snprintf(dir, sizeof(dir), "%s/.cache/zenc", env);
+    }
+#endif
+    else
+    {
+        snprintf(dir, sizeof(dir), "%s/zenc-cache", z_get_temp_dir());
+    }
+
+    for (char *p = dir; *p; p++)
+    {
+        if (*p == '\\')
+        {
+            *p = '/';
+        }
+    }
+    if (!z_mkdir_p(dir))
+    {
+        dir[0] = 0;
+        return NULL;
+    }
+    return dir;
+}
+
+int z_copy_file(const char *from, const char *to)
+{
+    FILE *in = fopen(from, "rb");
+    if (!in)
+    {
+        return 0;
+    }
+    char tmp[MAX_PATH_SIZE + 64];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", to, z_get_pid());
+    FILE *out = fopen(tmp, "wb");
+    if (!out)
+    {
+        fclose(in);
+        return 0;
+    }
+    char buf[65536];
+    size_t n;
+    int ok = 1;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+    {
+        ok = fwrite(buf, 1, n, out) == n;
+    }
+    ok = !ferror(in) && ok;
+    fclose(in);
+    ok = (fclose(out) == 0) && ok;
+#if !ZC_OS_WINDOWS
+    struct stat st;
+    if (ok && stat(from, &st) == 0)
+    {
+        chmod(tmp, st.st_mode & 07777);
+    }
+#endif
+    // The copy is renamed into place, so an interrupted copy never leaves a
+    // truncated file behind.
+#if ZC_OS_WINDOWS
+    remove(to);
+#endif
+    if (!ok || rename(tmp, to) != 0)
+    {
+        remove(tmp);
+        return 0;
+    }
+    return 1;
+}
+
 int z_get_pid(void)
 {
 #if ZC_OS_WINDOWS
@@ -144,6 +272,18 @@ void z_get_executable_path(char *buffer, size_t size)
 #endif
 }
 
+int z_get_cpu_count(void)
+{
+#if ZC_OS_WINDOWS
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int n = (int)info.dwNumberOfProcessors;
+#else
+    int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return n > 0 ? n : 1;
+}
+
 int z_isatty(int fd)
 {
 #if ZC_OS_WINDOWS
@@ -153,6 +293,41 @@ int z_isatty(int fd)
 #endif
 }
 
+int z_wait_readable(int fd, int timeout_ms)
+{
+#if ZC_OS_WINDOWS
+    HANDLE h = (HANDLE)_get_osfhandle(fd);
+    DWORD type = GetFileType(h);
+    if (type == FILE_TYPE_PIPE)
+    {
+        // Pipes are not waitable handles: poll them for buffered bytes.
+        DWORD start = GetTickCount();
+        while (1)
+        {
+            DWORD avail = 0;
+            if (!PeekNamedPipe(h, NULL, 0, NULL, &avail, NULL) || avail > 0)
+            {
+                return 1; // Data, or a broken pipe the next read reports.
+            }
+            if (timeout_ms >= 0 && (int)(GetTickCount() - start) >= timeout_ms)
+            {
+                return 0;
+            }
+            Sleep(1);
+        }
+    }
+    if (type == FILE_TYPE_DISK)
+    {
+        return 1;
+    }
+    DWORD wait = timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms;
+    return WaitForSingleObject(h, wait) == WAIT_OBJECT_0;
+#else
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, timeout_ms) > 0;
+#endif
+}
+
 int z_match_os(const char *os_name)
 {
     if (!os_name)
@@ -132,11 +132,44 @@ double z_get_monotonic_time(void);
  */
 const char *z_get_temp_dir(void);
 
+/**
+ * @brief Get the directory zc caches build artefacts in, creating it.
+ *
+ * `$ZC_CACHE_DIR`, else `$XDG_CACHE_HOME/zenc` or `~/.cache/zenc`
+ * (`%LOCALAPPDATA%/zenc` on Windows).
+ *
+ * @return The directory, or NULL if it cannot be created.
+ */
+const char *z_get_cache_dir(void);
+
+/**
+ * @brief Create @p path and each missing directory along it.
+ *
+ * @p path uses '/' separators; it is modified during the call and restored.
+ * @return 1 if @p path is a directory afterwards, 0 otherwise.
+ */
+int z_mkdir_p(char *path);
+
+/**
+ * @brief Copy a file, keeping its permissions.
+ *
+ * The copy is written next to @p to and renamed into place, so @p to is
+ * never left truncated.
+ *
+ * @return 1 on success, 0 otherwise.
+ */
+int z_copy_file(const char *from, const char *to);
+
 /**
  * @brief Get current process ID.
  */
 int z_get_pid(void);
 
+/**
+ * @brief Get the number of online processors (at least 1).
+ */
+int z_get_cpu_count(void);
+
 /**
  * @brief Get the path of the current executable.
  */
@@ -147,6 +180,13 @@ void z_get_executable_path(char *buffer, size_t size);
  */
 int z_isatty(int fd);
 
+/**
+ * @brief Wait until @p fd has input (or end of input) to read.
+ * @param timeout_ms Milliseconds to wait at most, or -1 to wait indefinitely.
+ * @return 1 if a read will not block, 0 on timeout.
+ */
+int z_wait_readable(int fd, int timeout_ms);
+
 // Console / REPL
 void repl_enable_raw_mode(void);
 void repl_disable_raw_mode(void);
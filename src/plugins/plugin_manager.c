@@ -1,6 +1,7 @@
 
 #include "plugin_manager.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,6 +16,30 @@ typedef struct PluginNode
 
 static PluginNode *head = NULL;
 
+// Files can be parsed on several threads (language server indexing).
+static pthread_mutex_t plugins_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static ZPlugin *find_plugin(const char *name)
+{
+    for (PluginNode *curr = head; curr; curr = curr->next)
+    {
+        if (strcmp(curr->plugin->name, name) == 0)
+        {
+            return curr->plugin;
+        }
+    }
+    return NULL;
+}
+
+static void add_plugin(ZPlugin *plugin, void *handle)
+{
+    PluginNode *node = malloc(sizeof(PluginNode));
+    node->plugin = plugin;
+    node->handle = handle;
+    node->next = head;
+    head = node;
+}
+
 #include "../platform/os.h"
 
 void zptr_plugin_mgr_init(void)
@@ -29,16 +54,12 @@ void zptr_register_plugin(ZPlugin *plugin)
         return;
     }
 
-    if (zptr_find_plugin(plugin->name))
+    pthread_mutex_lock(&plugins_lock);
+    if (!find_plugin(plugin->name))
     {
-        return;
+        add_plugin(plugin, NULL);
     }
-
-    PluginNode *node = malloc(sizeof(PluginNode));
-    node->plugin = plugin;
-    node->handle = NULL;
-    node->next = head;
-    head = node;
+    pthread_mutex_unlock(&plugins_lock);
 }
 
 ZPlugin *zptr_load_plugin(const char *path)
@@ -65,28 +86,29 @@ ZPlugin *zptr_load_plugin(const char *path)
         return NULL;
     }
 
-    // Register
-    PluginNode *node = malloc(sizeof(PluginNode));
-    node->plugin = plugin;
-    node->handle = handle;
-    node->next = head;
-    head = node;
+    // Register, unless another thread loaded it meanwhile.
+    pthread_mutex_lock(&plugins_lock);
+    ZPlugin *loaded = find_plugin(plugin->name);
+    if (loaded)
+    {
+        z_dlclose(handle);
+        plugin = loaded;
+    }
+    else
+    {
+        add_plugin(plugin, handle);
+    }
+    pthread_mutex_unlock(&plugins_lock);
 
     return plugin;
 }
 
 ZPlugin *zptr_find_plugin(const char *name)
 {
-    PluginNode *curr = head;
-    while (curr)
-    {
-        if (strcmp(curr->plugin->name, name) == 0)
-        {
-            return curr->plugin;
-        }
-        curr = curr->next;
-    }
-    return NULL;
+    pthread_mutex_lock(&plugins_lock);
+    ZPlugin *plugin = find_plugin(name);
+    pthread_mutex_unlock(&plugins_lock);
+    return plugin;
 }
 
 void zptr_plugin_mgr_cleanup(void)
@@ -0,0 +1,311 @@
+#include "build_cache.h"
+#include "hash.h"
+#include "platform/os.h"
+#include "zprep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static int is_regular_file(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static int is_c_source(const char *path)
+{
+    static const char *exts[] = {".c", ".cc", ".cpp", ".cxx", ".m", ".mm", ".cu", NULL};
+    const char *dot = strrchr(path, '.');
+    for (int i = 0; dot && exts[i]; i++)
+    {
+        if (strcmp(dot, exts[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether args[i] names an input file rather than an option or the compiler.
+static int is_input(const ArgList *args, size_t i, size_t cc_words)
+{
+    const char *arg = args->args[i];
+    return i >= cc_words && arg[0] != '-' && is_regular_file(arg) &&
+           !(i > 0 && strcmp(args->args[i - 1], "-o") == 0);
+}
+
+static unsigned long long hash_file(unsigned long long h, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        return h;
+    }
+    char buf[8192];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        h = hash_fnv1a(h, buf, n);
+    }
+    fclose(f);
+    return h;
+}
+
+// Folds the preprocessed form of `source`, which takes in every header it
+// includes, into `h`. Returns 0 if the compiler could not preprocess it.
+static int hash_preprocessed(const ArgList *args, size_t cc_words, const char *source,
+                             unsigned long long *h)
+{
+    char out[MAX_PATH_SIZE];
+    snprintf(out, sizeof(out), "%s/zc_build_pp_%d.i", z_get_temp_dir(), z_get_pid());
+
+    ArgList pp;
+    arg_list_init(&pp);
+    for (size_t i = 0; i < args->count; i++)
+    {
+        if (strcmp(args->args[i], "-o") == 0)
+        {
+            i++;
+            continue;
+        }
+        if (!is_input(args, i, cc_words))
+        {
+            arg_list_add(&pp, args->args[i]);
+        }
+    }
+    // Warnings come from the real compile.
+    arg_list_add(&pp, "-w");
+    arg_list_add(&pp, "-E");
+    arg_list_add(&pp, "-o");
+    arg_list_add(&pp, out);
+    arg_list_add(&pp, source);
+    int ok = arg_run(&pp) == 0 && is_regular_file(out);
+    arg_list_free(&pp);
+    if (ok)
+    {
+        *h = hash_file(*h, out);
+    }
+    remove(out);
+    return ok;
+}
+
+// Asks the compiler where it would find `file` in its default library
+// directories.
+static int find_with_compiler(const char *file, char *buf, size_t size)
+{
+    if (!backend_is_gnu_like())
+    {
+        return 0;
+    }
+    char out[MAX_PATH_SIZE];
+    char cmd[MAX_PATH_SIZE * 2];
+    snprintf(out, sizeof(out), "%s/zc_build_lib_%d.txt", z_get_temp_dir(), z_get_pid());
+    snprintf(cmd, sizeof(cmd), "%s -print-file-name=%s > \"%s\"%s", g_config.cc, file, out,
+             z_is_windows() ? " 2>NUL" : " 2>/dev/null");
+    int ignored = system(cmd);
+    (void)ignored;
+    char *text = load_file(out);
+    remove(out);
+    if (!text)
+    {
+        return 0;
+    }
+    size_t len = strlen(text);
+    while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r'))
+    {
+        text[--len] = 0;
+    }
+    // An unknown file is echoed back as given.
+    int found = strcmp(text, file) != 0 && is_regular_file(text);
+    if (found)
+    {
+        snprintf(buf, size, "%s", text);
+    }
+    free(text);
+    return found;
+}
+
+// Resolves `-l<name>` the way the linker does: the -L directories in order,
+// then the compiler's own.
+static int resolve_library(const ArgList *args, const char *name, char *buf, size_t size)
+{
+    int is_static = 0;
+    for (size_t i = 0; i < args->count; i++)
+    {
+        if (strcmp(args->args[i], "-static") == 0)
+        {
+            is_static = 1;
+        }
+    }
+    char files[4][256];
+    int count = 0;
+    if (name[0] == ':')
+    {
+        snprintf(files[count++], sizeof(files[0]), "%s", name + 1);
+    }
+    else
+    {
+        if (is_static)
+        {
+            snprintf(files[count++], sizeof(files[0]), "lib%s.a", name);
+        }
+        snprintf(files[count++], sizeof(files[0]), "lib%s.so", name);
+        snprintf(files[count++], sizeof(files[0]), "lib%s.dylib", name);
+        if (!is_static)
+        {
+            snprintf(files[count++], sizeof(files[0]), "lib%s.a", name);
+        }
+        snprintf(files[count++], sizeof(files[0]), "%s.lib", name);
+    }
+
+    for (size_t i = 0; i < args->count; i++)
+    {
+        const char *dir = NULL;
+        if (strcmp(args->args[i], "-L") == 0 && i + 1 < args->count)
+        {
+            dir = args->args[++i];
+        }
+        else if (strncmp(args->args[i], "-L", 2) == 0)
+        {
+            dir = args->args[i] + 2;
+        }
+        for (int j = 0; dir && j < count; j++)
+        {
+            snprintf(buf, size, "%s/%s", dir, files[j]);
+            if (is_regular_file(buf))
+            {
+                return 1;
+            }
+        }
+    }
+    for (int j = 0; j < count; j++)
+    {
+        if (find_with_compiler(files[j], buf, size))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int build_inputs_hash(const ArgList *args, unsigned long long *key)
+{
+    ArgList cc;
+    arg_list_init(&cc);
+    arg_list_add_from_string(&cc, g_config.cc);
+    size_t cc_words = cc.count;
+    arg_list_free(&cc);
+
+    unsigned long long h = hash_fnv1a_str(HASH_FNV1A_SEED, hash_toolchain_id());
+    for (size_t i = 0; i < args->count; i++)
+    {
+        h = hash_fnv1a_str(h, args->args[i]);
+    }
+    for (size_t i = 0; i < args->count; i++)
+    {
+        if (!is_input(args, i, cc_words))
+        {
+            continue;
+        }
+        const char *input = args->args[i];
+        if (is_c_source(input))
+        {
+            if (!hash_preprocessed(args, cc_words, input, &h))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            h = hash_file(h, input);
+        }
+    }
+    for (size_t i = 0; i < args->count; i++)
+    {
+        const char *name = NULL;
+        if (strcmp(args->args[i], "-l") == 0 && i + 1 < args->count)
+        {
+            name = args->args[++i];
+        }
+        else if (strncmp(args->args[i], "-l", 2) == 0)
+        {
+            name = args->args[i] + 2;
+        }
+        if (!name)
+        {
+            continue;
+        }
+        char lib[MAX_PATH_SIZE];
+        if (!resolve_library(args, name, lib, sizeof(lib)))
+        {
+            return 0;
+        }
+        h = hash_file(h, lib);
+    }
+    *key = h;
+    return 1;
+}
+
+// The file the compiler writes for `-o outfile`.
+static void output_path(const char *outfile, char *buf, size_t size)
+{
+    const char *sep = z_path_last_sep(outfile);
+    const char *base = sep ? sep + 1 : outfile;
+    if (z_is_windows() && !strchr(base, '.'))
+    {
+        snprintf(buf, size, "%s.exe", outfile);
+    }
+    else
+    {
+        snprintf(buf, size, "%s", outfile);
+    }
+}
+
+static char *cache_entry(const char *profile, unsigned long long key, int create)
+{
+    const char *cache = z_get_cache_dir();
+    if (!cache)
+    {
+        return NULL;
+    }
+    char *path = xmalloc(MAX_PATH_SIZE + 96);
+    if (create)
+    {
+        snprintf(path, MAX_PATH_SIZE + 96, "%s/build/%s", cache, profile);
+        z_mkdir_p(path);
+    }
+    snprintf(path, MAX_PATH_SIZE + 96, "%s/build/%s/%016llx", cache, profile, key);
+    return path;
+}
+
+int build_cache_fetch(const char *profile, unsigned long long key, const char *outfile)
+{
+    char *entry = cache_entry(profile, key, 0);
+    if (!entry)
+    {
+        return 0;
+    }
+    int found = 0;
+    if (is_regular_file(entry))
+    {
+        char out[MAX_PATH_SIZE + 8];
+        output_path(outfile, out, sizeof(out));
+        found = z_copy_file(entry, out);
+    }
+    free(entry);
+    return found;
+}
+
+void build_cache_store(const char *profile, unsigned long long key, const char *outfile)
+{
+    char *entry = cache_entry(profile, key, 1);
+    if (!entry)
+    {
+        return;
+    }
+    char out[MAX_PATH_SIZE + 8];
+    output_path(outfile, out, sizeof(out));
+    z_copy_file(out, entry);
+    free(entry);
+}
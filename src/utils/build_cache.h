@@ -0,0 +1,41 @@
+#ifndef BUILD_CACHE_H
+#define BUILD_CACHE_H
+
+#include "cmd.h"
+
+// Reuse of backend builds.
+//
+// Optimized builds, LTO ones above all, spend most of their time in the C
+// compiler. Their output is kept under <cache>/build/<profile>, keyed on
+// everything that goes into the compile command: its arguments, the
+// compiler's version, each C source as the preprocessor expands it (so
+// every header it includes counts) and the content of the other input
+// files, such as objects, and of the libraries -l resolves to. A build
+// whose library cannot be found is not cached.
+
+/**
+ * @brief Hashes a compile command and everything its inputs pull in.
+ *
+ * C sources are run through the preprocessor (`cc -E`) with the command's
+ * own flags.
+ *
+ * @param key Set to the hash.
+ * @return 1 on success, 0 if a source could not be preprocessed or a
+ *         library could not be found, in which case the build must not be
+ *         cached.
+ */
+int build_inputs_hash(const ArgList *args, unsigned long long *key);
+
+/**
+ * @brief Copies a cached build to @p outfile.
+ *
+ * @return 1 if there was one, 0 otherwise.
+ */
+int build_cache_fetch(const char *profile, unsigned long long key, const char *outfile);
+
+/**
+ * @brief Stores @p outfile as the build for @p key.
+ */
+void build_cache_store(const char *profile, unsigned long long key, const char *outfile);
+
+#endif
@@ -71,6 +71,25 @@ void print_usage()
            "         Enable semantic analysis (types, borrows, moves)\n");
     printf("  " COLOR_CYAN "--json" COLOR_RESET "          Emit diagnostics as JSON\n");
     printf("  " COLOR_CYAN "--no-zen" COLOR_RESET "        Disable Zen facts\n");
+    printf("  " COLOR_CYAN "--no-comptime-cache" COLOR_RESET
+           " Always re-run comptime blocks\n");
+    printf("  " COLOR_CYAN "--no-build-cache" COLOR_RESET
+           " Always run the C compiler for profile builds\n");
+    printf("  " COLOR_CYAN "--keep-dead-code" COLOR_RESET
+           " Emit unused functions and vtables too\n");
+    printf("  " COLOR_CYAN "--bounds-checks=<mode>" COLOR_RESET
+           " Index checks: full, elide (default) or off\n");
+    printf("  " COLOR_CYAN "--release" COLOR_RESET "       Optimized build (profile 'release')\n");
+    printf("  " COLOR_CYAN "--release-lto" COLOR_RESET
+           "   Optimized build with link-time optimization\n");
+    printf("  " COLOR_CYAN "--size" COLOR_RESET "          Build optimized for binary size\n");
+    printf("  " COLOR_CYAN "--profile <name>" COLOR_RESET " Use a build profile from zenc.json\n");
+    printf("  " COLOR_CYAN "--pgo" COLOR_RESET
+           "           Profile-guided build: instrument, train, rebuild\n");
+    printf("  " COLOR_CYAN "--pgo-train <cmd>" COLOR_RESET
+           " Training command for --pgo (default: run the program)\n");
+    printf("  " COLOR_CYAN "--pgo-hints" COLOR_RESET
+           "     Suggest @hot/@cold from the --pgo profile\n");
     printf("  " COLOR_CYAN "--cpp" COLOR_RESET "           Use C++ mode\n");
     printf("  " COLOR_CYAN "--objective-c" COLOR_RESET "   Use Objective-C mode\n");
     printf("  " COLOR_CYAN "--cuda" COLOR_RESET "          Use CUDA mode (requires nvcc)\n");
@@ -79,11 +98,100 @@ void print_usage()
     printf("  " COLOR_CYAN "--version" COLOR_RESET "       Print version information\n");
 }
 
+void backend_base_name(char *buf, size_t size)
+{
+    snprintf(buf, size, "%s", g_config.cc);
+    char *space = strchr(buf, ' ');
+    if (space)
+    {
+        *space = 0;
+    }
+    char *sep = z_path_last_sep(buf);
+    if (sep)
+    {
+        memmove(buf, sep + 1, strlen(sep + 1) + 1);
+    }
+}
+
+int backend_is_gnu_like(void)
+{
+    char base[64];
+    backend_base_name(base, sizeof(base));
+    return strstr(base, "gcc") || strstr(base, "g++") || strstr(base, "clang") ||
+           strstr(base, "zig") || strcmp(base, "cc") == 0 || strcmp(base, "c++") == 0 ||
+           strcmp(base, "cc.exe") == 0 || strcmp(base, "c++.exe") == 0;
+}
+
+// Flags of the selected build profile. They go before the user's flags, so
+// an explicit -O or -march on the command line still wins.
+static void add_profile_flags(ArgList *list)
+{
+    const BuildProfile *p = &g_config.profile;
+    if (p->opt[0])
+    {
+        arg_list_add_fmt(list, "-O%s", p->opt);
+    }
+    if (!backend_is_gnu_like())
+    {
+        if (p->lto || p->no_plt || p->hidden_symbols || p->gc_sections || p->march[0])
+        {
+            static int warned = 0;
+            if (!warned)
+            {
+                zwarn("profile '%s': %s only takes its optimization level", p->name, g_config.cc);
+                warned = 1;
+            }
+        }
+        arg_list_add_from_string(list, p->cflags);
+        return;
+    }
+
+    if (p->march[0])
+    {
+        arg_list_add_fmt(list, "-march=%s", p->march);
+    }
+    if (p->lto)
+    {
+        // One command compiles and links the generated C and the extra C
+        // files, so all of them are optimized together.
+        arg_list_add(list, "-flto");
+    }
+#if ZC_OS_LINUX || ZC_OS_BSD || ZC_OS_ANDROID
+    if (p->no_plt)
+    {
+        arg_list_add(list, "-fno-plt");
+    }
+#endif
+#if !ZC_OS_WINDOWS && !ZC_OS_CYGWIN
+    if (p->hidden_symbols)
+    {
+        arg_list_add(list, "-fvisibility=hidden");
+    }
+#endif
+    if (p->gc_sections)
+    {
+        arg_list_add(list, "-ffunction-sections");
+        arg_list_add(list, "-fdata-sections");
+#if ZC_OS_MACOS
+        arg_list_add(list, "-Wl,-dead_strip");
+#else
+        arg_list_add(list, "-Wl,--gc-sections");
+#endif
+    }
+    arg_list_add_from_string(list, p->cflags);
+}
+
 void build_compile_arg_list(ArgList *list, const char *outfile, const char *temp_source_file)
 {
     // Compiler
     arg_list_add_from_string(list, g_config.cc);
 
+    // Build profile
+    if (g_config.profile_name)
+    {
+        add_profile_flags(list);
+    }
+
     // GCC Flags
     arg_list_add_from_string(list, g_config.gcc_flags);
     arg_list_add_from_string(list, g_cflags);
@@ -117,6 +225,10 @@ void build_compile_arg_list(ArgList *list, const char *outfile, const char *temp
     {
         arg_list_add(list, g_config.c_files[i]);
     }
+    for (int i = 0; i < g_config.embed_object_count; i++)
+    {
+        arg_list_add(list, g_config.embed_objects[i]);
+    }
 
     // Platform flags
     if (!z_is_windows() && !g_config.is_freestanding)
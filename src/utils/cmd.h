@@ -107,6 +107,19 @@ int arg_run(ArgList *list);
  */
 void arg_list_add_from_string(ArgList *list, const char *str);
 
+/**
+ * @brief Write the backend compiler's base name (no arguments or directory)
+ * @param buf Buffer to write to
+ * @param size Size of the buffer
+ */
+void backend_base_name(char *buf, size_t size);
+
+/**
+ * @brief Whether the backend takes GCC/Clang options (gcc, clang, zig, cc)
+ * @return 1 if it does, 0 otherwise
+ */
+int backend_is_gnu_like(void);
+
 void build_compile_arg_list(ArgList *list, const char *outfile, const char *temp_source_file);
 
 #endif
@@ -45,6 +45,127 @@ static void append_whitelist(cJSON *c_funcs)
     g_config.c_function_whitelist[current_count + added] = NULL;
 }
 
+// ** Build profiles **
+
+#define MAX_BUILD_PROFILES 16
+
+static BuildProfile g_profiles[MAX_BUILD_PROFILES];
+static int g_profile_count = 0;
+
+static BuildProfile *profile_slot(const char *name)
+{
+    for (int i = 0; i < g_profile_count; i++)
+    {
+        if (strcmp(g_profiles[i].name, name) == 0)
+        {
+            return &g_profiles[i];
+        }
+    }
+    return NULL;
+}
+
+static void init_builtin_profiles(void)
+{
+    if (g_profile_count > 0)
+    {
+        return;
+    }
+
+    BuildProfile release;
+    memset(&release, 0, sizeof(release));
+    strcpy(release.name, "release");
+    strcpy(release.opt, "2");
+    release.no_plt = 1;
+    release.hidden_symbols = 1;
+    g_profiles[g_profile_count++] = release;
+
+    BuildProfile lto = release;
+    strcpy(lto.name, "release-lto");
+    lto.lto = 1;
+    g_profiles[g_profile_count++] = lto;
+
+    BuildProfile size = release;
+    strcpy(size.name, "size");
+    strcpy(size.opt, "s");
+    size.gc_sections = 1;
+    g_profiles[g_profile_count++] = size;
+}
+
+static void copy_json_string(cJSON *obj, const char *key, char *dest, size_t size)
+{
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(obj, key);
+    if (cJSON_IsString(item) && item->valuestring)
+    {
+        snprintf(dest, size, "%s", item->valuestring);
+    }
+}
+
+static void copy_json_bool(cJSON *obj, const char *key, int *dest)
+{
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(obj, key);
+    if (cJSON_IsBool(item))
+    {
+        *dest = cJSON_IsTrue(item);
+    }
+}
+
+// "profiles": { "<name>": { "inherits": "release", "opt": "3", ... } }
+// An existing profile is updated in place; a new one starts as a copy of
+// the profile it inherits from, "release" by default.
+static void load_profiles(cJSON *profiles)
+{
+    init_builtin_profiles();
+    cJSON *entry = NULL;
+    cJSON_ArrayForEach(entry, profiles)
+    {
+        if (!cJSON_IsObject(entry) || !entry->string || !entry->string[0])
+        {
+            continue;
+        }
+        BuildProfile *p = profile_slot(entry->string);
+        if (!p)
+        {
+            if (g_profile_count == MAX_BUILD_PROFILES)
+            {
+                zwarn("too many build profiles in zenc.json, ignoring '%s'", entry->string);
+                continue;
+            }
+            char base[32] = "release";
+            copy_json_string(entry, "inherits", base, sizeof(base));
+            BuildProfile *parent = profile_slot(base);
+            p = &g_profiles[g_profile_count++];
+            if (parent)
+            {
+                *p = *parent;
+            }
+            else
+            {
+                memset(p, 0, sizeof(*p));
+            }
+            snprintf(p->name, sizeof(p->name), "%s", entry->string);
+        }
+        copy_json_string(entry, "opt", p->opt, sizeof(p->opt));
+        copy_json_string(entry, "march", p->march, sizeof(p->march));
+        copy_json_string(entry, "cflags", p->cflags, sizeof(p->cflags));
+        copy_json_bool(entry, "lto", &p->lto);
+        copy_json_bool(entry, "no_plt", &p->no_plt);
+        copy_json_bool(entry, "hidden_symbols", &p->hidden_symbols);
+        copy_json_bool(entry, "gc_sections", &p->gc_sections);
+    }
+}
+
+int find_build_profile(const char *name, BuildProfile *out)
+{
+    init_builtin_profiles();
+    BuildProfile *p = profile_slot(name);
+    if (!p)
+    {
+        return 0;
+    }
+    *out = *p;
+    return 1;
+}
+
 static int load_config_file(const char *path)
 {
     FILE *f = fopen(path, "rb");
@@ -79,6 +200,11 @@ static int load_config_file(const char *path)
         {
             append_whitelist(c_funcs);
         }
+        cJSON *profiles = cJSON_GetObjectItemCaseSensitive(json, "profiles");
+        if (cJSON_IsObject(profiles))
+        {
+            load_profiles(profiles);
+        }
         cJSON_Delete(json);
         return 1;
     }
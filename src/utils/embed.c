@@ -0,0 +1,351 @@
+#include "embed.h"
+#include "cmd.h"
+#include "hash.h"
+#include "platform/os.h"
+#include "zprep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if (ZC_OS_LINUX || ZC_OS_BSD) && (defined(__x86_64__) || defined(__aarch64__))
+#include <elf.h>
+#define EMBED_HAS_ELF_WRITER 1
+#else
+#define EMBED_HAS_ELF_WRITER 0
+#endif
+
+typedef struct EmbedAsset
+{
+    unsigned char digest[HASH_SHA256_SIZE];
+    const unsigned char *data;
+    long len;
+    char *sym;
+    struct EmbedAsset *next;
+} EmbedAsset;
+
+static EmbedAsset *g_embeds = NULL;
+
+// Whether the backend is one of the compilers known to take GNU inline
+// assembly (or `#embed`), so the generated file can fill the symbol itself.
+static int embed_backend_has_gnu_asm(void)
+{
+    if (backend_is_gnu_like())
+    {
+        return 1;
+    }
+    char base[64];
+    backend_base_name(base, sizeof(base));
+    return strstr(base, "tcc") || strstr(base, "nvcc") || strstr(base, "icx") ||
+           strstr(base, "icpx");
+}
+
+#if EMBED_HAS_ELF_WRITER
+static const char embed_shstrtab[] = "\0.rodata\0.symtab\0.strtab\0.shstrtab\0.note.GNU-stack";
+
+enum
+{
+    SH_RODATA = 1,
+    SH_SYMTAB,
+    SH_STRTAB,
+    SH_SHSTRTAB,
+    SH_NOTE,
+    SH_COUNT
+};
+
+// File offsets of the parts of an embed object.
+typedef struct
+{
+    size_t rodata_off;
+    size_t rodata_size;
+    size_t symtab_off;
+    size_t symtab_size;
+    size_t strtab_off;
+    size_t strtab_size;
+    size_t shstrtab_off;
+    size_t shdr_off;
+    size_t file_size;
+} EmbedLayout;
+
+static EmbedLayout embed_layout(const char *sym, long len)
+{
+    EmbedLayout lo;
+    lo.rodata_off = sizeof(Elf64_Ehdr);
+    lo.rodata_size = (size_t)len + 1;
+    lo.symtab_off = (lo.rodata_off + lo.rodata_size + 7) & ~(size_t)7;
+    lo.symtab_size = 2 * sizeof(Elf64_Sym);
+    lo.strtab_off = lo.symtab_off + lo.symtab_size;
+    lo.strtab_size = strlen(sym) + 2;
+    lo.shstrtab_off = lo.strtab_off + lo.strtab_size;
+    lo.shdr_off = (lo.shstrtab_off + sizeof(embed_shstrtab) + 7) & ~(size_t)7;
+    lo.file_size = lo.shdr_off + SH_COUNT * sizeof(Elf64_Shdr);
+    return lo;
+}
+
+// Writes a relocatable ELF object holding `data` plus a NUL in .rodata,
+// under the global symbol `sym`.
+static int embed_write_object(const char *out_path, const char *sym, const unsigned char *data,
+                              long len)
+{
+    size_t sym_len = strlen(sym);
+    EmbedLayout lo = embed_layout(sym, len);
+
+    Elf64_Ehdr eh;
+    memset(&eh, 0, sizeof(eh));
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_type = ET_REL;
+#if defined(__x86_64__)
+    eh.e_machine = EM_X86_64;
+#else
+    eh.e_machine = EM_AARCH64;
+#endif
+    eh.e_version = EV_CURRENT;
+    eh.e_shoff = lo.shdr_off;
+    eh.e_ehsize = sizeof(Elf64_Ehdr);
+    eh.e_shentsize = sizeof(Elf64_Shdr);
+    eh.e_shnum = SH_COUNT;
+    eh.e_shstrndx = SH_SHSTRTAB;
+
+    Elf64_Sym syms[2];
+    memset(syms, 0, sizeof(syms));
+    syms[1].st_name = 1;
+    syms[1].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT);
+    syms[1].st_other = STV_HIDDEN;
+    syms[1].st_shndx = SH_RODATA;
+    syms[1].st_size = lo.rodata_size;
+
+    Elf64_Shdr sh[SH_COUNT];
+    memset(sh, 0, sizeof(sh));
+    sh[SH_RODATA].sh_name = 1;
+    sh[SH_RODATA].sh_type = SHT_PROGBITS;
+    sh[SH_RODATA].sh_flags = SHF_ALLOC;
+    sh[SH_RODATA].sh_offset = lo.rodata_off;
+    sh[SH_RODATA].sh_size = lo.rodata_size;
+    sh[SH_RODATA].sh_addralign = 16;
+    sh[SH_SYMTAB].sh_name = 9;
+    sh[SH_SYMTAB].sh_type = SHT_SYMTAB;
+    sh[SH_SYMTAB].sh_offset = lo.symtab_off;
+    sh[SH_SYMTAB].sh_size = lo.symtab_size;
+    sh[SH_SYMTAB].sh_link = SH_STRTAB;
+    sh[SH_SYMTAB].sh_info = 1; // First global symbol.
+    sh[SH_SYMTAB].sh_addralign = 8;
+    sh[SH_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+    sh[SH_STRTAB].sh_name = 17;
+    sh[SH_STRTAB].sh_type = SHT_STRTAB;
+    sh[SH_STRTAB].sh_offset = lo.strtab_off;
+    sh[SH_STRTAB].sh_size = lo.strtab_size;
+    sh[SH_STRTAB].sh_addralign = 1;
+    sh[SH_SHSTRTAB].sh_name = 25;
+    sh[SH_SHSTRTAB].sh_type = SHT_STRTAB;
+    sh[SH_SHSTRTAB].sh_offset = lo.shstrtab_off;
+    sh[SH_SHSTRTAB].sh_size = sizeof(embed_shstrtab);
+    sh[SH_SHSTRTAB].sh_addralign = 1;
+    sh[SH_NOTE].sh_name = 35; // Marks the stack non-executable.
+    sh[SH_NOTE].sh_type = SHT_PROGBITS;
+    sh[SH_NOTE].sh_offset = lo.shdr_off;
+    sh[SH_NOTE].sh_addralign = 1;
+
+    char tmp_path[MAX_PATH_SIZE];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", out_path, z_get_pid());
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f)
+    {
+        return 0;
+    }
+
+    static const char zeros[8] = {0};
+    int ok = fwrite(&eh, sizeof(eh), 1, f) == 1;
+    ok = ok && fwrite(data, 1, len, f) == (size_t)len;
+    ok = ok && fwrite(zeros, 1, 1 + lo.symtab_off - (lo.rodata_off + lo.rodata_size), f) ==
+                   1 + lo.symtab_off - (lo.rodata_off + lo.rodata_size);
+    ok = ok && fwrite(syms, sizeof(syms), 1, f) == 1;
+    ok = ok && fputc(0, f) != EOF && fwrite(sym, 1, sym_len + 1, f) == sym_len + 1;
+    ok = ok && fwrite(embed_shstrtab, sizeof(embed_shstrtab), 1, f) == 1;
+    size_t pad = lo.shdr_off - (lo.shstrtab_off + sizeof(embed_shstrtab));
+    ok = ok && fwrite(zeros, 1, pad, f) == pad;
+    ok = ok && fwrite(sh, sizeof(sh), 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp_path, out_path) != 0)
+    {
+        remove(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+#endif
+
+// Finds or writes the cached object for an asset, and adds it to the link.
+static int embed_link_object(const char *sym, const unsigned char *data, long len)
+{
+#if EMBED_HAS_ELF_WRITER
+    const char *cache = z_get_cache_dir();
+    size_t max_objects = sizeof(g_config.embed_objects) / sizeof(g_config.embed_objects[0]);
+    if (!cache || (size_t)g_config.embed_object_count >= max_objects)
+    {
+        return 0;
+    }
+
+    char dir[MAX_PATH_SIZE];
+    snprintf(dir, sizeof(dir), "%s/embed", cache);
+    z_mkdir_p(dir);
+
+    // The symbol names the content by its SHA-256, so an object of the
+    // right size under that name holds these bytes. Objects are renamed
+    // into place once complete; the size check also catches any left
+    // truncated by other means.
+    char obj[MAX_PATH_SIZE + 128];
+    snprintf(obj, sizeof(obj), "%s/%s.o", dir, sym);
+    struct stat st;
+    int cached = stat(obj, &st) == 0 && (size_t)st.st_size == embed_layout(sym, len).file_size;
+    if (!cached && !embed_write_object(obj, sym, data, len))
+    {
+        return 0;
+    }
+    g_config.embed_objects[g_config.embed_object_count++] = xstrdup(obj);
+    return 1;
+#else
+    (void)sym;
+    (void)data;
+    (void)len;
+    return 0;
+#endif
+}
+
+// `s` with `\` and `"` escaped for a C or assembler string literal.
+static char *embed_escape(const char *s)
+{
+    char *e = xmalloc(strlen(s) * 2 + 1);
+    char *p = e;
+    for (; *s; s++)
+    {
+        if (*s == '\\' || *s == '"')
+        {
+            *p++ = '\\';
+        }
+        *p++ = *s;
+    }
+    *p = 0;
+    return e;
+}
+
+static void embed_emit_definition(FILE *out, const char *sym, const char *path, int first)
+{
+    if (first)
+    {
+        fprintf(out, "#if defined(__APPLE__)\n");
+        fprintf(out, "#define ZC_EMBED_BEGIN(s) \".const_data\\n.globl \" s \"\\n.private_extern \" "
+                     "s \"\\n.weak_definition \" s \"\\n.p2align 4\\n\" s \":\\n\"\n");
+        fprintf(out, "#define ZC_EMBED_END(s) \"\\n.text\\n\"\n");
+        fprintf(out, "#elif defined(_WIN32)\n");
+        fprintf(out, "#define ZC_EMBED_BEGIN(s) \".section .rdata,\\\"dr\\\"\\n.p2align 4\\n\" s "
+                     "\":\\n\"\n");
+        fprintf(out, "#define ZC_EMBED_END(s) \"\\n.text\\n\"\n");
+        fprintf(out, "#else\n");
+        fprintf(out, "#define ZC_EMBED_BEGIN(s) \".pushsection .rodata\\n.weak \" s \"\\n.hidden \" "
+                     "s \"\\n.type \" s \", %%object\\n.balign 16\\n\" s \":\\n\"\n");
+        fprintf(out, "#define ZC_EMBED_END(s) \"\\n.size \" s \", . - \" s \"\\n.popsection\\n\"\n");
+        fprintf(out, "#endif\n");
+    }
+
+    // `#embed` takes its file name as written, with no escapes, so a name
+    // holding a quote can only go through `.incbin`.
+    const char *cond = "#if";
+    if (!strchr(path, '"'))
+    {
+        fprintf(out, "#if defined(__has_embed)\n");
+        fprintf(out, "static const unsigned char %s[] = {\n#embed \"%s\"\n, 0};\n", sym, path);
+        cond = "#elif";
+    }
+    // The .incbin operand is an assembler string inside a C string.
+    char *asm_path = embed_escape(path);
+    char *c_path = embed_escape(asm_path);
+    fprintf(out, "%s defined(__GNUC__) || defined(__TINYC__)\n", cond);
+    fprintf(out, "extern const unsigned char %s[] __asm__(\"%s\");\n", sym, sym);
+    fprintf(out,
+            "__asm__(ZC_EMBED_BEGIN(\"%s\") \".incbin \\\"%s\\\"\\n.byte 0\" "
+            "ZC_EMBED_END(\"%s\"));\n",
+            sym, c_path, sym);
+    free(c_path);
+    free(asm_path);
+    fprintf(out, "#else\n");
+    fprintf(out, "extern const unsigned char %s[];\n", sym);
+    fprintf(out, "#endif\n");
+}
+
+const char *embed_large(ParserContext *ctx, const char *path, const unsigned char *data,
+                        long len)
+{
+    unsigned char digest[HASH_SHA256_SIZE];
+    hash_sha256(data, len, digest);
+    for (EmbedAsset *a = g_embeds; a; a = a->next)
+    {
+        if (a->len == len && memcmp(a->digest, digest, sizeof(digest)) == 0)
+        {
+            // Same digest, different bytes: the symbol is taken, so inline.
+            return memcmp(a->data, data, len) == 0 ? a->sym : NULL;
+        }
+    }
+
+    // The path ends up in `#embed` and in string literals. Windows takes
+    // either separator, so it gets the one that needs no escaping there.
+    char *abs = realpath(path, NULL);
+    if (!abs)
+    {
+        return NULL;
+    }
+    for (char *p = abs; *p; p++)
+    {
+        if (*p == '\\' && z_is_windows())
+        {
+            *p = '/';
+        }
+        else if (*p == '\n' || *p == '\r')
+        {
+            free(abs);
+            return NULL;
+        }
+    }
+
+    char hex[HASH_SHA256_SIZE * 2 + 1];
+    hash_to_hex(digest, sizeof(digest), hex);
+    char sym[128];
+    snprintf(sym, sizeof(sym), "_zc_embed_%s", hex);
+
+    if (!g_config.mode_transpile && !g_config.mode_lsp && !embed_backend_has_gnu_asm() &&
+        !embed_link_object(sym, data, len))
+    {
+        free(abs);
+        return NULL;
+    }
+
+    if (ctx->hoist_out)
+    {
+        embed_emit_definition(ctx->hoist_out, sym, abs, g_embeds == NULL);
+    }
+    free(abs);
+
+    EmbedAsset *a = xmalloc(sizeof(EmbedAsset));
+    memcpy(a->digest, digest, sizeof(digest));
+    a->data = data;
+    a->len = len;
+    a->sym = xstrdup(sym);
+    a->next = g_embeds;
+    g_embeds = a;
+    return a->sym;
+}
+
+const char *embed_writable(ParserContext *ctx, const char *sym, long len)
+{
+    static int count = 0;
+    char *buf = xmalloc(strlen(sym) + 32);
+    sprintf(buf, "%s_rw%d", sym, count++);
+    if (ctx->hoist_out)
+    {
+        fprintf(ctx->hoist_out, "static unsigned char %s[%ld];\n", buf, len + 1);
+    }
+    return buf;
+}
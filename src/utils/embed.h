@@ -0,0 +1,49 @@
+#ifndef EMBED_H
+#define EMBED_H
+
+#include "parser.h"
+
+// Large `embed` assets.
+//
+// Small files are spelled out byte by byte as a C initializer. Past
+// EMBED_INLINE_MAX bytes that initializer costs the C compiler far more
+// than the data is worth, so each distinct content is emitted once as a
+// read-only symbol instead. The symbol is filled by C23 `#embed` when the
+// C compiler has it, by an `.incbin` directive when it speaks GNU
+// assembler, and otherwise by a relocatable object that zc writes to its
+// cache and links in. Symbols and cached objects are named by the SHA-256
+// of the content.
+
+#define EMBED_INLINE_MAX (64 * 1024)
+
+/**
+ * @brief Emits a large asset as a symbol holding its bytes and a trailing NUL.
+ *
+ * Assets with the same content share one symbol, however many files embed
+ * them.
+ *
+ * @param ctx  Parser context; the symbol's definition goes to its hoist_out.
+ * @param path Path of the asset.
+ * @param data The asset's bytes. They are compared against later assets, so
+ *             they must stay valid for the rest of the compilation.
+ * @param len  Number of bytes.
+ * @return The symbol's C name, or NULL if the asset has to be inlined.
+ */
+const char *embed_large(ParserContext *ctx, const char *path, const unsigned char *data,
+                        long len);
+
+/**
+ * @brief Declares zeroed storage for a writable copy of an embed.
+ *
+ * Inline embeds of arrays and slices are compound literals the program may
+ * write to. A large embed of those types is copied from its shared symbol
+ * into storage of its own each time the expression is evaluated, as the
+ * literal would be initialized.
+ *
+ * @param sym Symbol returned by embed_large().
+ * @param len Number of bytes; the storage also holds the trailing NUL.
+ * @return The storage's C name.
+ */
+const char *embed_writable(ParserContext *ctx, const char *sym, long len);
+
+#endif
@@ -0,0 +1,161 @@
+#include "hash.h"
+#include "platform/os.h"
+#include "zprep.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+unsigned long long hash_fnv1a(unsigned long long h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+unsigned long long hash_fnv1a_str(unsigned long long h, const char *s)
+{
+    return hash_fnv1a(h, s ? s : "", (s ? strlen(s) : 0) + 1);
+}
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t st[8], const unsigned char *p)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 |
+               (uint32_t)p[i * 4 + 2] << 8 | (uint32_t)p[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = SHA256_ROTR(w[i - 15], 7) ^ SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = SHA256_ROTR(w[i - 2], 17) ^ SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = st[0], b = st[1], c = st[2], d = st[3];
+    uint32_t e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t s1 = SHA256_ROTR(e, 6) ^ SHA256_ROTR(e, 11) ^ SHA256_ROTR(e, 25);
+        uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t s0 = SHA256_ROTR(a, 2) ^ SHA256_ROTR(a, 13) ^ SHA256_ROTR(a, 22);
+        uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    st[0] += a;
+    st[1] += b;
+    st[2] += c;
+    st[3] += d;
+    st[4] += e;
+    st[5] += f;
+    st[6] += g;
+    st[7] += h;
+}
+
+void hash_sha256(const void *data, size_t len, unsigned char out[HASH_SHA256_SIZE])
+{
+    uint32_t st[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    const unsigned char *p = data;
+    size_t left = len;
+    for (; left >= 64; left -= 64, p += 64)
+    {
+        sha256_block(st, p);
+    }
+
+    // The tail, a 0x80 byte, zero padding and the bit length fill one or
+    // two more blocks.
+    unsigned char tail[128] = {0};
+    memcpy(tail, p, left);
+    tail[left] = 0x80;
+    size_t tail_len = left < 56 ? 64 : 128;
+    unsigned long long bits = (unsigned long long)len * 8;
+    for (int i = 0; i < 8; i++)
+    {
+        tail[tail_len - 1 - i] = (unsigned char)(bits >> (i * 8));
+    }
+    sha256_block(st, tail);
+    if (tail_len == 128)
+    {
+        sha256_block(st, tail + 64);
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        out[i * 4] = (unsigned char)(st[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(st[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(st[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)st[i];
+    }
+}
+
+void hash_to_hex(const unsigned char *bytes, size_t len, char *out)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++)
+    {
+        out[i * 2] = digits[bytes[i] >> 4];
+        out[i * 2 + 1] = digits[bytes[i] & 15];
+    }
+    out[len * 2] = 0;
+}
+
+const char *hash_toolchain_id(void)
+{
+    static char *id = NULL;
+    if (id)
+    {
+        return id;
+    }
+
+    char exe[MAX_PATH_SIZE];
+    z_get_executable_path(exe, sizeof(exe));
+    struct stat st;
+    long long exe_size = 0, exe_mtime = 0;
+    if (stat(exe, &st) == 0)
+    {
+        exe_size = (long long)st.st_size;
+        exe_mtime = (long long)st.st_mtime;
+    }
+
+    char ver_file[MAX_PATH_SIZE];
+    char cmd[MAX_PATH_SIZE + 128];
+    snprintf(ver_file, sizeof(ver_file), "%s/zc_cc_version_%d.txt", z_get_temp_dir(), z_get_pid());
+    snprintf(cmd, sizeof(cmd), "%s --version > \"%s\" 2>&1", g_config.cc, ver_file);
+    int ignored = system(cmd);
+    (void)ignored;
+    char *ver = load_file(ver_file);
+    remove(ver_file);
+
+    size_t len = strlen(exe) + strlen(g_config.cc) + (ver ? strlen(ver) : 0) + 128;
+    id = xmalloc(len);
+    snprintf(id, len, "%s|%s|%lld|%lld|%s|%s", ZEN_VERSION, exe, exe_size, exe_mtime, g_config.cc,
+             ver ? ver : "");
+    free(ver);
+    return id;
+}
@@ -0,0 +1,52 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+
+// Hashes for the caches zc keeps between runs (comptime output, backend
+// builds, PGO profiles, embed objects).
+
+/**
+ * @brief Starting value for hash_fnv1a().
+ */
+#define HASH_FNV1A_SEED 14695981039346656037ULL
+
+/**
+ * @brief Folds @p len bytes into the 64-bit FNV-1a hash @p h.
+ */
+unsigned long long hash_fnv1a(unsigned long long h, const void *data, size_t len);
+
+/**
+ * @brief Folds a string and its terminator into @p h; NULL hashes as "".
+ */
+unsigned long long hash_fnv1a_str(unsigned long long h, const char *s);
+
+/**
+ * @brief Size in bytes of a SHA-256 digest.
+ */
+#define HASH_SHA256_SIZE 32
+
+/**
+ * @brief Computes the SHA-256 digest of @p len bytes.
+ *
+ * For keys where a collision would silently pick the wrong content, such as
+ * cache entries shared between builds.
+ */
+void hash_sha256(const void *data, size_t len, unsigned char out[HASH_SHA256_SIZE]);
+
+/**
+ * @brief Writes @p len bytes as lowercase hex, plus a terminator, to @p out.
+ */
+void hash_to_hex(const unsigned char *bytes, size_t len, char *out);
+
+/**
+ * @brief Identifies the zc binary and the C compiler in use.
+ *
+ * Combines the zc version, the path, size and modification time of the zc
+ * executable, the backend command and the output of `cc --version`. Cache
+ * keys include it, so entries written by another build of zc or another
+ * compiler are never reused. The compiler is probed once per process.
+ */
+const char *hash_toolchain_id(void);
+
+#endif
@@ -0,0 +1,531 @@
+#include "pgo.h"
+#include "build_cache.h"
+#include "cJSON.h"
+#include "cmd.h"
+#include "hash.h"
+#include "platform/os.h"
+#include "zprep.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A function is suggested as @hot once the training run called it at least
+// this often, and at least a tenth as often as the busiest function.
+#define PGO_HOT_MIN_CALLS 1000
+
+typedef enum
+{
+    PGO_NONE,
+    PGO_GCC,
+    PGO_CLANG
+} PgoCompiler;
+
+static PgoCompiler pgo_compiler(void)
+{
+    char base[64];
+    backend_base_name(base, sizeof(base));
+    if (strstr(base, "clang"))
+    {
+        return PGO_CLANG;
+    }
+    // zig cc is Clang underneath but ships no llvm-profdata.
+    if (backend_is_gnu_like() && !strstr(base, "zig"))
+    {
+        return PGO_GCC;
+    }
+    return PGO_NONE;
+}
+
+// A companion tool named like the compiler: gcc-12 -> gcov-12,
+// clang-15 -> llvm-profdata-15.
+static void pgo_tool_name(char *buf, size_t size, const char *tool)
+{
+    char base[64];
+    backend_base_name(base, sizeof(base));
+    const char *dash = strrchr(base, '-');
+    if (dash && dash[1] >= '0' && dash[1] <= '9')
+    {
+        snprintf(buf, size, "%s%s", tool, dash);
+    }
+    else
+    {
+        snprintf(buf, size, "%s", tool);
+    }
+}
+
+static int pgo_file_exists(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+// The profile directory for this build, created if needed; NULL, after a
+// warning, if it cannot be keyed or there is no cache directory.
+static char *pgo_profile_dir(ArgList *args)
+{
+    const char *cache = z_get_cache_dir();
+    if (!cache)
+    {
+        zwarn("--pgo: no cache directory for the profile; building without one");
+        return NULL;
+    }
+
+    // gcc names profiles after the absolute path of the output, so the
+    // working directory is part of the key too.
+    char cwd[MAX_PATH_SIZE];
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        cwd[0] = 0;
+    }
+
+    unsigned long long h;
+    if (!build_inputs_hash(args, &h))
+    {
+        zwarn("--pgo: could not preprocess the generated C or find a library to key the "
+              "profile; building without one");
+        return NULL;
+    }
+    h = hash_fnv1a_str(h, cwd);
+    h = hash_fnv1a_str(h, g_config.pgo_train);
+
+    char *dir = xmalloc(MAX_PATH_SIZE + 32);
+    snprintf(dir, MAX_PATH_SIZE + 32, "%s/pgo/%016llx", cache, h);
+    z_mkdir_p(dir);
+    return dir;
+}
+
+// Collects the files in `dir` whose names end in `ext`.
+static void pgo_list_files(const char *dir, const char *ext, ArgList *out)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+    {
+        return;
+    }
+    size_t ext_len = strlen(ext);
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL)
+    {
+        size_t len = strlen(e->d_name);
+        if (len > ext_len && strcmp(e->d_name + len - ext_len, ext) == 0)
+        {
+            arg_list_add_fmt(out, "%s/%s", dir, e->d_name);
+        }
+    }
+    closedir(d);
+}
+
+static int pgo_run_compile(ArgList *args)
+{
+    if (g_config.verbose)
+    {
+        printf(COLOR_BOLD COLOR_BLUE "     Command" COLOR_RESET);
+        for (size_t i = 0; i < args->count; i++)
+        {
+            printf(" %s", args->args[i]);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    return arg_run(args);
+}
+
+// Runs the training command, or the instrumented program itself.
+static int pgo_train(const char *outfile)
+{
+    if (g_config.pgo_train)
+    {
+        if (!g_config.quiet)
+        {
+            printf(COLOR_BOLD COLOR_GREEN "    Training" COLOR_RESET " %s\n", g_config.pgo_train);
+            fflush(stdout);
+        }
+        return system(g_config.pgo_train);
+    }
+
+    ArgList run;
+    arg_list_init(&run);
+    if (z_path_last_sep(outfile) || z_is_abs_path(outfile))
+    {
+        arg_list_add(&run, outfile);
+    }
+    else
+    {
+        arg_list_add_fmt(&run, "%s%s", z_get_run_prefix(), outfile);
+    }
+    if (!g_config.quiet)
+    {
+        printf(COLOR_BOLD COLOR_GREEN "    Training" COLOR_RESET " %s\n", run.args[0]);
+        fflush(stdout);
+    }
+    int ret = arg_run(&run);
+    arg_list_free(&run);
+    return ret;
+}
+
+// gcc names the notes and profile of `cc -o out src.c` after `out`, or after
+// `out-src` when the base names differ.
+static void pgo_aux_names(const char *outfile, const char *source_file, char aux[2][MAX_PATH_SIZE])
+{
+    char src_base[MAX_PATH_SIZE];
+    char *sep = z_path_last_sep(source_file);
+    snprintf(src_base, sizeof(src_base), "%s", sep ? sep + 1 : source_file);
+    char *dot = strrchr(src_base, '.');
+    if (dot)
+    {
+        *dot = 0;
+    }
+    snprintf(aux[0], MAX_PATH_SIZE, "%s", outfile);
+    snprintf(aux[1], MAX_PATH_SIZE, "%.*s-%.*s", MAX_PATH_SIZE / 2 - 1, outfile,
+             MAX_PATH_SIZE / 2 - 1, src_base);
+}
+
+// Moves the notes file of the --pgo-hints build next to its profile.
+static void pgo_keep_notes(const char *dir, const char *outfile, const char *source_file)
+{
+    char aux[2][MAX_PATH_SIZE];
+    pgo_aux_names(outfile, source_file, aux);
+    char dest[MAX_PATH_SIZE + 32];
+    snprintf(dest, sizeof(dest), "%s/hints.gcno", dir);
+    for (int i = 0; i < 2; i++)
+    {
+        char notes[MAX_PATH_SIZE + 8];
+        snprintf(notes, sizeof(notes), "%s.gcno", aux[i]);
+        if (z_copy_file(notes, dest))
+        {
+            remove(notes);
+            return;
+        }
+    }
+}
+
+// Instruments, trains and records the profile in `dir`. Returns 1 if a
+// profile was recorded.
+//
+// For --pgo-hints the build is separate and not inlined: gcc inlines small
+// functions before it instruments them, so in the optimizing build a hot
+// callee's own counters stay at zero. That profile cannot feed the inlined
+// final build (gcc rejects it as a coverage mismatch), hence its own run.
+static int pgo_record(PgoCompiler cc, const char *dir, ArgList *base, const char *outfile,
+                      const char *source_file, int for_hints)
+{
+    ArgList args;
+    arg_list_init(&args);
+    for (size_t i = 0; i < base->count; i++)
+    {
+        arg_list_add(&args, base->args[i]);
+    }
+    arg_list_add_fmt(&args, "-fprofile-generate=%s", dir);
+    if (for_hints)
+    {
+        arg_list_add(&args, "-fno-inline");
+        arg_list_add(&args, "-ftest-coverage");
+    }
+    if (cc == PGO_GCC)
+    {
+        if (g_parser_ctx && g_parser_ctx->has_async)
+        {
+            arg_list_add(&args, "-fprofile-update=prefer-atomic");
+        }
+    }
+    int ret = pgo_run_compile(&args);
+    arg_list_free(&args);
+    if (ret != 0)
+    {
+        return 0;
+    }
+    if (for_hints)
+    {
+        pgo_keep_notes(dir, outfile, source_file);
+    }
+
+    ret = pgo_train(outfile);
+    if (ret != 0)
+    {
+        zwarn("--pgo: training run exited with status %d; using the profile it left", ret);
+    }
+
+    char ready[MAX_PATH_SIZE + 32];
+    snprintf(ready, sizeof(ready), "%s/ready", dir);
+    if (cc == PGO_CLANG)
+    {
+        ArgList merge;
+        arg_list_init(&merge);
+        char tool[64];
+        pgo_tool_name(tool, sizeof(tool), "llvm-profdata");
+        arg_list_add(&merge, tool);
+        arg_list_add(&merge, "merge");
+        arg_list_add_fmt(&merge, "-output=%s/default.profdata", dir);
+        size_t inputs = merge.count;
+        pgo_list_files(dir, ".profraw", &merge);
+        int merged = merge.count > inputs && pgo_run_compile(&merge) == 0;
+        arg_list_free(&merge);
+        if (!merged)
+        {
+            zwarn("--pgo: could not merge the profile with %s", tool);
+            return 0;
+        }
+    }
+    else
+    {
+        ArgList found;
+        arg_list_init(&found);
+        pgo_list_files(dir, ".gcda", &found);
+        size_t count = found.count;
+        arg_list_free(&found);
+        if (count == 0)
+        {
+            zwarn("--pgo: the training run did not write a profile");
+            return 0;
+        }
+    }
+
+    FILE *f = fopen(ready, "w");
+    if (f)
+    {
+        fclose(f);
+    }
+    return 1;
+}
+
+static ASTNode *pgo_find_function(ParserContext *ctx, const char *name)
+{
+    for (StructRef *r = ctx->parsed_funcs_list; r; r = r->next)
+    {
+        if (r->node && r->node->type == NODE_FUNCTION && r->node->func.name &&
+            strcmp(r->node->func.name, name) == 0)
+        {
+            return r->node;
+        }
+    }
+    for (StructRef *r = ctx->parsed_impls_list; r; r = r->next)
+    {
+        ASTNode *m = NULL;
+        if (r->node && r->node->type == NODE_IMPL)
+        {
+            m = r->node->impl.methods;
+        }
+        else if (r->node && r->node->type == NODE_IMPL_TRAIT)
+        {
+            m = r->node->impl_trait.methods;
+        }
+        for (; m; m = m->next)
+        {
+            if (m->type == NODE_FUNCTION && m->func.name && strcmp(m->func.name, name) == 0)
+            {
+                return m;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Reports @hot / @cold suggestions from the call counts of the profile.
+static void pgo_hints(ParserContext *ctx, const char *dir, const char *main_src,
+                      const char *outfile, const char *source_file)
+{
+    char notes[MAX_PATH_SIZE + 32];
+    char data[MAX_PATH_SIZE + 32];
+    char json[MAX_PATH_SIZE + 32];
+    snprintf(notes, sizeof(notes), "%s/hints.gcno", dir);
+    snprintf(data, sizeof(data), "%s/hints.gcda", dir);
+    snprintf(json, sizeof(json), "%s/hints.json", dir);
+
+    // Profiles are named after the mangled path of their object; pick the
+    // one of the generated C file, not of extra C sources.
+    char aux[2][MAX_PATH_SIZE];
+    pgo_aux_names(outfile, source_file, aux);
+    ArgList found;
+    arg_list_init(&found);
+    pgo_list_files(dir, ".gcda", &found);
+    int have_data = 0;
+    for (size_t i = 0; i < found.count && !have_data; i++)
+    {
+        size_t len = strlen(found.args[i]);
+        for (int a = 0; a < 2 && !have_data; a++)
+        {
+            char *sep = z_path_last_sep(aux[a]);
+            char suffix[MAX_PATH_SIZE + 8];
+            snprintf(suffix, sizeof(suffix), "#%s.gcda", sep ? sep + 1 : aux[a]);
+            size_t slen = strlen(suffix);
+            if (len > slen && strcmp(found.args[i] + len - slen, suffix) == 0)
+            {
+                have_data = z_copy_file(found.args[i], data);
+            }
+        }
+    }
+    arg_list_free(&found);
+    if (!have_data || !pgo_file_exists(notes))
+    {
+        zwarn("--pgo-hints: no call counts were recorded for this build");
+        return;
+    }
+
+    char tool[64];
+    pgo_tool_name(tool, sizeof(tool), "gcov");
+    char cmd[MAX_PATH_SIZE * 3];
+    snprintf(cmd, sizeof(cmd), "%s --json-format --stdout \"%s\" > \"%s\"%s", tool, data, json,
+             z_is_windows() ? " 2>NUL" : " 2>/dev/null");
+    int ret = system(cmd);
+    char *text = ret == 0 ? load_file(json) : NULL;
+    cJSON *root = text ? cJSON_Parse(text) : NULL;
+    if (!root)
+    {
+        zwarn("--pgo-hints: could not read the profile with %s", tool);
+        free(text);
+        return;
+    }
+
+    size_t src_len = main_src ? strlen(main_src) : 0;
+    double max_calls = 0;
+    cJSON *files = cJSON_GetObjectItem(root, "files");
+    cJSON *file;
+    cJSON_ArrayForEach(file, files)
+    {
+        cJSON *fn;
+        cJSON_ArrayForEach(fn, cJSON_GetObjectItem(file, "functions"))
+        {
+            cJSON *calls = cJSON_GetObjectItem(fn, "execution_count");
+            if (cJSON_IsNumber(calls) && calls->valuedouble > max_calls)
+            {
+                max_calls = calls->valuedouble;
+            }
+        }
+    }
+
+    char *saved_filename = g_current_filename;
+    g_current_filename = g_config.input_file;
+    cJSON_ArrayForEach(file, files)
+    {
+        cJSON *fn;
+        cJSON_ArrayForEach(fn, cJSON_GetObjectItem(file, "functions"))
+        {
+            cJSON *name = cJSON_GetObjectItem(fn, "name");
+            cJSON *calls = cJSON_GetObjectItem(fn, "execution_count");
+            if (!cJSON_IsString(name) || !cJSON_IsNumber(calls) ||
+                strcmp(name->valuestring, "main") == 0)
+            {
+                continue;
+            }
+            ASTNode *node = pgo_find_function(ctx, name->valuestring);
+            if (!node || !node->token.start || node->token.start < main_src ||
+                node->token.start >= main_src + src_len)
+            {
+                continue;
+            }
+
+            double n = calls->valuedouble;
+            char msg[512];
+            if (!node->func.hot && n >= PGO_HOT_MIN_CALLS && n * 10 >= max_calls)
+            {
+                snprintf(msg, sizeof(msg), "'%s' was called %.0f times in the training run",
+                         name->valuestring, n);
+                zwarn_with_suggestion(node->token, msg, "Mark it @hot");
+            }
+            else if (!node->func.cold && n == 0)
+            {
+                snprintf(msg, sizeof(msg), "'%s' was never called in the training run",
+                         name->valuestring);
+                zwarn_with_suggestion(node->token, msg, "Mark it @cold if that is typical");
+            }
+        }
+    }
+    g_current_filename = saved_filename;
+    cJSON_Delete(root);
+    free(text);
+}
+
+int pgo_build(ParserContext *ctx, const char *main_src, const char *outfile,
+              const char *source_file)
+{
+    ArgList base;
+    arg_list_init(&base);
+    build_compile_arg_list(&base, outfile, source_file);
+
+    // A profile does little for unoptimized code.
+    int has_opt = 0;
+    for (size_t i = 0; i < base.count; i++)
+    {
+        if (strncmp(base.args[i], "-O", 2) == 0)
+        {
+            has_opt = 1;
+        }
+    }
+    if (!has_opt)
+    {
+        arg_list_add(&base, "-O2");
+    }
+
+    PgoCompiler cc = pgo_compiler();
+    char *dir = cc == PGO_NONE ? NULL : pgo_profile_dir(&base);
+    if (cc == PGO_NONE)
+    {
+        zwarn("--pgo needs gcc or clang; building '%s' without a profile", outfile);
+    }
+
+    int have_profile = 0;
+    int have_hints = 0;
+    char hints_dir[MAX_PATH_SIZE + 48];
+    if (dir)
+    {
+        char ready[MAX_PATH_SIZE + 64];
+        snprintf(ready, sizeof(ready), "%s/ready", dir);
+        have_profile = pgo_file_exists(ready);
+        if (!have_profile)
+        {
+            have_profile = pgo_record(cc, dir, &base, outfile, source_file, 0);
+        }
+        else if (g_config.verbose)
+        {
+            printf(COLOR_BOLD COLOR_BLUE "     Profile" COLOR_RESET " %s (cached)\n", dir);
+        }
+
+        // Recorded before the final build, which overwrites `outfile`.
+        snprintf(hints_dir, sizeof(hints_dir), "%s/hints", dir);
+        if (have_profile && g_config.pgo_hints && cc == PGO_GCC && z_mkdir_p(hints_dir))
+        {
+            snprintf(ready, sizeof(ready), "%s/ready", hints_dir);
+            have_hints = pgo_file_exists(ready) ||
+                         pgo_record(cc, hints_dir, &base, outfile, source_file, 1);
+        }
+    }
+
+    ArgList args;
+    arg_list_init(&args);
+    for (size_t i = 0; i < base.count; i++)
+    {
+        arg_list_add(&args, base.args[i]);
+    }
+    if (have_profile && cc == PGO_GCC)
+    {
+        arg_list_add_fmt(&args, "-fprofile-use=%s", dir);
+    }
+    else if (have_profile && cc == PGO_CLANG)
+    {
+        arg_list_add_fmt(&args, "-fprofile-use=%s/default.profdata", dir);
+    }
+    int ret = pgo_run_compile(&args);
+    arg_list_free(&args);
+    arg_list_free(&base);
+
+    if (ret == 0 && have_profile && g_config.pgo_hints)
+    {
+        if (have_hints)
+        {
+            pgo_hints(ctx, hints_dir, main_src, outfile, source_file);
+        }
+        else if (cc == PGO_GCC)
+        {
+            zwarn("--pgo-hints: no call counts were recorded for this build");
+        }
+        else
+        {
+            zwarn("--pgo-hints needs gcc; the profile is still used for the build");
+        }
+    }
+    free(dir);
+    return ret;
+}
@@ -0,0 +1,32 @@
+#ifndef PGO_H
+#define PGO_H
+
+#include "parser.h"
+
+// Profile-guided builds (`--pgo`).
+//
+// The program is built with profiling instrumentation, trained by running
+// it (or the --pgo-train command), and built again with the recorded
+// profile. Profiles are kept in the zc cache directory, keyed on the
+// preprocessed C (headers included), the compile command, the C compiler
+// and the training command, so rebuilding unchanged code goes straight to
+// the final build.
+// GCC and Clang are supported; other compilers get a plain build.
+
+/**
+ * @brief Builds `outfile` from `source_file` with profile feedback.
+ *
+ * With --pgo-hints, functions of the main input file that the training run
+ * called very often, or never, are reported as @hot / @cold suggestions.
+ * The counts are read with gcov, so hints need GCC.
+ *
+ * @param ctx         Parser context, to map C functions back to the source.
+ * @param main_src    Source text of the main input file.
+ * @param outfile     Executable to produce.
+ * @param source_file Generated C file.
+ * @return The exit status of the final compilation.
+ */
+int pgo_build(ParserContext *ctx, const char *main_src, const char *outfile,
+              const char *source_file);
+
+#endif
@@ -2,8 +2,8 @@
 #include "parser.h"
 #include "zprep.h"
 
-char *g_current_filename = "unknown";
-ParserContext *g_parser_ctx = NULL;
+ZC_THREAD_LOCAL char *g_current_filename = "unknown";
+ZC_THREAD_LOCAL ParserContext *g_parser_ctx = NULL;
 
 // ** Arena Implementation **
 #define ARENA_BLOCK_SIZE (1024 * 1024)
@@ -16,7 +16,8 @@ typedef struct ArenaBlock
     char data[];
 } ArenaBlock;
 
-static ArenaBlock *current_block = NULL;
+// Each thread allocates from its own blocks; memory may still be shared.
+static ZC_THREAD_LOCAL ArenaBlock *current_block = NULL;
 
 static void *arena_alloc_raw(size_t size)
 {
@@ -133,9 +134,9 @@ char *load_file(const char *fn)
 }
 
 // ** Build Directives **
-char g_link_flags[MAX_FLAGS_SIZE] = "";
-char g_cflags[MAX_FLAGS_SIZE] = "";
-int g_warning_count = 0;
+ZC_THREAD_LOCAL char g_link_flags[MAX_FLAGS_SIZE] = "";
+ZC_THREAD_LOCAL char g_cflags[MAX_FLAGS_SIZE] = "";
+ZC_THREAD_LOCAL int g_warning_count = 0;
 CompilerConfig g_config = {0};
 
 static void append_flag(char *dest, size_t max_size, const char *flag)
@@ -175,7 +175,7 @@ void zzen_at(Token t, const char *msg, const char *url)
 {
     fprintf(stderr, COLOR_GREEN "zen: " COLOR_RESET COLOR_BOLD "%s" COLOR_RESET "\n", msg);
 
-    extern char *g_current_filename;
+    extern ZC_THREAD_LOCAL char *g_current_filename;
     if (t.line > 0)
     {
         fprintf(stderr, COLOR_BLUE "  --> " COLOR_RESET "%s:%d:%d\n",
@@ -220,7 +220,7 @@ int zen_trigger_at(ZenTrigger t, Token location)
         return 0;
     }
 
-    extern int g_warning_count;
+    extern ZC_THREAD_LOCAL int g_warning_count;
     if (g_warning_count > 0)
     {
         return 0;
@@ -283,7 +283,7 @@ void zen_trigger_global(void)
         return;
     }
 
-    extern int g_warning_count;
+    extern ZC_THREAD_LOCAL int g_warning_count;
     if (g_warning_count > 0)
     {
         return;
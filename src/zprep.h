@@ -20,7 +20,7 @@
 #define calloc(n, s) xcalloc(n, s)   ///< Allocate and zero memory.
 
 // ** GLOBAL STATE **
-extern char *g_current_filename; ///< Current filename.
+extern ZC_THREAD_LOCAL char *g_current_filename; ///< Current filename.
 
 /**
  * @brief Token types for the Lexer.
@@ -169,9 +169,9 @@ char *load_file(const char *filename);
 #define MAX_PATTERN_SIZE 1024
 
 // ** Build Directives **
-extern char g_link_flags[MAX_FLAGS_SIZE];
-extern char g_cflags[MAX_FLAGS_SIZE];
-extern int g_warning_count;
+extern ZC_THREAD_LOCAL char g_link_flags[MAX_FLAGS_SIZE];
+extern ZC_THREAD_LOCAL char g_cflags[MAX_FLAGS_SIZE];
+extern ZC_THREAD_LOCAL int g_warning_count;
 
 struct ParserContext;
 
@@ -188,17 +188,44 @@ int levenshtein(const char *s1, const char *s2);
 // Diagnostics (errors and warnings) are in diagnostics/diagnostics.h
 #include "diagnostics/diagnostics.h"
 
+/**
+ * @brief Backend settings of a build profile (--release, --release-lto, --size).
+ */
+typedef struct
+{
+    char name[32];      ///< Profile name.
+    char opt[8];        ///< Optimization level, as in -O<opt>.
+    int lto;            ///< 1 to compile and link with -flto.
+    int no_plt;         ///< 1 for -fno-plt (ELF targets).
+    int hidden_symbols; ///< 1 for -fvisibility=hidden; only @export stays visible.
+    int gc_sections;    ///< 1 to drop unused functions and data at link time.
+    char march[64];     ///< -march value; empty for the compiler's default.
+    char cflags[512];   ///< Extra backend flags.
+} BuildProfile;
+
+/**
+ * @brief How indexing is bounds checked (--bounds-checks=).
+ */
+typedef enum
+{
+    BOUNDS_CHECKS_ELIDE = 0, ///< Leave out the checks range analysis proves redundant.
+    BOUNDS_CHECKS_FULL,      ///< Check every access.
+    BOUNDS_CHECKS_OFF        ///< Check nothing.
+} BoundsChecks;
+
 /**
  * @brief Compiler configuration and flags.
  */
 typedef struct
 {
-    char *input_file;      ///< Input source file path.
-    char *extra_files[64]; ///< Additional input files.
-    int extra_file_count;  ///< Number of extra input files.
-    char *c_files[64];     ///< Additional C/C++/OBJ files to be passed directly to backend.
-    int c_file_count;      ///< Number of C/C++/OBJ files.
-    char *output_file;     ///< Output binary file path.
+    char *input_file;        ///< Input source file path.
+    char *extra_files[64];   ///< Additional input files.
+    int extra_file_count;    ///< Number of extra input files.
+    char *c_files[64];       ///< Additional C/C++/OBJ files to be passed directly to backend.
+    int c_file_count;        ///< Number of C/C++/OBJ files.
+    char *embed_objects[64]; ///< Objects zc wrote for large embeds (see utils/embed.h).
+    int embed_object_count;  ///< Number of embed objects.
+    char *output_file;       ///< Output binary file path.
 
     // Modes.
     int mode_run;        ///< 1 if 'run' command (compile & execute).
@@ -217,7 +244,17 @@ typedef struct
     int json_output;     ///< 1 if --json (emit structured JSON diagnostics).
     int use_typecheck;   ///< 1 if --typecheck (enable manual semantic analysis).
 
-    int keep_comments; ///< 1 if --keep-comments (preserve comments in output).
+    int keep_comments;     ///< 1 if --keep-comments (preserve comments in output).
+    int no_comptime_cache; ///< 1 if --no-comptime-cache (always re-run comptime blocks).
+    int no_build_cache;    ///< 1 if --no-build-cache (always run the C compiler).
+    int keep_dead_code;    ///< 1 if --keep-dead-code (emit unused functions too).
+    int bounds_checks;     ///< BoundsChecks mode (--bounds-checks=).
+    int pgo;               ///< 1 if --pgo (profile-guided build).
+    int pgo_hints;         ///< 1 if --pgo-hints (suggest @hot/@cold from the profile).
+    char *pgo_train;       ///< --pgo-train command; NULL runs the program itself.
+
+    char *profile_name;   ///< Build profile selected on the command line, or NULL.
+    BuildProfile profile; ///< Its settings, resolved once the configs are loaded.
 
     // GCC Flags accumulator.
     char gcc_flags[4096]; ///< Flags passed to the backend compiler.
@@ -237,8 +274,8 @@ typedef struct
 } CompilerConfig;
 
 extern CompilerConfig g_config;
-extern char g_link_flags[];
-extern char g_cflags[];
+extern ZC_THREAD_LOCAL char g_link_flags[];
+extern ZC_THREAD_LOCAL char g_cflags[];
 
 struct ParserContext;
 
@@ -255,4 +292,11 @@ void scan_build_directives(struct ParserContext *ctx, const char *src);
  */
 void load_all_configs(void);
 
+/**
+ * @brief Looks up a build profile: a built-in one or one from zenc.json.
+ *
+ * @return 1 and fills @p out if the profile exists, 0 otherwise.
+ */
+int find_build_profile(const char *name, BuildProfile *out);
+
 #endif
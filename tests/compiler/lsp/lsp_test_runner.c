@@ -242,6 +242,49 @@ void test_hover()
     free(resp);
 }
 
+void test_incremental_change()
+{
+    printf("Running test_incremental_change...\n");
+    // Line 0: fn alpha() {}
+    // Line 1: fn main() {
+    // Line 2: }
+    send_request(
+        "{\"jsonrpc\": \"2.0\", \"method\": \"textDocument/didOpen\", \"params\": "
+        "{\"textDocument\": {\"uri\": \"file:///tmp/test_incr.zc\", \"languageId\": \"zenc\", "
+        "\"version\": 1, \"text\": \"fn alpha() {}\\nfn main() {\\n}\"}}}");
+
+    // Rename alpha to target, then call it on a new line 2; the edits arrive
+    // as separate notifications, as when typing.
+    send_request("{\"jsonrpc\": \"2.0\", \"method\": \"textDocument/didChange\", \"params\": "
+                 "{\"textDocument\": {\"uri\": \"file:///tmp/test_incr.zc\", \"version\": 2}, "
+                 "\"contentChanges\": [{\"range\": {\"start\": {\"line\": 0, \"character\": 3}, "
+                 "\"end\": {\"line\": 0, \"character\": 8}}, \"text\": \"target\"}]}}");
+    send_request("{\"jsonrpc\": \"2.0\", \"method\": \"textDocument/didChange\", \"params\": "
+                 "{\"textDocument\": {\"uri\": \"file:///tmp/test_incr.zc\", \"version\": 3}, "
+                 "\"contentChanges\": [{\"range\": {\"start\": {\"line\": 2, \"character\": 0}, "
+                 "\"end\": {\"line\": 2, \"character\": 0}}, \"text\": \"    target();\\n\"}]}}");
+
+    // Sent before the diagnostics delay runs out: must still see both edits.
+    send_request("{\"jsonrpc\": \"2.0\", \"id\": 90, \"method\": \"textDocument/definition\", "
+                 "\"params\": {\"textDocument\": {\"uri\": \"file:///tmp/test_incr.zc\"}, "
+                 "\"position\": {\"line\": 2, \"character\": 6}}}");
+
+    char *resp = wait_for_response(90);
+    if (!resp)
+    {
+        fail("No response for definition after incremental change");
+    }
+    if (strstr(resp, "\"line\":0"))
+    {
+        printf("PASS: test_incremental_change (edits applied)\n");
+    }
+    else
+    {
+        printf("FAIL: test_incremental_change (edits not applied): %s\n", resp);
+    }
+    free(resp);
+}
+
 void test_shutdown()
 {
     printf("Running test_shutdown...\n");
@@ -619,6 +662,7 @@ int main()
     test_references();
     test_rename();
     test_outline();
+    test_incremental_change();
     test_shutdown();
     send_request("{\"jsonrpc\": \"2.0\", \"method\": \"exit\", \"params\": {}}");
     waitpid(child_pid, NULL, 0);
@@ -38,6 +38,134 @@ fi
 # Cleanup
 rm -f "${TEST_NAME%.zc}.c" a.out
 
+# Test 2: Closure contexts
+TEST_NAME="closure_escape.zc"
+echo -n "Testing $TEST_DIR/$TEST_NAME (Closure contexts and specialisation)... "
+
+$ZC "$TEST_DIR/$TEST_NAME" --emit-c > /dev/null 2>&1
+if [ $? -ne 0 ]; then
+    echo "FAIL (Compilation error)"
+    ((FAILED++))
+else
+    # The lambda passed to apply() only gets called: its context goes on the
+    # stack, and a clone of apply() calls it directly. The one passed to
+    # keep() is returned, so it stays on the heap.
+    STACK=$(grep -c "&(struct Lambda_[0-9]*_Ctx){" "${TEST_NAME%.zc}.c")
+    HEAP=$(grep -c "malloc(sizeof(struct Lambda_" "${TEST_NAME%.zc}.c")
+    DIRECT=$(grep -c "_lambda_0(f.ctx, x)" "${TEST_NAME%.zc}.c")
+
+    if [ "$STACK" -eq 1 ] && [ "$HEAP" -eq 1 ] && [ "$DIRECT" -eq 1 ]; then
+        echo "PASS"
+        ((PASSED++))
+    else
+        echo "FAIL (Found $STACK stack and $HEAP heap contexts, $DIRECT direct calls, expected 1, 1 and 1)"
+        ((FAILED++))
+    fi
+fi
+
+rm -f "${TEST_NAME%.zc}.c" a.out
+
+# Test 3: Switch lowering for match
+TEST_NAME="match_switch.zc"
+echo -n "Testing $TEST_DIR/$TEST_NAME (Match lowered to switch)... "
+
+$ZC "$TEST_DIR/$TEST_NAME" --emit-c > /dev/null 2>&1
+if [ $? -ne 0 ]; then
+    echo "FAIL (Compilation error)"
+    ((FAILED++))
+else
+    # The enum match becomes a switch on the tag; the string match stays an
+    # if-chain of strcmp() calls.
+    SWITCH=$(grep -c "switch (_m_[0-9]*.tag)" "${TEST_NAME%.zc}.c")
+    STRCMP=$(grep -o "strcmp(_m_[0-9]*, " "${TEST_NAME%.zc}.c" | wc -l)
+
+    if [ "$SWITCH" -eq 1 ] && [ "$STRCMP" -eq 3 ]; then
+        echo "PASS"
+        ((PASSED++))
+    else
+        echo "FAIL (Found $SWITCH switches and $STRCMP string tests, expected 1 and 3)"
+        ((FAILED++))
+    fi
+fi
+
+rm -f "${TEST_NAME%.zc}.c" a.out
+
+# Test 4: Constant folding
+TEST_NAME="const_fold.zc"
+echo -n "Testing $TEST_DIR/$TEST_NAME (Constant folding)... "
+
+$ZC "$TEST_DIR/$TEST_NAME" --emit-c > /dev/null 2>&1
+if [ $? -ne 0 ]; then
+    echo "FAIL (Compilation error)"
+    ((FAILED++))
+else
+    # Literal arithmetic, string concatenation, sizeof and the constant if
+    # are folded; the int overflow is left for the C compiler.
+    FOLDED=$(grep -c "(x \* 86400)\|uint8_t bytes\[16\]\|= \"hello, world\";" "${TEST_NAME%.zc}.c")
+    KEPT=$(grep -c "(2147483647 + 1)" "${TEST_NAME%.zc}.c")
+    DEAD=$(grep -c "unreachable\"" "${TEST_NAME%.zc}.c")
+
+    if [ "$FOLDED" -eq 3 ] && [ "$KEPT" -eq 1 ] && [ "$DEAD" -eq 0 ]; then
+        echo "PASS"
+        ((PASSED++))
+    else
+        echo "FAIL (Found $FOLDED folded, $KEPT kept and $DEAD dead expressions, expected 3, 1 and 0)"
+        ((FAILED++))
+    fi
+fi
+
+rm -f "${TEST_NAME%.zc}.c" "${TEST_NAME%.zc}" a.out
+
+# Test 5: Unused functions, methods and vtables are not emitted
+TEST_NAME="dead_code.zc"
+echo -n "Testing $TEST_DIR/$TEST_NAME (Dead code elimination)... "
+
+$ZC "$TEST_DIR/$TEST_NAME" --emit-c > /dev/null 2>&1
+if [ $? -ne 0 ]; then
+    echo "FAIL (Compilation error)"
+    ((FAILED++))
+else
+    # Only main, twice() and the Square impl of Shape are reachable.
+    LIVE=$(grep -c "^int32_t twice(int32_t x)$\|^Shape_VTable Square_Shape_VTable" "${TEST_NAME%.zc}.c")
+    DEAD=$(grep -c "never_called\|recurse_alone\|Line__Shape_area\|Line_Shape_VTable" "${TEST_NAME%.zc}.c")
+
+    if [ "$LIVE" -eq 2 ] && [ "$DEAD" -eq 0 ]; then
+        echo "PASS"
+        ((PASSED++))
+    else
+        echo "FAIL (Found $LIVE live and $DEAD dead definitions, expected 2 and 0)"
+        ((FAILED++))
+    fi
+fi
+
+rm -f "${TEST_NAME%.zc}.c" "${TEST_NAME%.zc}" a.out
+
+# Test 6: Bounds checks left out or hoisted in range loops
+TEST_NAME="bounds_checks.zc"
+echo -n "Testing $TEST_DIR/$TEST_NAME (Bounds-check elimination)... "
+
+$ZC "$TEST_DIR/$TEST_NAME" --emit-c > /dev/null 2>&1
+if [ $? -ne 0 ]; then
+    echo "FAIL (Compilation error)"
+    ((FAILED++))
+else
+    # `0..8` over int[8] and `0..s.len` need no check; `0..n` compares once
+    # before the loop; the loop that changes its bound keeps both checks.
+    ELIDED=$(grep -c "a\[i\] = i)\|s.data\[i\]" "${TEST_NAME%.zc}.c")
+    HOISTED=$(grep -c "_z_inb_[0-9]* ? i : _z_check_bounds(i, 8)" "${TEST_NAME%.zc}.c")
+    CHECKED=$(grep -o "a\[_z_check_bounds(i, 8)\]" "${TEST_NAME%.zc}.c" | wc -l)
+
+    if [ "$ELIDED" -eq 2 ] && [ "$HOISTED" -eq 1 ] && [ "$CHECKED" -eq 2 ]; then
+        echo "PASS"
+        ((PASSED++))
+    else
+        echo "FAIL (Found $ELIDED elided, $HOISTED hoisted and $CHECKED checked accesses, expected 2, 1 and 2)"
+        ((FAILED++))
+    fi
+fi
+
+rm -f "${TEST_NAME%.zc}.c" "${TEST_NAME%.zc}" a.out
+
 echo "----------------------------------------"
 echo "Summary:"
 echo "-> Passed: $PASSED"